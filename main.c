@@ -22,7 +22,21 @@ int main(int argc, char** argv)
 
     snes_init(&snes);
     snes_loadrom(&snes, rom, rom_size);
-    snes_run(&snes);
+
+    // optional 2nd arg, path to write an instruction trace to
+    if (argc >= 3 && !snes_trace_start(&snes, argv[2]))
+    {
+        printf("failed to start trace: %s\n", argv[2]);
+    }
+
+    // only returns once a breakpoint is hit
+    if (snes_run(&snes) == SNES_RunResult_BREAK)
+    {
+        const struct SNES_DebugHit* hit = snes_debug_get_hit(&snes);
+        printf("breakpoint %u hit - addr: 0x%06X pc: 0x%06X value: 0x%02X\n", hit->id, hit->addr, hit->pc, hit->value);
+    }
+
+    snes_quit(&snes);
 
     return 0;
 }
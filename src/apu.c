@@ -23,6 +23,19 @@
 #define FLAG_C snes->apu.flag_C
 
 
+// NOTE: the apu runs on a clock of its own (~1.024MHz) and isn't stepped
+// along with the cpu. it's caught up to the master clock when the cpu
+// talks to it (APUIO) and on the apu sync event, which is rescheduled
+// every SNES_APU_SYNC_CYCLES so that it never falls far behind.
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesapuspc700iotimers
+enum
+{
+    APU_CLOCK = 1024000, // spc700 cycles per second
+    APU_TIMER_SLOW = 128, // spc700 cycles per tick of timer 0 / 1 (8kHz)
+    APU_TIMER_FAST = 16, // timer 2 (64kHz)
+};
+
 static const uint8_t IPL_ROM[] =
 {
     0xCD, 0xEF, 0xBD, 0xE8, 0x00, 0xC6, 0x1D, 0xD0, 0xFC, 0x8F, 0xAA, 0xF4, 0x8F, 0xBB, 0xF5, 0x78,
@@ -265,8 +278,54 @@ static void DEY(struct SNES_Core* snes)
     set_nz(snes, REG_Y);
 }
 
+// each timer ticks at 8kHz / 64kHz, its 4-bit counter goes up every
+// time the ticks reach the target (0 is 256)
+static void run_timers(struct SNES_Core* snes, uint32_t cycles)
+{
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        const uint32_t period = i == 2 ? APU_TIMER_FAST : APU_TIMER_SLOW;
+        const uint32_t clock = snes->apu.timer_clock[i] + cycles;
+        const uint32_t ticks = clock / period;
+
+        snes->apu.timer_clock[i] = clock % period;
+
+        if (!snes->apu.timer_enable[i])
+        {
+            continue;
+        }
+
+        const uint32_t target = snes->apu.timer[i] ? snes->apu.timer[i] : 256;
+        const uint32_t stage = snes->apu.timer_stage[i] + ticks;
+
+        snes->apu.timer_stage[i] = stage % target;
+        snes->apu.counter[i] = (snes->apu.counter[i] + stage / target) & 0xF;
+    }
+}
+
+void snes_apu_catch_up(struct SNES_Core* snes)
+{
+    const uint64_t clock = snes->cart.pal ? SNES_MASTER_CLOCK_PAL : SNES_MASTER_CLOCK_NTSC;
+    const uint64_t elapsed = snes->scheduler.cycles - snes->apu.master_cycles;
+
+    // the remainder is kept so that no time is lost between syncs
+    snes->apu.clock_frac += elapsed * APU_CLOCK;
+    snes->apu.master_cycles = snes->scheduler.cycles;
+
+    const uint32_t cycles = snes->apu.clock_frac / clock;
+    snes->apu.clock_frac %= clock;
+
+    // todo: run the spc700 (and dsp) for cycles once they're implemented
+    run_timers(snes, cycles);
+}
+
 bool snes_apu_init(struct SNES_Core* snes)
 {
+    snes->apu.master_cycles = snes->scheduler.cycles;
+    snes->apu.clock_frac = 0;
+    memset(snes->apu.timer_clock, 0, sizeof(snes->apu.timer_clock));
+    memset(snes->apu.timer_stage, 0, sizeof(snes->apu.timer_stage));
+
     // set control reg inital value (allow reads from ipl)
     snes_apu_write8(snes, 0x00F1, 0xB0);
 
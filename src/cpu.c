@@ -1,5 +1,6 @@
 #include "bit.h"
 #include "internal.h"
+#include "snes.h"
 #include "types.h"
 #include <stdint.h>
 #include <string.h>
@@ -17,17 +18,42 @@
 #define REG_PBR snes->cpu.PBR
 #define REG_DBR snes->cpu.DBR
 
-// flags
-#define FLAG_C snes->cpu.flag_C
-#define FLAG_Z snes->cpu.flag_Z
-#define FLAG_I snes->cpu.flag_I
-#define FLAG_D snes->cpu.flag_D
-#define FLAG_X snes->cpu.flag_X
-#define FLAG_M snes->cpu.flag_M
-#define FLAG_V snes->cpu.flag_V
-#define FLAG_N snes->cpu.flag_N
+// flags, P is packed apart from N and Z which are lazily
+// evaluated from the last result, see set_nz_8().
+#define FLAG_C ((snes->cpu.P >> 0) & 1)
+#define FLAG_Z ((snes->cpu.nz & 0xFFFF) == 0)
+#define FLAG_I ((snes->cpu.P >> 2) & 1)
+#define FLAG_X ((snes->cpu.P >> 4) & 1)
+#define FLAG_M ((snes->cpu.P >> 5) & 1)
+#define FLAG_V ((snes->cpu.P >> 6) & 1)
+#define FLAG_N (snes->cpu.nz >> 31)
 #define FLAG_E snes->cpu.flag_E
 
+#define SET_FLAG(flag, value) snes->cpu.P = (snes->cpu.P & ~SNES_P_##flag) | ((value) ? SNES_P_##flag : 0)
+
+// width dependent handlers are force inlined when using dispatch tables
+// so that each table gets its own copy with the width checks removed.
+#if SNES_CPU_DISPATCH_TABLES
+    #define CPU_INLINE static inline __attribute__((always_inline))
+#else
+    #define CPU_INLINE static
+#endif
+
+static void update_width(struct SNES_Core* snes)
+{
+    if (FLAG_E)
+    {
+        snes->cpu.width = SNES_CpuWidth_EMULATION;
+    }
+    else if (FLAG_M)
+    {
+        snes->cpu.width = FLAG_X ? SNES_CpuWidth_M8_X8 : SNES_CpuWidth_M8_X16;
+    }
+    else
+    {
+        snes->cpu.width = FLAG_X ? SNES_CpuWidth_M16_X8 : SNES_CpuWidth_M16_X16;
+    }
+}
 
 bool snes_cpu_init(struct SNES_Core* snes)
 {
@@ -37,46 +63,49 @@ bool snes_cpu_init(struct SNES_Core* snes)
     REG_PC = snes_cpu_read16(snes, 0xFFFC);
     // below are taken from bsnes-plus
     REG_SP = 0x01FF;
+    snes->cpu.nz = 1; // N and Z clear
     FLAG_E = true;
-    FLAG_M = true;
-    FLAG_X = true;
-    FLAG_I = true;
+    SET_FLAG(M, true);
+    SET_FLAG(X, true);
+    SET_FLAG(I, true);
+    update_width(snes);
+    snes_cpu_cache_reset(snes);
+    memset(&snes->cpu_idle, 0, sizeof(snes->cpu_idle));
 
     snes_log("initial pc: 0x%04X\n", REG_PC);
 
     return true;
 }
 
+// an irq that was held while interrupts were disabled is taken
+// as soon as they are enabled again.
+static void check_irq(struct SNES_Core* snes)
+{
+    if (!FLAG_I && snes->cpu.irq_line)
+    {
+        snes_scheduler_add(snes, SNES_Event_INTERRUPT, snes->scheduler.cycles);
+    }
+}
+
 static void set_status_flags(struct SNES_Core* snes, uint8_t value)
 {
-    FLAG_C = is_bit_set(0, value);
-    FLAG_Z = is_bit_set(1, value);
-    FLAG_I = is_bit_set(2, value);
-    FLAG_D = is_bit_set(3, value);
-    FLAG_X = is_bit_set(4, value);
-    FLAG_M = is_bit_set(5, value);
-    FLAG_V = is_bit_set(6, value);
-    FLAG_N = is_bit_set(7, value);
+    snes->cpu.P = value & ~(SNES_P_N | SNES_P_Z);
+    // any nz with bit 31 as N and the low 16-bits zero only if Z
+    snes->cpu.nz = ((value & SNES_P_N) ? 0x80000000 : 0) | ((value & SNES_P_Z) ? 0 : 1);
 
     if (FLAG_X)
     {
         REG_X &= 0xFF;
         REG_Y &= 0xFF;
     }
+
+    update_width(snes);
+    check_irq(snes);
 }
 
 static uint8_t get_status_flags(const struct SNES_Core* snes)
 {
-    uint8_t value = 0;
-    value |= FLAG_C << 0;
-    value |= FLAG_Z << 1;
-    value |= FLAG_I << 2;
-    value |= FLAG_D << 3;
-    value |= FLAG_X << 4;
-    value |= FLAG_M << 5;
-    value |= FLAG_V << 6;
-    value |= FLAG_N << 7;
-    return value;
+    return snes->cpu.P | (FLAG_N << 7) | (FLAG_Z << 1);
 }
 
 // basically add the bank byte to addr
@@ -85,172 +114,251 @@ static uint32_t addr(uint32_t bank_byte, uint16_t addr)
     return ((bank_byte << 16) | addr) & 0x00FFFFFF;
 }
 
-// addressing modes
-static void implied(struct SNES_Core* snes)
+// fetches the operand of the current instruction and advances PC.
+// the address of the operand is stored in oprand, which is what the
+// immediate addressing modes use as the effective address.
+static uint32_t fetch(struct SNES_Core* snes, uint8_t len)
 {
-    (void)snes; // does nothing
+    const uint32_t operand_addr = addr(REG_PBR, REG_PC);
+    uint32_t raw = 0;
+
+    snes->cpu.oprand = operand_addr;
+
+    switch (len)
+    {
+        case 1: raw = snes_cpu_read8(snes, operand_addr); break;
+        case 2: raw = snes_cpu_read16(snes, operand_addr); break;
+        case 3: raw = snes_cpu_read24(snes, operand_addr); break;
+    }
+
+    REG_PC += len;
+    return raw;
 }
 
-static void absolute(struct SNES_Core* snes)
+// set in oprand by the immediate modes, addresses are only 24-bit
+#define OPRAND_IMMEDIATE 0x80000000u
+
+// the operand of instructions that have an immediate mode
+static uint8_t read_operand8(struct SNES_Core* snes)
 {
-    snes->cpu.oprand = snes_cpu_read16(snes, addr(REG_PBR, REG_PC));
-    snes->cpu.oprand = addr(REG_DBR, snes->cpu.oprand);
-    // snes_log("[ABS] oprand effective address: 0x%06X\n", snes->cpu.oprand);
+    if (snes->cpu.oprand & OPRAND_IMMEDIATE)
+    {
+        return snes->cpu.oprand;
+    }
 
-    REG_PC += 2;
+    return snes_cpu_read8(snes, snes->cpu.oprand);
 }
 
-static void absolute_x(struct SNES_Core* snes)
+static uint16_t read_operand16(struct SNES_Core* snes)
 {
-    snes->cpu.oprand = snes_cpu_read16(snes, addr(REG_PBR, REG_PC));
-    snes->cpu.oprand = addr(REG_DBR, snes->cpu.oprand + REG_X);
-    // snes_log("[ABS X] oprand effective address: 0x%06X\n", snes->cpu.oprand);
+    if (snes->cpu.oprand & OPRAND_IMMEDIATE)
+    {
+        return snes->cpu.oprand;
+    }
+
+    return snes_cpu_read16(snes, snes->cpu.oprand);
+}
 
-    REG_PC += 2;
+// operand length (in bytes) of each addressing mode
+#define LEN_implied 0
+#define LEN_immediate8 1
+#define LEN_immediateM (m8 ? 1 : 2)
+#define LEN_immediateX (x8 ? 1 : 2)
+#define LEN_relative 1
+#define LEN_direct_page 1
+#define LEN_direct_page_x 1
+#define LEN_direct_page_y 1
+#define LEN_dp_indirect 1
+#define LEN_dp_ind_long 1
+#define LEN_dp_ind_long_y 1
+#define LEN_absolute 2
+#define LEN_absolute_x 2
+#define LEN_absolute_y 2
+#define LEN_absolute_x_write 2
+#define LEN_absolute_y_write 2
+#define LEN_absolute_indirect_long 2
+#define LEN_absolute_long 3
+#define LEN_absolute_long_x 3
+#define LEN_block_move 2
+
+// charges count internal operations (cycles where the cpu doesn't use the bus)
+static void internal_op(struct SNES_Core* snes, unsigned count)
+{
+    snes->scheduler.cycles += SNES_CYCLES_IO * count;
+}
+
+// NOTE: the direct page modes take an extra cycle when the low byte of D
+// isn't zero, the indexed absolute modes take one when the index is 16-bit
+// or the page is crossed (stores and rmw always take it, see *_write).
+// SOURCE: https://problemkaputt.de/fullsnes.htm#cpuclockcycles
+static void dp_penalty(struct SNES_Core* snes)
+{
+    if (REG_D & 0xFF)
+    {
+        internal_op(snes, 1);
+    }
+}
+
+static void index_penalty(struct SNES_Core* snes, uint16_t base, uint16_t index)
+{
+    if (!FLAG_X || ((base + index) ^ base) & 0xFF00)
+    {
+        internal_op(snes, 1);
+    }
+}
+
+// addressing modes, raw is the operand returned by fetch()
+static void implied(struct SNES_Core* snes, uint32_t raw)
+{
+    (void)raw;
+    internal_op(snes, 1);
+}
+
+static void absolute(struct SNES_Core* snes, uint32_t raw)
+{
+    snes->cpu.oprand = addr(REG_DBR, raw);
+    // snes_log("[ABS] oprand effective address: 0x%06X\n", snes->cpu.oprand);
+}
+
+static void absolute_x(struct SNES_Core* snes, uint32_t raw)
+{
+    index_penalty(snes, raw, REG_X);
+    snes->cpu.oprand = addr(REG_DBR, raw + REG_X);
+    // snes_log("[ABS X] oprand effective address: 0x%06X\n", snes->cpu.oprand);
 }
 
-static void absolute_y(struct SNES_Core* snes)
+static void absolute_y(struct SNES_Core* snes, uint32_t raw)
 {
-    snes->cpu.oprand = snes_cpu_read16(snes, addr(REG_PBR, REG_PC));
-    snes->cpu.oprand = addr(REG_DBR, snes->cpu.oprand + REG_Y);
+    index_penalty(snes, raw, REG_Y);
+    snes->cpu.oprand = addr(REG_DBR, raw + REG_Y);
     // snes_log("[ABS Y] oprand effective address: 0x%06X\n", snes->cpu.oprand);
+}
 
-    REG_PC += 2;
+// stores and rmw always spend the cycle, the address can't be guessed
+static void absolute_x_write(struct SNES_Core* snes, uint32_t raw)
+{
+    internal_op(snes, 1);
+
+    snes->cpu.oprand = addr(REG_DBR, raw + REG_X);
 }
 
-static void absolute_long(struct SNES_Core* snes)
+static void absolute_y_write(struct SNES_Core* snes, uint32_t raw)
 {
-    snes->cpu.oprand = snes_cpu_read24(snes, addr(REG_PBR, REG_PC));
-    // snes_log("[ABS LONG] oprand effective address: 0x%06X\n", snes->cpu.oprand);
+    internal_op(snes, 1);
+
+    snes->cpu.oprand = addr(REG_DBR, raw + REG_Y);
+}
 
-    REG_PC += 3;
+static void absolute_long(struct SNES_Core* snes, uint32_t raw)
+{
+    snes->cpu.oprand = raw;
+    // snes_log("[ABS LONG] oprand effective address: 0x%06X\n", snes->cpu.oprand);
 }
 
-static void absolute_indirect_long(struct SNES_Core* snes)
+static void absolute_indirect_long(struct SNES_Core* snes, uint32_t raw)
 {
-    const uint16_t base = snes_cpu_read16(snes, addr(REG_PBR, REG_PC));
+    const uint16_t base = raw;
     snes->cpu.oprand = snes_cpu_read24(snes, base);
     // snes_log("[ABS INDIRECT LONG] oprand effective address: 0x%06X\n", snes->cpu.oprand);
-
-    REG_PC += 2;
 }
 
-static void absolute_long_x(struct SNES_Core* snes)
+static void absolute_long_x(struct SNES_Core* snes, uint32_t raw)
 {
-    snes->cpu.oprand = snes_cpu_read24(snes, addr(REG_PBR, REG_PC)) + REG_X;
+    snes->cpu.oprand = raw + REG_X;
     // snes_log("[ABS LONG X] oprand effective address: 0x%06X\n", snes->cpu.oprand);
-
-    REG_PC += 3;
 }
 
-static void immediate8(struct SNES_Core* snes)
+// MVN / MVP, the operand is the dst bank followed by the src bank
+static void block_move(struct SNES_Core* snes, uint32_t raw)
 {
-    snes->cpu.oprand = addr(REG_PBR, REG_PC++);
-    // snes_log("[IMM8] oprand effective address: 0x%06X\n", snes->cpu.oprand);
+    snes->cpu.oprand = raw;
 }
 
-static void immediate16(struct SNES_Core* snes)
+// the immediate modes keep the operand fetch() already read (and charged)
+// in oprand, so it isn't read again, see read_operand8().
+// they only differ in the operand length.
+static void immediate8(struct SNES_Core* snes, uint32_t raw)
 {
-    snes->cpu.oprand = addr(REG_PBR, REG_PC);
-    REG_PC += 2;
-    // snes_log("[IMM16] oprand effective address: 0x%06X\n", snes->cpu.oprand);
+    snes->cpu.oprand = OPRAND_IMMEDIATE | raw;
 }
 
 // for instructions that use A, such as LDA
-static void immediateM(struct SNES_Core* snes)
+static void immediateM(struct SNES_Core* snes, uint32_t raw)
 {
-    if (FLAG_M)
-    {
-        immediate8(snes);
-    }
-    else
-    {
-        immediate16(snes);
-    }
-
-    // snes_log("[IMM8] oprand effective address: 0x%06X\n", snes->cpu.oprand);
+    snes->cpu.oprand = OPRAND_IMMEDIATE | raw;
 }
 
-// for instructions that use X/Y, such as LDA
-static void immediateX(struct SNES_Core* snes)
+// for instructions that use X/Y, such as LDX
+static void immediateX(struct SNES_Core* snes, uint32_t raw)
 {
-    if (FLAG_X)
-    {
-        immediate8(snes);
-    }
-    else
-    {
-        immediate16(snes);
-    }
-
-    // snes_log("[IMM8] oprand effective address: 0x%06X\n", snes->cpu.oprand);
+    snes->cpu.oprand = OPRAND_IMMEDIATE | raw;
 }
 
-static void relative(struct SNES_Core* snes)
+static void relative(struct SNES_Core* snes, uint32_t raw)
 {
-    snes->cpu.oprand = snes_cpu_read8(snes, addr(REG_PBR, REG_PC++));
+    snes->cpu.oprand = raw;
 
     // snes_log("[REL] value: %d result: 0x%02X\n", (int8_t)snes->cpu.oprand, REG_PC + (int8_t)snes->cpu.oprand);
 }
 
-static void direct_page(struct SNES_Core* snes)
+static void direct_page(struct SNES_Core* snes, uint32_t raw)
 {
-    snes->cpu.oprand = snes_cpu_read8(snes, addr(REG_PBR, REG_PC++));
-    snes->cpu.oprand = (snes->cpu.oprand + REG_D) & 0xFFFF;
+    dp_penalty(snes);
+    snes->cpu.oprand = (raw + REG_D) & 0xFFFF;
     // snes_log("[DP] oprand effective address: 0x%06X\n", snes->cpu.oprand);
 }
 
-static void direct_page_x(struct SNES_Core* snes)
+static void direct_page_x(struct SNES_Core* snes, uint32_t raw)
 {
-    snes->cpu.oprand = snes_cpu_read8(snes, addr(REG_PBR, REG_PC++));
-    snes->cpu.oprand = (snes->cpu.oprand + REG_D + REG_X) & 0xFFFF;
+    dp_penalty(snes);
+    internal_op(snes, 1);
+    snes->cpu.oprand = (raw + REG_D + REG_X) & 0xFFFF;
     // snes_log("[DP X] oprand effective address: 0x%06X\n", snes->cpu.oprand);
 }
 
-static void direct_page_y(struct SNES_Core* snes)
+static void direct_page_y(struct SNES_Core* snes, uint32_t raw)
 {
-    snes->cpu.oprand = snes_cpu_read8(snes, addr(REG_PBR, REG_PC++));
-    snes->cpu.oprand = (snes->cpu.oprand + REG_D + REG_Y) & 0xFFFF;
+    dp_penalty(snes);
+    internal_op(snes, 1);
+    snes->cpu.oprand = (raw + REG_D + REG_Y) & 0xFFFF;
     // snes_log("[DP Y] oprand effective address: 0x%06X\n", snes->cpu.oprand);
 }
 
-static void dp_indirect(struct SNES_Core* snes)
+static void dp_indirect(struct SNES_Core* snes, uint32_t raw)
 {
+    dp_penalty(snes);
     // base + REG_D(indirect)
-    const uint16_t base = snes_cpu_read8(snes, addr(REG_PBR, REG_PC++)) + REG_D;
+    const uint16_t base = raw + REG_D;
     snes->cpu.oprand = snes_cpu_read16(snes, base);
     // snes_log_fatal("[DP INDIRECT] oprand effective address: 0x%06X 0x%04X M: %u\n", snes->cpu.oprand, snes_cpu_read8(snes, snes->cpu.oprand), FLAG_M);
 }
 
-static void dp_ind_long(struct SNES_Core* snes)
+static void dp_ind_long(struct SNES_Core* snes, uint32_t raw)
 {
+    dp_penalty(snes);
     // base + REG_D(indirect)
-    const uint16_t base = snes_cpu_read8(snes, addr(REG_PBR, REG_PC++)) + REG_D;
+    const uint16_t base = raw + REG_D;
     snes->cpu.oprand = snes_cpu_read24(snes, base);
     // snes_log_fatal("[DP IND LONG] oprand effective address: 0x%06X 0x%04X M: %u\n", snes->cpu.oprand, snes_cpu_read8(snes, snes->cpu.oprand), FLAG_M);
 }
 
-static void dp_ind_long_y(struct SNES_Core* snes)
+static void dp_ind_long_y(struct SNES_Core* snes, uint32_t raw)
 {
+    dp_penalty(snes);
     // base + REG_D(indirect)
-    const uint16_t base = snes_cpu_read8(snes, addr(REG_PBR, REG_PC++)) + REG_D;
+    const uint16_t base = raw + REG_D;
     snes->cpu.oprand = (snes_cpu_read24(snes, base) + REG_Y) & 0xFFFFFF;
     // snes_log("[DP IND LONG Y] oprand effective address: 0x%06X 0x%04X M: %u\n", snes->cpu.oprand, snes_cpu_read16(snes, snes->cpu.oprand), FLAG_M);
 }
 
-// for debugging, basically crash at pc and log stuff
-static void breakpoint(const struct SNES_Core* snes, int pc)
+#if SNES_CPU_IDLE_SKIP || SNES_JIT
+// true if every instruction has to be run (and seen) one by one,
+// the jit and idle loop skipping are bypassed when tracing / profiling.
+static bool instrumented(const struct SNES_Core* snes)
 {
-    if (((REG_PBR << 16) | REG_PC) == pc)
-    {
-        snes_log(
-            "[BP] PC: 0x%04X OP: 0x%02X oprand: 0x%06X REG_PBR: 0x%02X REG_A: 0x%04X S: 0x%04X X: 0x%04X Y: 0x%04X P: 0x%02X ticks: %zu\n",
-            REG_PC, snes->opcode, snes->cpu.oprand, REG_PBR, REG_A, REG_SP, REG_X, REG_Y, get_status_flags(snes), snes->ticks
-        );
-
-        getchar();
-    }
+    return snes->trace || snes->profile;
 }
+#endif
 
 // helper that only sets the low half of a 16-bit reg
 static void set_lo_byte(uint16_t* reg, uint8_t byte)
@@ -284,58 +392,59 @@ static uint16_t pop16(struct SNES_Core* snes)
 }
 
 // helper for setting flags NZ
+// the result is stored so that bit 31 is N and the low 16-bits are
+// only zero if the result is, nothing is evaluated until it's read.
 static void set_nz_8(struct SNES_Core* snes, uint8_t value)
 {
-    FLAG_N = is_bit_set(7, value);
-    FLAG_Z = value == 0;
+    snes->cpu.nz = value * 0x01000001u;
 }
 
 static void set_nz_16(struct SNES_Core* snes, uint16_t value)
 {
-    FLAG_N = is_bit_set(15, value);
-    FLAG_Z = value == 0;
+    snes->cpu.nz = value * 0x00010001u;
 }
 
 // set carry flag
 static void SEC(struct SNES_Core* snes)
 {
-    FLAG_C = true;
+    SET_FLAG(C, true);
 }
 
 // set decimal flag
 static void SED(struct SNES_Core* snes)
 {
-    FLAG_D = true;
+    SET_FLAG(D, true);
 }
 
 // set interrupt disable flag
 static void SEI(struct SNES_Core* snes)
 {
-    FLAG_I = true;
+    SET_FLAG(I, true);
 }
 
 // clear carry flag
 static void CLC(struct SNES_Core* snes)
 {
-    FLAG_C = false;
+    SET_FLAG(C, false);
 }
 
 // clear decimal flag
 static void CLD(struct SNES_Core* snes)
 {
-    FLAG_D = false;
+    SET_FLAG(D, false);
 }
 
 // clear interrupt disable flag
 static void CLI(struct SNES_Core* snes)
 {
-    FLAG_I = false;
+    SET_FLAG(I, false);
+    check_irq(snes);
 }
 
 // clear overflow flag
 static void CLV(struct SNES_Core* snes)
 {
-    FLAG_V = false;
+    SET_FLAG(V, false);
 }
 
 // store zero to memory
@@ -345,9 +454,9 @@ static void STZ(struct SNES_Core* snes)
 }
 
 // store x to memory
-static void STX(struct SNES_Core* snes)
+CPU_INLINE void STX(struct SNES_Core* snes, const bool x8)
 {
-    if (FLAG_X)
+    if (x8)
     {
         snes_cpu_write8(snes, snes->cpu.oprand, REG_X);
     }
@@ -358,9 +467,9 @@ static void STX(struct SNES_Core* snes)
 }
 
 // store x to memory
-static void STY(struct SNES_Core* snes)
+CPU_INLINE void STY(struct SNES_Core* snes, const bool x8)
 {
-    if (FLAG_X)
+    if (x8)
     {
         snes_cpu_write8(snes, snes->cpu.oprand, REG_Y);
     }
@@ -371,55 +480,55 @@ static void STY(struct SNES_Core* snes)
 }
 
 // load x from memory
-static void LDX(struct SNES_Core* snes)
+CPU_INLINE void LDX(struct SNES_Core* snes, const bool x8)
 {
-    if (FLAG_X)
+    if (x8)
     {
-        REG_X = snes_cpu_read8(snes, snes->cpu.oprand);
+        REG_X = read_operand8(snes);
         set_nz_8(snes, REG_X);
     }
     else
     {
-        REG_X = snes_cpu_read16(snes, snes->cpu.oprand);
+        REG_X = read_operand16(snes);
         set_nz_16(snes, REG_X);
     }
 }
 
 // load y from memory
-static void LDY(struct SNES_Core* snes)
+CPU_INLINE void LDY(struct SNES_Core* snes, const bool x8)
 {
-    if (FLAG_X)
+    if (x8)
     {
-        REG_Y = snes_cpu_read8(snes, snes->cpu.oprand);
+        REG_Y = read_operand8(snes);
         set_nz_8(snes, REG_Y);
     }
     else
     {
-        REG_Y = snes_cpu_read16(snes, snes->cpu.oprand);
+        REG_Y = read_operand16(snes);
         set_nz_16(snes, REG_Y);
     }
 }
 
 // load accumulator from memory
-static void LDA(struct SNES_Core* snes)
+CPU_INLINE void LDA(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    if (m8)
     {
-        const uint8_t value = snes_cpu_read8(snes, snes->cpu.oprand);
+        const uint8_t value = read_operand8(snes);
         set_lo_byte(&REG_A, value);
         set_nz_8(snes, REG_A);
     }
     else
     {
-        REG_A = snes_cpu_read16(snes, snes->cpu.oprand);
+        REG_A = read_operand16(snes);
         set_nz_16(snes, REG_A);
     }
 }
 
 // store accumulator to memory
-static void STA(struct SNES_Core* snes)
+CPU_INLINE void STA(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    if (m8)
     {
         snes_cpu_write8(snes, snes->cpu.oprand, REG_A);
     }
@@ -433,8 +542,9 @@ static void STA(struct SNES_Core* snes)
 static void XCE(struct SNES_Core* snes)
 {
     const bool old_carry = FLAG_C;
-    FLAG_C = FLAG_E;
+    SET_FLAG(C, FLAG_E);
     FLAG_E = old_carry;
+    update_width(snes);
     snes_log("[XCE] switch mode to %s\n", FLAG_E ? "EMULATED" : "NATIVE");
     if (FLAG_E)
     {
@@ -445,6 +555,8 @@ static void XCE(struct SNES_Core* snes)
 // exchange lo hi bytes of accumulator
 static void XBA(struct SNES_Core* snes)
 {
+    internal_op(snes, 1);
+
     const uint8_t lo_a = REG_A & 0xFF;
     const uint8_t hi_a = REG_A >> 8;
     REG_A = (lo_a << 8) | hi_a;
@@ -463,7 +575,9 @@ static void XBA(struct SNES_Core* snes)
 // clear the bits specified in the oprand of the flags
 static void REP(struct SNES_Core* snes)
 {
-    const uint8_t value = ~snes_cpu_read8(snes, snes->cpu.oprand);
+    internal_op(snes, 1);
+
+    const uint8_t value = ~read_operand8(snes);
     const uint8_t flags = get_status_flags(snes);
     set_status_flags(snes, flags & value);
 }
@@ -471,15 +585,17 @@ static void REP(struct SNES_Core* snes)
 // set the bits specified in the oprand of the flags
 static void SEP(struct SNES_Core* snes)
 {
-    const uint8_t value = snes_cpu_read8(snes, snes->cpu.oprand);
+    internal_op(snes, 1);
+
+    const uint8_t value = read_operand8(snes);
     const uint8_t flags = get_status_flags(snes);
     set_status_flags(snes, flags | value);
 }
 
 // transfer accumulator to REG_X
-static void TAX(struct SNES_Core* snes)
+CPU_INLINE void TAX(struct SNES_Core* snes, const bool x8)
 {
-    if (FLAG_X)
+    if (x8)
     {
         REG_X = REG_A & 0xFF;
         set_nz_8(snes, REG_X);
@@ -492,9 +608,9 @@ static void TAX(struct SNES_Core* snes)
 }
 
 // transfer accumulator to REG_Y
-static void TAY(struct SNES_Core* snes)
+CPU_INLINE void TAY(struct SNES_Core* snes, const bool x8)
 {
-    if (FLAG_X)
+    if (x8)
     {
         REG_Y = REG_A & 0xFF;
         set_nz_8(snes, REG_Y);
@@ -507,9 +623,9 @@ static void TAY(struct SNES_Core* snes)
 }
 
 // transfer REG_X to accumulator
-static void TXA(struct SNES_Core* snes)
+CPU_INLINE void TXA(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    if (m8)
     {
         set_lo_byte(&REG_A, REG_X);
         set_nz_8(snes, REG_A);
@@ -529,11 +645,11 @@ static void TXS(struct SNES_Core* snes)
 }
 
 // transfer REG_X to REG_Y
-static void TXY(struct SNES_Core* snes)
+CPU_INLINE void TXY(struct SNES_Core* snes, const bool x8)
 {
     REG_Y = REG_X;
 
-    if (FLAG_X)
+    if (x8)
     {
         set_nz_8(snes, REG_Y);
     }
@@ -544,9 +660,9 @@ static void TXY(struct SNES_Core* snes)
 }
 
 // transfer REG_Y to accumulator
-static void TYA(struct SNES_Core* snes)
+CPU_INLINE void TYA(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    if (m8)
     {
         set_lo_byte(&REG_A, REG_Y);
         set_nz_8(snes, REG_A);
@@ -559,11 +675,11 @@ static void TYA(struct SNES_Core* snes)
 }
 
 // transfer REG_Y to REG_X
-static void TYX(struct SNES_Core* snes)
+CPU_INLINE void TYX(struct SNES_Core* snes, const bool x8)
 {
     REG_X = REG_Y;
 
-    if (FLAG_X)
+    if (x8)
     {
         set_nz_8(snes, REG_X);
     }
@@ -588,9 +704,9 @@ static void TCS(struct SNES_Core* snes)
 }
 
 // transfer stack pointer to accumulator
-static void TSC(struct SNES_Core* snes)
+CPU_INLINE void TSC(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    if (m8)
     {
         set_lo_byte(&REG_A, REG_SP);
         set_nz_8(snes, REG_A);
@@ -603,9 +719,9 @@ static void TSC(struct SNES_Core* snes)
 }
 
 // transfer direct page register to accumulator
-static void TDC(struct SNES_Core* snes)
+CPU_INLINE void TDC(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    if (m8)
     {
         set_lo_byte(&REG_A, REG_D);
         set_nz_8(snes, REG_A);
@@ -618,29 +734,29 @@ static void TDC(struct SNES_Core* snes)
 }
 
 // add with carry
-static void ADC(struct SNES_Core* snes)
+CPU_INLINE void ADC(struct SNES_Core* snes, const bool m8)
 {
-    assert(FLAG_D == false && "decimal mode not impl\n");
+    assert(!(snes->cpu.P & SNES_P_D) && "decimal mode not impl\n");
 
-    if (FLAG_M)
+    if (m8)
     {
         const uint8_t a = REG_A;
-        const uint8_t value = snes_cpu_read8(snes, snes->cpu.oprand) + FLAG_C;
+        const uint8_t value = read_operand8(snes) + FLAG_C;
         const uint8_t result = a + value;
 
-        FLAG_V = ((a ^ result) & (value ^ result) & 0x80) > 0;
-        FLAG_C = (a + value) > 0xFF;
+        SET_FLAG(V, ((a ^ result) & (value ^ result) & 0x80) > 0);
+        SET_FLAG(C, (a + value) > 0xFF);
         set_nz_8(snes, result);
 
         set_lo_byte(&REG_A, result);
     }
     else
     {
-        const uint16_t value = snes_cpu_read16(snes, snes->cpu.oprand) + FLAG_C;
+        const uint16_t value = read_operand16(snes) + FLAG_C;
         const uint16_t result = REG_A + value;
 
-        FLAG_V = ((REG_A ^ result) & (value ^ result) & 0x8000) > 0;
-        FLAG_C = (REG_A + value) > 0xFFFF;
+        SET_FLAG(V, ((REG_A ^ result) & (value ^ result) & 0x8000) > 0);
+        SET_FLAG(C, (REG_A + value) > 0xFFFF);
         set_nz_16(snes, result);
 
         REG_A = result;
@@ -648,31 +764,31 @@ static void ADC(struct SNES_Core* snes)
 }
 
 // subtract with carry
-static void SBC(struct SNES_Core* snes)
+CPU_INLINE void SBC(struct SNES_Core* snes, const bool m8)
 {
-    assert(FLAG_D == false && "decimal mode not impl\n");
+    assert(!(snes->cpu.P & SNES_P_D) && "decimal mode not impl\n");
 
     // NOTE: not sure if V is set correct, copied from my nes
     // might need to invert the result as copied from nes ADC()
-    if (FLAG_M)
+    if (m8)
     {
         const uint8_t a = REG_A;
-        const uint8_t value = snes_cpu_read8(snes, snes->cpu.oprand) + !FLAG_C;
+        const uint8_t value = read_operand8(snes) + !FLAG_C;
         const uint8_t result = a - value;
 
-        FLAG_V = ((a ^ result) & (value ^ result) & 0x80) > 0;
-        FLAG_C = a >= value;
+        SET_FLAG(V, ((a ^ result) & (value ^ result) & 0x80) > 0);
+        SET_FLAG(C, a >= value);
         set_nz_8(snes, result);
 
         set_lo_byte(&REG_A, result);
     }
     else
     {
-        const uint16_t value = snes_cpu_read16(snes, snes->cpu.oprand) + !FLAG_C;
+        const uint16_t value = read_operand16(snes) + !FLAG_C;
         const uint16_t result = REG_A - value;
 
-        FLAG_V = ((REG_A ^ result) & (value ^ result) & 0x8000) > 0;
-        FLAG_C = REG_A >= value;
+        SET_FLAG(V, ((REG_A ^ result) & (value ^ result) & 0x8000) > 0);
+        SET_FLAG(C, REG_A >= value);
         set_nz_16(snes, result);
 
         REG_A = result;
@@ -680,73 +796,73 @@ static void SBC(struct SNES_Core* snes)
 }
 
 // compare accumulator with memory
-static void CMP(struct SNES_Core* snes)
+CPU_INLINE void CMP(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    if (m8)
     {
         const uint8_t a = REG_A;
-        const uint8_t value = snes_cpu_read8(snes, snes->cpu.oprand);
+        const uint8_t value = read_operand8(snes);
         const uint8_t result = a - value;
 
-        FLAG_C = a >= value;
+        SET_FLAG(C, a >= value);
         set_nz_8(snes, result);
     }
     else
     {
-        const uint16_t value = snes_cpu_read16(snes, snes->cpu.oprand);
+        const uint16_t value = read_operand16(snes);
         const uint16_t result = REG_A - value;
 
-        FLAG_C = REG_A >= value;
+        SET_FLAG(C, REG_A >= value);
         set_nz_16(snes, result);
     }
 }
 
 // compare REG_X with memory
-static void CPX(struct SNES_Core* snes)
+CPU_INLINE void CPX(struct SNES_Core* snes, const bool x8)
 {
-    if (FLAG_X)
+    if (x8)
     {
-        const uint8_t value = snes_cpu_read8(snes, snes->cpu.oprand);
+        const uint8_t value = read_operand8(snes);
         const uint8_t result = REG_X - value;
 
-        FLAG_C = REG_X >= value;
+        SET_FLAG(C, REG_X >= value);
         set_nz_8(snes, result);
     }
     else
     {
-        const uint16_t value = snes_cpu_read16(snes, snes->cpu.oprand);
+        const uint16_t value = read_operand16(snes);
         const uint16_t result = REG_X - value;
 
-        FLAG_C = REG_X >= value;
+        SET_FLAG(C, REG_X >= value);
         set_nz_16(snes, result);
     }
 }
 
 // compare REG_Y with memory
-static void CPY(struct SNES_Core* snes)
+CPU_INLINE void CPY(struct SNES_Core* snes, const bool x8)
 {
-    if (FLAG_X)
+    if (x8)
     {
-        const uint8_t value = snes_cpu_read8(snes, snes->cpu.oprand);
+        const uint8_t value = read_operand8(snes);
         const uint8_t result = REG_Y - value;
 
-        FLAG_C = REG_Y >= value;
+        SET_FLAG(C, REG_Y >= value);
         set_nz_8(snes, result);
     }
     else
     {
-        const uint16_t value = snes_cpu_read16(snes, snes->cpu.oprand);
+        const uint16_t value = read_operand16(snes);
         const uint16_t result = REG_Y - value;
 
-        FLAG_C = REG_Y >= value;
+        SET_FLAG(C, REG_Y >= value);
         set_nz_16(snes, result);
     }
 }
 
 // decrement REG_A
-static void DEA(struct SNES_Core* snes)
+CPU_INLINE void DEA(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    if (m8)
     {
         const uint8_t result = REG_A - 1;
         set_lo_byte(&REG_A, result);
@@ -760,11 +876,11 @@ static void DEA(struct SNES_Core* snes)
 }
 
 // decrement REG_X
-static void DEX(struct SNES_Core* snes)
+CPU_INLINE void DEX(struct SNES_Core* snes, const bool x8)
 {
     REG_X--;
 
-    if (FLAG_X)
+    if (x8)
     {
         REG_X &= 0xFF;
         set_nz_8(snes, REG_X);
@@ -776,11 +892,11 @@ static void DEX(struct SNES_Core* snes)
 }
 
 // decrement REG_Y
-static void DEY(struct SNES_Core* snes)
+CPU_INLINE void DEY(struct SNES_Core* snes, const bool x8)
 {
     REG_Y--;
 
-    if (FLAG_X)
+    if (x8)
     {
         REG_Y &= 0xFF;
         set_nz_8(snes, REG_Y);
@@ -792,9 +908,9 @@ static void DEY(struct SNES_Core* snes)
 }
 
 // increment REG_A
-static void INA(struct SNES_Core* snes)
+CPU_INLINE void INA(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    if (m8)
     {
         const uint8_t result = REG_A + 1;
         set_lo_byte(&REG_A, result);
@@ -808,11 +924,11 @@ static void INA(struct SNES_Core* snes)
 }
 
 // increment REG_X
-static void INX(struct SNES_Core* snes)
+CPU_INLINE void INX(struct SNES_Core* snes, const bool x8)
 {
     REG_X++;
 
-    if (FLAG_X)
+    if (x8)
     {
         REG_X &= 0xFF;
         set_nz_8(snes, REG_X);
@@ -824,11 +940,11 @@ static void INX(struct SNES_Core* snes)
 }
 
 // increment REG_Y
-static void INY(struct SNES_Core* snes)
+CPU_INLINE void INY(struct SNES_Core* snes, const bool x8)
 {
     REG_Y++;
 
-    if (FLAG_X)
+    if (x8)
     {
         REG_Y &= 0xFF;
         set_nz_8(snes, REG_Y);
@@ -840,13 +956,16 @@ static void INY(struct SNES_Core* snes)
 }
 
 // rotate left memory
-static void ROL(struct SNES_Core* snes)
+CPU_INLINE void ROL(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    // the modify step between the read and the write
+    internal_op(snes, 1);
+
+    if (m8)
     {
         const uint8_t value = snes_cpu_read8(snes, snes->cpu.oprand);
         const uint8_t result = (value << 1) | FLAG_C;
-        FLAG_C = is_bit_set(7, result);
+        SET_FLAG(C, is_bit_set(7, result));
         set_nz_8(snes, result);
         snes_cpu_write8(snes, snes->cpu.oprand, result);
     }
@@ -854,40 +973,43 @@ static void ROL(struct SNES_Core* snes)
     {
         const uint16_t value = snes_cpu_read16(snes, snes->cpu.oprand);
         const uint16_t result = (value << 1) | FLAG_C;
-        FLAG_C = is_bit_set(15, result);
+        SET_FLAG(C, is_bit_set(15, result));
         set_nz_16(snes, result);
         snes_cpu_write16(snes, snes->cpu.oprand, result);
     }
 }
 
 // rotate left REG_A
-static void ROLA(struct SNES_Core* snes)
+CPU_INLINE void ROLA(struct SNES_Core* snes, const bool m8)
 {
     const uint16_t old_a = REG_A;
 
-    if (FLAG_M)
+    if (m8)
     {
         const uint8_t result = (REG_A << 1) | FLAG_C;
         set_lo_byte(&REG_A, result);
-        FLAG_C = is_bit_set(7, old_a);
+        SET_FLAG(C, is_bit_set(7, old_a));
         set_nz_8(snes, REG_A);
     }
     else
     {
         REG_A = (REG_A << 1) | FLAG_C;
-        FLAG_C = is_bit_set(15, old_a);
+        SET_FLAG(C, is_bit_set(15, old_a));
         set_nz_16(snes, REG_A);
     }
 }
 
 // rotate right memory
-static void ROR(struct SNES_Core* snes)
+CPU_INLINE void ROR(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    // the modify step between the read and the write
+    internal_op(snes, 1);
+
+    if (m8)
     {
         const uint8_t value = snes_cpu_read8(snes, snes->cpu.oprand);
         const uint8_t result = (value >> 1) | (FLAG_C << 7);
-        FLAG_C = is_bit_set(1, value);
+        SET_FLAG(C, is_bit_set(1, value));
         set_nz_8(snes, result);
         snes_cpu_write8(snes, snes->cpu.oprand, result);
     }
@@ -895,19 +1017,19 @@ static void ROR(struct SNES_Core* snes)
     {
         const uint16_t value = snes_cpu_read16(snes, snes->cpu.oprand);
         const uint16_t result = (value >> 1) | (FLAG_C << 15);
-        FLAG_C = is_bit_set(1, value);
+        SET_FLAG(C, is_bit_set(1, value));
         set_nz_16(snes, result);
         snes_cpu_write16(snes, snes->cpu.oprand, result);
     }
 }
 
 // rotate right REG_A
-static void RORA(struct SNES_Core* snes)
+CPU_INLINE void RORA(struct SNES_Core* snes, const bool m8)
 {
     const bool old_carry = FLAG_C;
-    FLAG_C = is_bit_set(1, REG_A);
+    SET_FLAG(C, is_bit_set(1, REG_A));
 
-    if (FLAG_M)
+    if (m8)
     {
         const uint8_t result = (REG_A >> 1) | (old_carry << 7);
         set_lo_byte(&REG_A, result);
@@ -920,12 +1042,35 @@ static void RORA(struct SNES_Core* snes)
     }
 }
 
+#if SNES_CPU_IDLE_SKIP
+static void idle_check(struct SNES_Core* snes, uint16_t loop_end);
+#endif
+
+// takes a relative branch, a backward branch may be an idle loop
+static void branch(struct SNES_Core* snes)
+{
+    const int8_t offset = snes->cpu.oprand;
+    const uint16_t old_pc = REG_PC;
+    REG_PC += offset;
+
+    // a taken branch costs a cycle, crossing a page another in emulation mode
+    internal_op(snes, FLAG_E && ((old_pc ^ REG_PC) & 0xFF00) ? 2 : 1);
+
+#if SNES_CPU_IDLE_SKIP
+    // skipped iterations would be missing from the trace / profile
+    if (offset < 0 && !instrumented(snes))
+    {
+        idle_check(snes, REG_PC - offset);
+    }
+#endif
+}
+
 // branch if carry flag clear
 static void BCC(struct SNES_Core* snes)
 {
     if (!FLAG_C)
     {
-        REG_PC += (int8_t)snes->cpu.oprand;
+        branch(snes);
         // snes_log("[BCC] REG_PC: 0x%04X\n", REG_PC);
     }
 }
@@ -935,7 +1080,7 @@ static void BCS(struct SNES_Core* snes)
 {
     if (FLAG_C)
     {
-        REG_PC += (int8_t)snes->cpu.oprand;
+        branch(snes);
         // snes_log("[BCS] REG_PC: 0x%04X\n", REG_PC);
     }
 }
@@ -945,7 +1090,7 @@ static void BEQ(struct SNES_Core* snes)
 {
     if (FLAG_Z)
     {
-        REG_PC += (int8_t)snes->cpu.oprand;
+        branch(snes);
         // snes_log("[BEQ] REG_PC: 0x%04X\n", REG_PC);
     }
 }
@@ -955,7 +1100,7 @@ static void BMI(struct SNES_Core* snes)
 {
     if (FLAG_N)
     {
-        REG_PC += (int8_t)snes->cpu.oprand;
+        branch(snes);
         // snes_log("[BMI] REG_PC: 0x%04X\n", REG_PC);
     }
 }
@@ -965,7 +1110,7 @@ static void BPL(struct SNES_Core* snes)
 {
     if (!FLAG_N)
     {
-        REG_PC += (int8_t)snes->cpu.oprand;
+        branch(snes);
         // snes_log("[BPL] REG_PC: 0x%04X\n", REG_PC);
     }
 }
@@ -975,7 +1120,7 @@ static void BNE(struct SNES_Core* snes)
 {
     if (!FLAG_Z)
     {
-        REG_PC += (int8_t)snes->cpu.oprand;
+        branch(snes);
         // snes_log("[BNE] REG_PC: 0x%04X\n", REG_PC);
     }
 }
@@ -985,7 +1130,7 @@ static void BVC(struct SNES_Core* snes)
 {
     if (!FLAG_V)
     {
-        REG_PC += (int8_t)snes->cpu.oprand;
+        branch(snes);
         // snes_log("[BVC] REG_PC: 0x%04X\n", REG_PC);
     }
 }
@@ -995,7 +1140,7 @@ static void BVS(struct SNES_Core* snes)
 {
     if (FLAG_V)
     {
-        REG_PC += (int8_t)snes->cpu.oprand;
+        branch(snes);
         // snes_log("[BVS] REG_PC: 0x%04X\n", REG_PC);
     }
 }
@@ -1003,12 +1148,14 @@ static void BVS(struct SNES_Core* snes)
 // branch always
 static void BRA(struct SNES_Core* snes)
 {
-    REG_PC += (int8_t)snes->cpu.oprand;
+    branch(snes);
 }
 
 // push pc to stack then set pc (jmp)
 static void JSR(struct SNES_Core* snes)
 {
+    internal_op(snes, 1);
+
     push16(snes, REG_PC - 1);
     REG_PC = snes->cpu.oprand;
     snes_log("[JSR] jump to 0x%04X\n", REG_PC);
@@ -1017,6 +1164,8 @@ static void JSR(struct SNES_Core* snes)
 // push pc to stack then set pc (jmp)
 static void JSL(struct SNES_Core* snes)
 {
+    internal_op(snes, 1);
+
     push8(snes, REG_PBR);
     push16(snes, REG_PC - 1);
     REG_PC = snes->cpu.oprand;
@@ -1042,14 +1191,18 @@ static void JML(struct SNES_Core* snes)
 // pull status flags by byte from stack
 static void PLP(struct SNES_Core* snes)
 {
+    internal_op(snes, 1);
+
     const uint8_t value = pop8(snes);
     set_status_flags(snes, value);
 }
 
 // pull data bank register from stack
-static void PLA(struct SNES_Core* snes)
+CPU_INLINE void PLA(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    internal_op(snes, 1);
+
+    if (m8)
     {
         const uint8_t result = pop8(snes);
         set_lo_byte(&REG_A, result);
@@ -1065,6 +1218,8 @@ static void PLA(struct SNES_Core* snes)
 // pull data bank register from stack
 static void PLB(struct SNES_Core* snes)
 {
+    internal_op(snes, 1);
+
     REG_DBR = pop8(snes);
     set_nz_8(snes, REG_DBR);
 
@@ -1074,14 +1229,18 @@ static void PLB(struct SNES_Core* snes)
 // pull direct page register from stack
 static void PLD(struct SNES_Core* snes)
 {
+    internal_op(snes, 1);
+
     REG_D = pop16(snes);
     set_nz_16(snes, REG_D);
 }
 
 // pull REG_X from stack
-static void PLX(struct SNES_Core* snes)
+CPU_INLINE void PLX(struct SNES_Core* snes, const bool x8)
 {
-    if (FLAG_X)
+    internal_op(snes, 1);
+
+    if (x8)
     {
         REG_X = pop8(snes);
         set_nz_8(snes, REG_X);
@@ -1094,9 +1253,11 @@ static void PLX(struct SNES_Core* snes)
 }
 
 // pull REG_Y from stack
-static void PLY(struct SNES_Core* snes)
+CPU_INLINE void PLY(struct SNES_Core* snes, const bool x8)
 {
-    if (FLAG_X)
+    internal_op(snes, 1);
+
+    if (x8)
     {
         REG_Y = pop8(snes);
         set_nz_8(snes, REG_Y);
@@ -1122,9 +1283,9 @@ static void PHP(struct SNES_Core* snes)
 }
 
 // push accumulator to stack
-static void PHA(struct SNES_Core* snes)
+CPU_INLINE void PHA(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    if (m8)
     {
         push8(snes, REG_A);
     }
@@ -1135,9 +1296,9 @@ static void PHA(struct SNES_Core* snes)
 }
 
 // push REG_X to stack
-static void PHX(struct SNES_Core* snes)
+CPU_INLINE void PHX(struct SNES_Core* snes, const bool x8)
 {
-    if (FLAG_X)
+    if (x8)
     {
         push8(snes, REG_X);
     }
@@ -1148,9 +1309,9 @@ static void PHX(struct SNES_Core* snes)
 }
 
 // push REG_Y to stack
-static void PHY(struct SNES_Core* snes)
+CPU_INLINE void PHY(struct SNES_Core* snes, const bool x8)
 {
-    if (FLAG_X)
+    if (x8)
     {
         push8(snes, REG_Y);
     }
@@ -1175,22 +1336,205 @@ static void PHK(struct SNES_Core* snes)
 // return from subroutine
 static void RTS(struct SNES_Core* snes)
 {
+    internal_op(snes, 2);
+
     REG_PC = pop16(snes) + 1;
-    snes_log("[RTS] REG_PC: 0x%04X op: 0x%02X\n", REG_PC, snes_cpu_read8(snes, REG_PC));
+    snes_log("[RTS] REG_PC: 0x%04X\n", REG_PC);
+}
+
+// return from interrupt
+static void RTI(struct SNES_Core* snes)
+{
+    internal_op(snes, 1);
+
+    set_status_flags(snes, pop8(snes));
+    REG_PC = pop16(snes);
+
+    if (!FLAG_E)
+    {
+        REG_PBR = pop8(snes);
+    }
+}
+
+// byte i of a move reads src[i * step] and writes dst[i * step], in order.
+// when the ranges overlap in the direction of the move, the bytes that
+// were just written are read again, so the start of the range repeats.
+static void move_bytes(uint8_t* dst, const uint8_t* src, size_t count, int step)
+{
+    const uintptr_t d = (uintptr_t)dst;
+    const uintptr_t s = (uintptr_t)src;
+
+    if (step > 0 && d > s && d - s < count)
+    {
+        const size_t period = d - s;
+        size_t done = period;
+
+        memcpy(dst, src, period);
+
+        while (done < count)
+        {
+            const size_t chunk = done < count - done ? done : count - done;
+            memcpy(dst + done, dst, chunk);
+            done += chunk;
+        }
+    }
+    else if (step < 0 && s > d && s - d < count)
+    {
+        // same as above, but from the last byte down
+        const size_t period = s - d;
+        size_t done = period;
+
+        memcpy(dst - period + 1, src - period + 1, period);
+
+        while (done < count)
+        {
+            const size_t chunk = done < count - done ? done : count - done;
+            memcpy(dst - done - chunk + 1, dst - chunk + 1, chunk);
+            done += chunk;
+        }
+    }
+    else if (step > 0)
+    {
+        memmove(dst, src, count);
+    }
+    else
+    {
+        memmove(dst - count + 1, src - count + 1, count);
+    }
+}
+
+// bytes from index (in the direction of step) before the index wraps or
+// the page ends, 0 if the page isn't plain memory.
+static size_t move_span(uint8_t bank, uint16_t index, uint16_t index_mask, int step, bool mapped)
+{
+    const uint32_t offset = addr(bank, index) & SNES_MEM_PAGE_MASK;
+    size_t span;
+
+    if (!mapped)
+    {
+        return 0;
+    }
+
+    if (step > 0)
+    {
+        span = SNES_MEM_PAGE_SIZE - offset;
+        return span < (size_t)index_mask + 1 - index ? span : (size_t)index_mask + 1 - index;
+    }
+
+    span = offset + 1;
+    return span < (size_t)index + 1 ? span : (size_t)index + 1;
+}
+
+// moves a single byte through the bus
+static void block_move_byte(struct SNES_Core* snes, uint32_t src, uint32_t dst)
+{
+    snes_cpu_write8(snes, dst, snes_cpu_read8(snes, src));
+    snes->scheduler.cycles += SNES_CYCLES_IO * 2;
+}
+
+// MVN (step 1) / MVP (step -1) move A + 1 bytes from src:X to dst:Y.
+// on hardware, the instruction moves a single byte and runs again until
+// A wraps to 0xFFFF, so it can be interrupted after any byte. this runs
+// every byte up to the next event in one go (in bulk if both sides are
+// plain memory) and leaves PC on the instruction if bytes are left.
+static void block_move_run(struct SNES_Core* snes, bool x8, int step)
+{
+    const uint8_t dst_bank = snes->cpu.oprand & 0xFF;
+    const uint8_t src_bank = (snes->cpu.oprand >> 8) & 0xFF;
+    const uint16_t index_mask = x8 ? 0xFF : 0xFFFF;
+    const uint16_t pc = REG_PC - 3;
+    const uint8_t* cost = snes->mem.access_cycles;
+    // every byte after the 1st fetches the instruction again
+    const uint32_t refetch =
+        cost[addr(REG_PBR, pc + 0) >> SNES_MEM_PAGE_SHIFT] +
+        cost[addr(REG_PBR, pc + 1) >> SNES_MEM_PAGE_SHIFT] +
+        cost[addr(REG_PBR, pc + 2) >> SNES_MEM_PAGE_SHIFT];
+    size_t count = 1;
+
+    REG_DBR = dst_bank;
+
+    // the fetch of the 1st byte has already been charged
+    block_move_byte(snes, addr(src_bank, REG_X), addr(dst_bank, REG_Y));
+
+    for (;;)
+    {
+        REG_X = (REG_X + step * (int)count) & index_mask;
+        REG_Y = (REG_Y + step * (int)count) & index_mask;
+        REG_A -= count;
+
+        if (REG_A == 0xFFFF || snes->scheduler.cycles >= snes->scheduler.next)
+        {
+            break;
+        }
+
+        const uint32_t src = addr(src_bank, REG_X);
+        const uint32_t dst = addr(dst_bank, REG_Y);
+        const uint8_t* r = snes->mem.rmap[src >> SNES_MEM_PAGE_SHIFT];
+        uint8_t* w = snes->mem.wmap[dst >> SNES_MEM_PAGE_SHIFT];
+        const uint64_t byte_cycles = refetch + cost[src >> SNES_MEM_PAGE_SHIFT] + cost[dst >> SNES_MEM_PAGE_SHIFT] + SNES_CYCLES_IO * 2;
+        const uint64_t until_next = snes->scheduler.next - snes->scheduler.cycles;
+        // the byte that reaches the next event is still moved
+        const uint64_t max = until_next / byte_cycles + (until_next % byte_cycles != 0);
+        const size_t src_span = move_span(src_bank, REG_X, index_mask, step, r != NULL);
+        const size_t dst_span = move_span(dst_bank, REG_Y, index_mask, step, w != NULL);
+
+        count = (size_t)REG_A + 1;
+        count = count < src_span ? count : src_span;
+        count = count < dst_span ? count : dst_span;
+        count = count < max ? count : max;
+
+        if (count > 1)
+        {
+            uint8_t* dst_ptr = w + (dst & SNES_MEM_PAGE_MASK);
+
+            move_bytes(dst_ptr, r + (src & SNES_MEM_PAGE_MASK), count, step);
+            snes->scheduler.cycles += count * byte_cycles;
+            snes->mem.open_bus = dst_ptr[step * (ptrdiff_t)(count - 1)];
+        }
+        else
+        {
+            snes->scheduler.cycles += refetch;
+            block_move_byte(snes, src, dst);
+            count = 1;
+        }
+    }
+
+    // the rest is moved once the event has run
+    if (REG_A != 0xFFFF)
+    {
+        REG_PC = pc;
+    }
+}
+
+// block move negative (incrementing)
+static void MVN(struct SNES_Core* snes, bool x8)
+{
+    block_move_run(snes, x8, 1);
+}
+
+// block move positive (decrementing)
+static void MVP(struct SNES_Core* snes, bool x8)
+{
+    block_move_run(snes, x8, -1);
 }
 
 // return from subroutine long
 static void RTL(struct SNES_Core* snes)
 {
+    internal_op(snes, 1);
+
     REG_PC = pop16(snes) + 1;
     REG_PBR = pop8(snes);
-    snes_log("[RTL] %02X:%04X op: 0x%02X\n", REG_PBR, REG_PC, snes_cpu_read8(snes, REG_PC));
+    snes_log("[RTL] %02X:%04X\n", REG_PBR, REG_PC);
 }
 
 // increment memory
-static void INC(struct SNES_Core* snes)
+CPU_INLINE void INC(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    // the modify step between the read and the write
+    internal_op(snes, 1);
+
+    if (m8)
     {
         const uint8_t result = snes_cpu_read8(snes, snes->cpu.oprand) + 1;
         set_nz_8(snes, result);
@@ -1205,9 +1549,12 @@ static void INC(struct SNES_Core* snes)
 }
 
 // decrement memory
-static void DEC(struct SNES_Core* snes)
+CPU_INLINE void DEC(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    // the modify step between the read and the write
+    internal_op(snes, 1);
+
+    if (m8)
     {
         const uint8_t result = snes_cpu_read8(snes, snes->cpu.oprand) - 1;
         set_nz_8(snes, result);
@@ -1222,61 +1569,64 @@ static void DEC(struct SNES_Core* snes)
 }
 
 // and accumulator with memory
-static void AND(struct SNES_Core* snes)
+CPU_INLINE void AND(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    if (m8)
     {
-        const uint8_t result = REG_A & snes_cpu_read8(snes, snes->cpu.oprand);
+        const uint8_t result = REG_A & read_operand8(snes);
         set_lo_byte(&REG_A, result);
         set_nz_8(snes, result);
     }
     else
     {
-        REG_A &= snes_cpu_read16(snes, snes->cpu.oprand);
+        REG_A &= read_operand16(snes);
         set_nz_16(snes, REG_A);
     }
 }
 
 // or accumulator with memory
-static void ORA(struct SNES_Core* snes)
+CPU_INLINE void ORA(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    if (m8)
     {
-        const uint8_t result = REG_A | snes_cpu_read8(snes, snes->cpu.oprand);
+        const uint8_t result = REG_A | read_operand8(snes);
         set_lo_byte(&REG_A, result);
         set_nz_8(snes, result);
     }
     else
     {
-        REG_A |= snes_cpu_read16(snes, snes->cpu.oprand);
+        REG_A |= read_operand16(snes);
         set_nz_16(snes, REG_A);
     }
 }
 
 // xor accumulator with memory
-static void EOR(struct SNES_Core* snes)
+CPU_INLINE void EOR(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    if (m8)
     {
-        const uint8_t result = REG_A ^ snes_cpu_read8(snes, snes->cpu.oprand);
+        const uint8_t result = REG_A ^ read_operand8(snes);
         set_lo_byte(&REG_A, result);
         set_nz_8(snes, result);
     }
     else
     {
-        REG_A ^= snes_cpu_read16(snes, snes->cpu.oprand);
+        REG_A ^= read_operand16(snes);
         set_nz_16(snes, REG_A);
     }
 }
 
 // arithmetic shift left memory
-static void ASL(struct SNES_Core* snes)
+CPU_INLINE void ASL(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    // the modify step between the read and the write
+    internal_op(snes, 1);
+
+    if (m8)
     {
         const uint8_t value = snes_cpu_read8(snes, snes->cpu.oprand);
         const uint8_t result = value << 1;
-        FLAG_C = is_bit_set(7, value);
+        SET_FLAG(C, is_bit_set(7, value));
         set_nz_8(snes, result);
         snes_cpu_write8(snes, snes->cpu.oprand, result);
     }
@@ -1284,24 +1634,24 @@ static void ASL(struct SNES_Core* snes)
     {
         const uint16_t value = snes_cpu_read16(snes, snes->cpu.oprand);
         const uint16_t result = value << 1;
-        FLAG_C = is_bit_set(15, value);
+        SET_FLAG(C, is_bit_set(15, value));
         set_nz_16(snes, result);
         snes_cpu_write16(snes, snes->cpu.oprand, result);
     }
 }
 
 // arithmetic shift left accumulator
-static void ASLA(struct SNES_Core* snes)
+CPU_INLINE void ASLA(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    if (m8)
     {
-        FLAG_C = is_bit_set(7, REG_A);
+        SET_FLAG(C, is_bit_set(7, REG_A));
         set_lo_byte(&REG_A, REG_A << 1);
         set_nz_8(snes, REG_A);
     }
     else
     {
-        FLAG_C = is_bit_set(15, REG_A);
+        SET_FLAG(C, is_bit_set(15, REG_A));
         REG_A <<= 1;
         set_nz_16(snes, REG_A);
     }
@@ -1309,13 +1659,16 @@ static void ASLA(struct SNES_Core* snes)
 
 
 // logical shift right memory
-static void LSR(struct SNES_Core* snes)
+CPU_INLINE void LSR(struct SNES_Core* snes, const bool m8)
 {
-    if (FLAG_M)
+    // the modify step between the read and the write
+    internal_op(snes, 1);
+
+    if (m8)
     {
         const uint8_t value = snes_cpu_read8(snes, snes->cpu.oprand);
         const uint8_t result = value >> 1;
-        FLAG_C = is_bit_set(1, value);
+        SET_FLAG(C, is_bit_set(1, value));
         set_nz_8(snes, result);
         snes_cpu_write8(snes, snes->cpu.oprand, result);
     }
@@ -1323,18 +1676,18 @@ static void LSR(struct SNES_Core* snes)
     {
         const uint16_t value = snes_cpu_read16(snes, snes->cpu.oprand);
         const uint16_t result = value >> 1;
-        FLAG_C = is_bit_set(1, value);
+        SET_FLAG(C, is_bit_set(1, value));
         set_nz_16(snes, result);
         snes_cpu_write16(snes, snes->cpu.oprand, result);
     }
 }
 
 // logical shift right accumulator
-static void LSRA(struct SNES_Core* snes)
+CPU_INLINE void LSRA(struct SNES_Core* snes, const bool m8)
 {
-    FLAG_C = is_bit_set(1, REG_A);
+    SET_FLAG(C, is_bit_set(1, REG_A));
 
-    if (FLAG_M)
+    if (m8)
     {
         set_lo_byte(&REG_A, REG_A >> 1);
         set_nz_8(snes, REG_A);
@@ -1348,206 +1701,1300 @@ static void LSRA(struct SNES_Core* snes)
 
 static void handle_interrupt(struct SNES_Core* snes, uint16_t vector)
 {
-    push8(snes, REG_PBR);
+    if (!FLAG_E)
+    {
+        push8(snes, REG_PBR);
+    }
+
     push16(snes, REG_PC);
     push8(snes, get_status_flags(snes));
     REG_PC = snes_cpu_read16(snes, vector);
     REG_PBR = 0x00;
-    FLAG_I = true; // disable interrupts
+    SET_FLAG(I, true); // disable interrupts
+    SET_FLAG(D, false);
 }
 
 static void on_irq(struct SNES_Core* snes)
 {
-    handle_interrupt(snes, 0xFFEE);
+    handle_interrupt(snes, FLAG_E ? SNES_Vector_EMU_IRQ : SNES_Vector_IRQ);
 }
 
 static void on_nmi(struct SNES_Core* snes)
 {
-    handle_interrupt(snes, 0xFFEA);
+    handle_interrupt(snes, FLAG_E ? SNES_Vector_EMU_NMI : SNES_Vector_NMI);
+}
+
+// every implemented opcode, as: OP(opcode, addressing mode, instruction).
+// m8 / x8 are the accumulator / index width, they are either read from
+// the flags once per instruction (switch dispatch) or are constants
+// (table dispatch), in which case the width checks are compiled out.
+// todo: 0x21, 0x41, 0x81 (dp x indirect) and 0x87 (dp indirect long)
+#define CPU_OPCODES(OP) \
+    OP(0x01, direct_page_x,           ORA(snes, m8)) \
+    OP(0x05, direct_page,             ORA(snes, m8)) \
+    OP(0x06, direct_page,             ASL(snes, m8)) \
+    OP(0x07, dp_ind_long,             ORA(snes, m8)) \
+    OP(0x08, implied,                 PHP(snes)) \
+    OP(0x09, immediateM,              ORA(snes, m8)) \
+    OP(0x0A, implied,                 ASLA(snes, m8)) \
+    OP(0x0B, implied,                 PHD(snes)) \
+    OP(0x0D, absolute,                ORA(snes, m8)) \
+    OP(0x0E, absolute,                ASL(snes, m8)) \
+    OP(0x0F, absolute_long,           ORA(snes, m8)) \
+    OP(0x10, relative,                BPL(snes)) \
+    OP(0x15, direct_page_x,           ORA(snes, m8)) \
+    OP(0x16, direct_page_x,           ASL(snes, m8)) \
+    OP(0x18, implied,                 CLC(snes)) \
+    OP(0x19, absolute_y,              ORA(snes, m8)) \
+    OP(0x1A, implied,                 INA(snes, m8)) \
+    OP(0x1B, implied,                 TCS(snes)) \
+    OP(0x1D, absolute_x,              ORA(snes, m8)) \
+    OP(0x1E, absolute_x_write,        ASL(snes, m8)) \
+    OP(0x20, absolute,                JSR(snes)) \
+    OP(0x22, absolute_long,           JSL(snes)) \
+    OP(0x25, direct_page,             AND(snes, m8)) \
+    OP(0x26, direct_page,             ROL(snes, m8)) \
+    OP(0x28, implied,                 PLP(snes)) \
+    OP(0x29, immediateM,              AND(snes, m8)) \
+    OP(0x2A, implied,                 ROLA(snes, m8)) \
+    OP(0x2B, implied,                 PLD(snes)) \
+    OP(0x2D, absolute,                AND(snes, m8)) \
+    OP(0x2E, absolute,                ROL(snes, m8)) \
+    OP(0x2F, absolute_long,           AND(snes, m8)) \
+    OP(0x30, relative,                BMI(snes)) \
+    OP(0x35, direct_page_x,           AND(snes, m8)) \
+    OP(0x36, direct_page_x,           ROL(snes, m8)) \
+    OP(0x38, implied,                 SEC(snes)) \
+    OP(0x39, absolute_y,              AND(snes, m8)) \
+    OP(0x3A, implied,                 DEA(snes, m8)) \
+    OP(0x3B, implied,                 TSC(snes, m8)) \
+    OP(0x3D, absolute_x,              AND(snes, m8)) \
+    OP(0x3E, absolute_x_write,        ROL(snes, m8)) \
+    OP(0x40, implied,                 RTI(snes)) \
+    OP(0x44, block_move,              MVP(snes, x8)) \
+    OP(0x45, direct_page,             EOR(snes, m8)) \
+    OP(0x46, direct_page,             LSR(snes, m8)) \
+    OP(0x48, implied,                 PHA(snes, m8)) \
+    OP(0x49, immediateM,              EOR(snes, m8)) \
+    OP(0x4A, implied,                 LSRA(snes, m8)) \
+    OP(0x4B, implied,                 PHK(snes)) \
+    OP(0x4C, absolute,                JMP(snes)) \
+    OP(0x4D, absolute,                EOR(snes, m8)) \
+    OP(0x4E, direct_page_x,           LSR(snes, m8)) \
+    OP(0x4F, absolute_long,           EOR(snes, m8)) \
+    OP(0x50, relative,                BVC(snes)) \
+    OP(0x54, block_move,              MVN(snes, x8)) \
+    OP(0x55, direct_page_x,           EOR(snes, m8)) \
+    OP(0x58, implied,                 CLI(snes)) \
+    OP(0x59, absolute_y,              EOR(snes, m8)) \
+    OP(0x5A, implied,                 PHY(snes, x8)) \
+    OP(0x5B, implied,                 TCD(snes)) \
+    OP(0x5C, absolute_long,           JML(snes)) \
+    OP(0x5D, absolute_x,              EOR(snes, m8)) \
+    OP(0x5E, absolute_x_write,        LSR(snes, m8)) \
+    OP(0x60, implied,                 RTS(snes)) \
+    OP(0x64, direct_page,             STZ(snes)) \
+    OP(0x65, direct_page,             ADC(snes, m8)) \
+    OP(0x66, direct_page,             ROR(snes, m8)) \
+    OP(0x68, implied,                 PLA(snes, m8)) \
+    OP(0x69, immediateM,              ADC(snes, m8)) \
+    OP(0x6A, implied,                 RORA(snes, m8)) \
+    OP(0x6B, implied,                 RTL(snes)) \
+    OP(0x6D, absolute,                ADC(snes, m8)) \
+    OP(0x6E, absolute,                ROR(snes, m8)) \
+    OP(0x6F, absolute_long,           ADC(snes, m8)) \
+    OP(0x70, relative,                BVS(snes)) \
+    OP(0x74, direct_page_x,           STZ(snes)) \
+    OP(0x76, direct_page_x,           ROR(snes, m8)) \
+    OP(0x77, dp_ind_long_y,           ADC(snes, m8)) \
+    OP(0x78, implied,                 SEI(snes)) \
+    OP(0x7A, implied,                 PLY(snes, x8)) \
+    OP(0x7B, implied,                 TDC(snes, m8)) \
+    OP(0x7E, absolute_x_write,        ROR(snes, m8)) \
+    OP(0x80, relative,                BRA(snes)) \
+    OP(0x84, direct_page,             STY(snes, x8)) \
+    OP(0x85, direct_page,             STA(snes, m8)) \
+    OP(0x86, direct_page,             STX(snes, x8)) \
+    OP(0x88, implied,                 DEY(snes, x8)) \
+    OP(0x8A, implied,                 TXA(snes, m8)) \
+    OP(0x8B, implied,                 PHB(snes)) \
+    OP(0x8C, absolute,                STY(snes, x8)) \
+    OP(0x8D, absolute,                STA(snes, m8)) \
+    OP(0x8E, absolute,                STX(snes, x8)) \
+    OP(0x8F, absolute_long,           STA(snes, m8)) \
+    OP(0x90, relative,                BCC(snes)) \
+    OP(0x94, direct_page_x,           STY(snes, x8)) \
+    OP(0x95, direct_page_x,           STA(snes, m8)) \
+    OP(0x96, direct_page_y,           STX(snes, x8)) \
+    OP(0x97, dp_ind_long_y,           STA(snes, m8)) \
+    OP(0x98, implied,                 TYA(snes, m8)) \
+    OP(0x99, absolute_y_write,        STA(snes, m8)) \
+    OP(0x9A, implied,                 TXS(snes)) \
+    OP(0x9B, implied,                 TXY(snes, x8)) \
+    OP(0x9C, absolute,                STZ(snes)) \
+    OP(0x9D, absolute_x_write,        STA(snes, m8)) \
+    OP(0x9E, absolute_x_write,        STZ(snes)) \
+    OP(0x9F, absolute_long_x,         STA(snes, m8)) \
+    OP(0xA0, immediateX,              LDY(snes, x8)) \
+    OP(0xA2, immediateX,              LDX(snes, x8)) \
+    OP(0xA4, direct_page,             LDY(snes, x8)) \
+    OP(0xA5, direct_page,             LDA(snes, m8)) \
+    OP(0xA6, direct_page,             LDX(snes, x8)) \
+    OP(0xA7, dp_ind_long,             LDA(snes, m8)) \
+    OP(0xA8, implied,                 TAY(snes, x8)) \
+    OP(0xA9, immediateM,              LDA(snes, m8)) \
+    OP(0xAA, implied,                 TAX(snes, x8)) \
+    OP(0xAB, implied,                 PLB(snes)) \
+    OP(0xAC, absolute,                LDY(snes, x8)) \
+    OP(0xAD, absolute,                LDA(snes, m8)) \
+    OP(0xAE, absolute,                LDX(snes, x8)) \
+    OP(0xAF, absolute_long,           LDA(snes, m8)) \
+    OP(0xB0, relative,                BCS(snes)) \
+    OP(0xB2, dp_indirect,             LDA(snes, m8)) \
+    OP(0xB4, direct_page_x,           LDY(snes, x8)) \
+    OP(0xB5, direct_page_x,           LDA(snes, m8)) \
+    OP(0xB6, direct_page_y,           LDX(snes, x8)) \
+    OP(0xB7, dp_ind_long_y,           LDA(snes, m8)) \
+    OP(0xB8, implied,                 CLV(snes)) \
+    OP(0xB9, absolute_y,              LDA(snes, m8)) \
+    OP(0xBB, implied,                 TYX(snes, x8)) \
+    OP(0xBC, absolute_x,              LDY(snes, x8)) \
+    OP(0xBD, absolute_x,              LDA(snes, m8)) \
+    OP(0xBE, absolute_y,              LDX(snes, x8)) \
+    OP(0xC0, immediateX,              CPY(snes, x8)) \
+    OP(0xC2, immediate8,              REP(snes)) \
+    OP(0xC4, direct_page,             CPY(snes, x8)) \
+    OP(0xC6, direct_page,             DEC(snes, m8)) \
+    OP(0xC8, implied,                 INY(snes, x8)) \
+    OP(0xC9, immediateM,              CMP(snes, m8)) \
+    OP(0xCA, implied,                 DEX(snes, x8)) \
+    OP(0xCC, absolute,                CPY(snes, x8)) \
+    OP(0xCD, absolute,                CMP(snes, m8)) \
+    OP(0xCE, absolute,                DEC(snes, m8)) \
+    OP(0xD0, relative,                BNE(snes)) \
+    OP(0xD6, direct_page_x,           DEC(snes, m8)) \
+    OP(0xD8, implied,                 CLD(snes)) \
+    OP(0xDA, implied,                 PHX(snes, x8)) \
+    OP(0xDC, absolute_indirect_long,  JML(snes)) \
+    OP(0xDE, absolute_x_write,        DEC(snes, m8)) \
+    OP(0xE0, immediateX,              CPX(snes, x8)) \
+    OP(0xE2, immediate8,              SEP(snes)) \
+    OP(0xE4, direct_page,             CPX(snes, x8)) \
+    OP(0xE6, direct_page,             INC(snes, m8)) \
+    OP(0xE8, implied,                 INX(snes, x8)) \
+    OP(0xE9, immediateM,              SBC(snes, m8)) \
+    OP(0xEB, implied,                 XBA(snes)) \
+    OP(0xEC, absolute,                CPX(snes, x8)) \
+    OP(0xEE, absolute,                INC(snes, m8)) \
+    OP(0xF0, relative,                BEQ(snes)) \
+    OP(0xF6, direct_page_x,           INC(snes, m8)) \
+    OP(0xF8, implied,                 SED(snes)) \
+    OP(0xFA, implied,                 PLX(snes, x8)) \
+    OP(0xFB, implied,                 XCE(snes)) \
+    OP(0xFE, absolute_x_write,        INC(snes, m8))
+
+static void unknown_opcode(struct SNES_Core* snes)
+{
+    (void)snes;
+    snes_log_fatal("UNK opcode: 0x%02X REG_PC: 0x%04X REG_PBR: 0x%02X REG_A: 0x%04X S: 0x%04X X: 0x%04X Y: 0x%04X P: 0x%02X ticks: %zu\n", snes->opcode, REG_PC, REG_PBR, REG_A, REG_SP, REG_X, REG_Y, get_status_flags(snes), snes->ticks);
+}
+
+#if SNES_CPU_DISPATCH_TABLES || SNES_CPU_CACHE
+// helpers for instantiating CPU_OPCODES once per width, with the
+// width passed as a constant. name is appended to the function name.
+#define OP_M8_X8(GEN, num, mode, op) GEN(m8_x8, true, true, num, mode, op)
+#define OP_M8_X16(GEN, num, mode, op) GEN(m8_x16, true, false, num, mode, op)
+#define OP_M16_X8(GEN, num, mode, op) GEN(m16_x8, false, true, num, mode, op)
+#define OP_M16_X16(GEN, num, mode, op) GEN(m16_x16, false, false, num, mode, op)
+#endif
+
+#if SNES_CPU_DISPATCH_TABLES
+
+typedef void(*cpu_op_t)(struct SNES_Core* snes);
+
+#define CPU_OP_FUNC(name, M8, X8, num, mode, op) \
+    static void op_##name##_##num(struct SNES_Core* snes) \
+    { \
+        const bool m8 = M8; \
+        const bool x8 = X8; \
+        (void)m8; (void)x8; \
+        mode(snes, fetch(snes, LEN_##mode)); \
+        op; \
+    }
+
+#define CPU_OP_ENTRY(name, M8, X8, num, mode, op) [num] = op_##name##_##num,
+
+#define OP_FUNC_M8_X8(num, mode, op) OP_M8_X8(CPU_OP_FUNC, num, mode, op)
+#define OP_FUNC_M8_X16(num, mode, op) OP_M8_X16(CPU_OP_FUNC, num, mode, op)
+#define OP_FUNC_M16_X8(num, mode, op) OP_M16_X8(CPU_OP_FUNC, num, mode, op)
+#define OP_FUNC_M16_X16(num, mode, op) OP_M16_X16(CPU_OP_FUNC, num, mode, op)
+#define OP_ENTRY_M8_X8(num, mode, op) OP_M8_X8(CPU_OP_ENTRY, num, mode, op)
+#define OP_ENTRY_M8_X16(num, mode, op) OP_M8_X16(CPU_OP_ENTRY, num, mode, op)
+#define OP_ENTRY_M16_X8(num, mode, op) OP_M16_X8(CPU_OP_ENTRY, num, mode, op)
+#define OP_ENTRY_M16_X16(num, mode, op) OP_M16_X16(CPU_OP_ENTRY, num, mode, op)
+
+CPU_OPCODES(OP_FUNC_M8_X8)
+CPU_OPCODES(OP_FUNC_M8_X16)
+CPU_OPCODES(OP_FUNC_M16_X8)
+CPU_OPCODES(OP_FUNC_M16_X16)
+
+// unimplemented opcodes are filled first, then overriden.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+
+static const cpu_op_t CPU_TABLES[SNES_CpuWidth_MAX][0x100] =
+{
+    [SNES_CpuWidth_M8_X8] = { [0x00 ... 0xFF] = unknown_opcode, CPU_OPCODES(OP_ENTRY_M8_X8) },
+    [SNES_CpuWidth_M8_X16] = { [0x00 ... 0xFF] = unknown_opcode, CPU_OPCODES(OP_ENTRY_M8_X16) },
+    [SNES_CpuWidth_M16_X8] = { [0x00 ... 0xFF] = unknown_opcode, CPU_OPCODES(OP_ENTRY_M16_X8) },
+    [SNES_CpuWidth_M16_X16] = { [0x00 ... 0xFF] = unknown_opcode, CPU_OPCODES(OP_ENTRY_M16_X16) },
+    // A, X and Y are always 8-bit in emulation mode. nothing else in the
+    // core is emulation specific (yet), so it shares the m8 x8 handlers.
+    [SNES_CpuWidth_EMULATION] = { [0x00 ... 0xFF] = unknown_opcode, CPU_OPCODES(OP_ENTRY_M8_X8) },
+};
+
+#pragma GCC diagnostic pop
+
+static void execute(struct SNES_Core* snes, uint8_t opcode)
+{
+    CPU_TABLES[snes->cpu.width][opcode](snes);
+}
+
+#else
+
+static void execute(struct SNES_Core* snes, uint8_t opcode)
+{
+    const bool m8 = FLAG_M;
+    const bool x8 = FLAG_X;
+
+    #define OP(num, mode, op) case num: mode(snes, fetch(snes, LEN_##mode)); op; break;
+
+    switch (opcode)
+    {
+        CPU_OPCODES(OP)
+
+        default:
+            unknown_opcode(snes);
+            break;
+    }
+
+    #undef OP
 }
 
-void snes_cpu_run(struct SNES_Core* snes)
+#endif // SNES_CPU_DISPATCH_TABLES
+
+#if SNES_PROFILE
+// counts executions and master cycles per opcode and per PBR:PC.
+// per addressing mode totals are summed from the opcodes on export.
+// the cycles of an instruction are everything from its fetch up until
+// the next one, interrupts taken by events aren't counted.
+
+#include <stdlib.h>
+
+struct SNES_ProfileCounter
+{
+    uint64_t count;
+    uint64_t cycles;
+};
+
+struct SNES_ProfilePc
+{
+    uint32_t key; // PBR:PC + 1, 0 if the slot is free
+    uint8_t opcode;
+    struct SNES_ProfileCounter counter;
+};
+
+struct SNES_Profile
+{
+    struct SNES_ProfileCounter opcodes[0x100];
+
+    // open addressing (linear probing) table of every pc executed
+    struct SNES_ProfilePc* pcs;
+    uint32_t pc_capacity; // power of 2
+    uint32_t pc_count;
+};
+
+// the handler name of each opcode, such as "LDA(snes, m8)"
+static const char* const PROFILE_OP_NAMES[0x100] =
+{
+    #define OP(num, mode, op) [num] = #op,
+    CPU_OPCODES(OP)
+    #undef OP
+};
+
+static const char* const PROFILE_MODE_NAMES[0x100] =
+{
+    #define OP(num, mode, op) [num] = #mode,
+    CPU_OPCODES(OP)
+    #undef OP
+};
+
+static uint32_t profile_hash(uint32_t key, uint32_t capacity)
+{
+    return (key * 2654435761u) & (capacity - 1);
+}
+
+static struct SNES_ProfilePc* profile_find(struct SNES_ProfilePc* pcs, uint32_t capacity, uint32_t key)
+{
+    uint32_t i = profile_hash(key, capacity);
+
+    while (pcs[i].key && pcs[i].key != key)
+    {
+        i = (i + 1) & (capacity - 1);
+    }
+
+    return &pcs[i];
+}
+
+static bool profile_grow(struct SNES_Profile* profile)
 {
-    if (FLAG_I == false)
+    const uint32_t capacity = profile->pc_capacity ? profile->pc_capacity * 2 : 1 << 16;
+    struct SNES_ProfilePc* pcs = calloc(capacity, sizeof(struct SNES_ProfilePc));
+
+    if (!pcs)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < profile->pc_capacity; i++)
     {
-        // todo: handle interrupts
+        if (profile->pcs[i].key)
+        {
+            *profile_find(pcs, capacity, profile->pcs[i].key) = profile->pcs[i];
+        }
     }
 
-    breakpoint(snes, 0x8075);
+    free(profile->pcs);
+    profile->pcs = pcs;
+    profile->pc_capacity = capacity;
+    return true;
+}
 
-    const uint8_t opcode = snes_cpu_read8(snes, addr(REG_PBR, REG_PC++));
-    snes->opcode = opcode;
+static void profile_instruction(struct SNES_Profile* profile, uint32_t pc, uint8_t opcode, uint64_t cycles)
+{
+    profile->opcodes[opcode].count++;
+    profile->opcodes[opcode].cycles += cycles;
 
-    switch (opcode)
+    // kept at most half full
+    if (profile->pc_count * 2 >= profile->pc_capacity && !profile_grow(profile))
     {
-        case 0x01: direct_page_x(snes);     ORA(snes); break;
-        case 0x05: direct_page(snes);       ORA(snes); break;
-        case 0x06: direct_page(snes);       ASL(snes); break;
-        case 0x07: dp_ind_long(snes);       ORA(snes); break;
-        case 0x08: implied(snes);           PHP(snes); break;
-        case 0x09: immediateM(snes);        ORA(snes); break;
-        case 0x0A: implied(snes);           ASLA(snes); break;
-        case 0x0B: implied(snes);           PHD(snes); break;
-        case 0x0D: absolute(snes);          ORA(snes); break;
-        case 0x0E: absolute(snes);          ASL(snes); break;
-        case 0x0F: absolute_long(snes);     ORA(snes); break;
-        case 0x10: relative(snes);          BPL(snes); break;
-        case 0x15: direct_page_x(snes);     ORA(snes); break;
-        case 0x16: direct_page_x(snes);     ASL(snes); break;
-        case 0x18: implied(snes);           CLC(snes); break;
-        case 0x19: absolute_y(snes);        ORA(snes); break;
-        case 0x1A: implied(snes);           INA(snes); break;
-        case 0x1B: implied(snes);           TCS(snes); break;
-        case 0x1D: absolute_x(snes);        ORA(snes); break;
-        case 0x1E: absolute_x(snes);        ASL(snes); break;
-        case 0x20: absolute(snes);          JSR(snes); break;
-        // case 0x21: direct_page_x(snes);     AND(snes); break;
-        case 0x22: absolute_long(snes);     JSL(snes); break;
-        case 0x25: direct_page(snes);       AND(snes); break;
-        case 0x26: direct_page(snes);       ROL(snes); break;
-        case 0x28: implied(snes);           PLP(snes); break;
-        case 0x29: immediateM(snes);        AND(snes); break;
-        case 0x2A: implied(snes);           ROLA(snes); break;
-        case 0x2B: implied(snes);           PLD(snes); break;
-        case 0x2D: absolute(snes);          AND(snes); break;
-        case 0x2E: absolute(snes);          ROL(snes); break;
-        case 0x2F: absolute_long(snes);     AND(snes); break;
-        case 0x30: relative(snes);          BMI(snes); break;
-        case 0x35: direct_page_x(snes);     AND(snes); break;
-        case 0x36: direct_page_x(snes);     ROL(snes); break;
-        case 0x38: implied(snes);           SEC(snes); break;
-        case 0x39: absolute_y(snes);        AND(snes); break;
-        case 0x3A: implied(snes);           DEA(snes); break;
-        case 0x3B: implied(snes);           TSC(snes); break;
-        case 0x3D: absolute_x(snes);        AND(snes); break;
-        case 0x3E: absolute_x(snes);        ROL(snes); break;
-        // case 0x41: direct_page_x(snes);     EOR(snes); break;
-        case 0x45: direct_page(snes);       EOR(snes); break;
-        case 0x46: direct_page(snes);       LSR(snes); break;
-        case 0x48: implied(snes);           PHA(snes); break;
-        case 0x49: immediateM(snes);        EOR(snes); break;
-        case 0x4A: implied(snes);           LSRA(snes); break;
-        case 0x4B: implied(snes);           PHK(snes); break;
-        case 0x4C: absolute(snes);          JMP(snes); break;
-        case 0x4D: absolute(snes);          EOR(snes); break;
-        case 0x4E: direct_page_x(snes);     LSR(snes); break;
-        case 0x4F: absolute_long(snes);     EOR(snes); break;
-        case 0x50: relative(snes);          BVC(snes); break;
-        case 0x55: direct_page_x(snes);     EOR(snes); break;
-        case 0x58: implied(snes);           CLI(snes); break;
-        case 0x59: absolute_y(snes);        EOR(snes); break;
-        case 0x5A: implied(snes);           PHY(snes); break;
-        case 0x5B: implied(snes);           TCD(snes); break;
-        case 0x5C: absolute_long(snes);     JML(snes); break;
-        case 0x5D: absolute_x(snes);        EOR(snes); break;
-        case 0x5E: absolute_x(snes);        LSR(snes); break;
-        case 0x60: implied(snes);           RTS(snes); break;
-        case 0x64: direct_page(snes);       STZ(snes); break;
-        case 0x65: direct_page(snes);       ADC(snes); break;
-        case 0x66: direct_page(snes);       ROR(snes); break;
-        case 0x68: implied(snes);           PLA(snes); break;
-        case 0x69: immediateM(snes);        ADC(snes); break;
-        case 0x6A: implied(snes);           RORA(snes); break;
-        case 0x6B: implied(snes);           RTL(snes); break;
-        case 0x6D: absolute(snes);          ADC(snes); break;
-        case 0x6E: absolute(snes);          ROR(snes); break;
-        case 0x6F: absolute_long(snes);     ADC(snes); break;
-        case 0x70: relative(snes);          BVS(snes); break;
-        case 0x74: direct_page_x(snes);     STZ(snes); break;
-        case 0x76: direct_page_x(snes);     ROR(snes); break;
-        case 0x77: dp_ind_long_y(snes);     ADC(snes); break;
-        case 0x78: implied(snes);           SEI(snes); break;
-        case 0x7A: implied(snes);           PLY(snes); break;
-        case 0x7B: implied(snes);           TDC(snes); break;
-        case 0x7E: absolute_x(snes);        ROR(snes); break;
-        case 0x80: relative(snes);          BRA(snes); break;
-        // case 0x81: direct_page_x(snes);     STA(snes); break;
-        case 0xB2: dp_indirect(snes);       LDA(snes); break;
-        case 0x84: direct_page(snes);       STY(snes); break;
-        case 0x85: direct_page(snes);       STA(snes); break;
-        case 0x86: direct_page(snes);       STX(snes); break;
-        // case 0x87: direct_page_long(snes);  STA(snes); break;
-        case 0x88: implied(snes);           DEY(snes); break;
-        case 0x8A: implied(snes);           TXA(snes); break;
-        case 0x8B: implied(snes);           PHB(snes); break;
-        case 0x8C: absolute(snes);          STY(snes); break;
-        case 0x8D: absolute(snes);          STA(snes); break;
-        case 0x8E: absolute(snes);          STX(snes); break;
-        case 0x8F: absolute_long(snes);     STA(snes); break;
-        case 0x90: relative(snes);          BCC(snes); break;
-        case 0x94: direct_page_x(snes);     STY(snes); break;
-        case 0x95: direct_page_x(snes);     STA(snes); break;
-        case 0x96: direct_page_y(snes);     STX(snes); break;
-        case 0x97: dp_ind_long_y(snes);     STA(snes); break;
-        case 0x98: implied(snes);           TYA(snes); break;
-        case 0x99: absolute_y(snes);        STA(snes); break;
-        case 0x9A: implied(snes);           TXS(snes); break;
-        case 0x9B: implied(snes);           TXY(snes); break;
-        case 0x9C: absolute(snes);          STZ(snes); break;
-        case 0x9D: absolute_x(snes);        STA(snes); break;
-        case 0x9E: absolute_x(snes);        STZ(snes); break;
-        case 0x9F: absolute_long_x(snes);   STA(snes); break;
-        case 0xA0: immediateX(snes);        LDY(snes); break;
-        case 0xA2: immediateX(snes);        LDX(snes); break;
-        case 0xA4: direct_page(snes);       LDY(snes); break;
-        case 0xA5: direct_page(snes);       LDA(snes); break;
-        case 0xA6: direct_page(snes);       LDX(snes); break;
-        case 0xA7: dp_ind_long(snes);       LDA(snes); break;
-        case 0xA8: implied(snes);           TAY(snes); break;
-        case 0xA9: immediateM(snes);        LDA(snes); break;
-        case 0xAA: implied(snes);           TAX(snes); break;
-        case 0xAB: implied(snes);           PLB(snes); break;
-        case 0xAC: absolute(snes);          LDY(snes); break;
-        case 0xAD: absolute(snes);          LDA(snes); break;
-        case 0xAE: absolute(snes);          LDX(snes); break;
-        case 0xAF: absolute_long(snes);     LDA(snes); break;
-        case 0xB0: relative(snes);          BCS(snes); break;
-        case 0xB4: direct_page_x(snes);     LDY(snes); break;
-        case 0xB5: direct_page_x(snes);     LDA(snes); break;
-        case 0xB6: direct_page_y(snes);     LDX(snes); break;
-        case 0xB7: dp_ind_long_y(snes);     LDA(snes); break;
-        case 0xB8: implied(snes);           CLV(snes); break;
-        case 0xB9: absolute_y(snes);        LDA(snes); break;
-        case 0xBB: implied(snes);           TYX(snes); break;
-        case 0xBC: absolute_x(snes);        LDY(snes); break;
-        case 0xBD: absolute_x(snes);        LDA(snes); break;
-        case 0xBE: absolute_y(snes);        LDX(snes); break;
-        case 0xC0: immediateX(snes);        CPY(snes); break;
-        case 0xC2: immediate8(snes);        REP(snes); break;
-        case 0xC4: direct_page(snes);       CPY(snes); break;
-        case 0xC6: direct_page(snes);       DEC(snes); break;
-        case 0xC8: implied(snes);           INY(snes); break;
-        case 0xC9: immediateM(snes);        CMP(snes); break;
-        case 0xCA: implied(snes);           DEX(snes); break;
-        case 0xCC: absolute(snes);          CPY(snes); break;
-        case 0xCD: absolute(snes);          CMP(snes); break;
-        case 0xCE: absolute(snes);          DEC(snes); break;
-        case 0xD0: relative(snes);          BNE(snes); break;
-        case 0xD6: direct_page_x(snes);     DEC(snes); break;
-        case 0xD8: implied(snes);           CLD(snes); break;
-        case 0xDA: implied(snes);           PHX(snes); break;
-        case 0xDC: absolute_indirect_long(snes);    JML(snes); break;
-        case 0xDE: absolute_x(snes);        DEC(snes); break;
-        case 0xE0: immediateX(snes);        CPX(snes); break;
-        case 0xE2: immediate8(snes);        SEP(snes); break;
-        case 0xE4: direct_page(snes);       CPX(snes); break;
-        case 0xE6: direct_page(snes);       INC(snes); break;
-        case 0xE8: implied(snes);           INX(snes); break;
-        case 0xE9: immediateM(snes);        SBC(snes); break;
-        case 0xEB: implied(snes);           XBA(snes); break;
-        case 0xEC: absolute(snes);          CPX(snes); break;
-        case 0xEE: absolute(snes);          INC(snes); break;
-        case 0xF0: relative(snes);          BEQ(snes); break;
-        case 0xF6: direct_page_x(snes);     INC(snes); break;
-        case 0xF8: implied(snes);           SED(snes); break;
-        case 0xFA: implied(snes);           PLX(snes); break;
-        case 0xFB: implied(snes);           XCE(snes); break;
-        case 0xFE: absolute_x(snes);        INC(snes); break;
+        return;
+    }
 
-        default:
-            snes_log_fatal("UNK opcode: 0x%02X REG_PC: 0x%04X REG_PBR: 0x%02X REG_A: 0x%04X S: 0x%04X X: 0x%04X Y: 0x%04X P: 0x%02X ticks: %zu\n", opcode, REG_PC, REG_PBR, REG_A, REG_SP, REG_X, REG_Y, get_status_flags(snes), snes->ticks);
-            break;
+    struct SNES_ProfilePc* entry = profile_find(profile->pcs, profile->pc_capacity, pc + 1);
+
+    if (!entry->key)
+    {
+        entry->key = pc + 1;
+        entry->opcode = opcode;
+        profile->pc_count++;
     }
 
-    snes->ticks++;
+    entry->counter.count++;
+    entry->counter.cycles += cycles;
+}
+
+bool snes_profile_start(struct SNES_Core* snes)
+{
+    snes_profile_stop(snes);
+
+    struct SNES_Profile* profile = calloc(1, sizeof(struct SNES_Profile));
+
+    if (!profile || !profile_grow(profile))
+    {
+        free(profile);
+        return false;
+    }
+
+    snes->profile = profile;
+    return true;
+}
+
+void snes_profile_stop(struct SNES_Core* snes)
+{
+    if (snes->profile)
+    {
+        free(snes->profile->pcs);
+        free(snes->profile);
+        snes->profile = NULL;
+    }
+}
+
+struct ProfileRow
+{
+    const char* name;
+    uint32_t pc;
+    uint8_t opcode;
+    struct SNES_ProfileCounter counter;
+};
+
+static int profile_row_cmp(const void* a, const void* b)
+{
+    const uint64_t x = ((const struct ProfileRow*)a)->counter.cycles;
+    const uint64_t y = ((const struct ProfileRow*)b)->counter.cycles;
+
+    return (x < y) - (x > y);
+}
+
+enum ProfileKind
+{
+    ProfileKind_OPCODE,
+    ProfileKind_MODE,
+    ProfileKind_PC,
+};
+
+// builds the rows of a kind sorted by cycles, the caller frees them
+static struct ProfileRow* profile_rows(const struct SNES_Profile* profile, enum ProfileKind kind, size_t* count)
+{
+    const size_t max = kind == ProfileKind_PC ? profile->pc_count : 0x100;
+    struct ProfileRow* rows = calloc(max ? max : 1, sizeof(struct ProfileRow));
+    size_t n = 0;
+
+    if (!rows)
+    {
+        *count = 0;
+        return NULL;
+    }
+
+    for (uint32_t i = 0; kind == ProfileKind_PC && i < profile->pc_capacity; i++)
+    {
+        const struct SNES_ProfilePc* entry = &profile->pcs[i];
+
+        if (entry->key)
+        {
+            rows[n++] = (struct ProfileRow){ PROFILE_OP_NAMES[entry->opcode], entry->key - 1, entry->opcode, entry->counter };
+        }
+    }
+
+    for (unsigned op = 0; kind != ProfileKind_PC && op < 0x100; op++)
+    {
+        const struct SNES_ProfileCounter* counter = &profile->opcodes[op];
+
+        if (!counter->count)
+        {
+            continue;
+        }
+
+        if (kind == ProfileKind_OPCODE)
+        {
+            rows[n++] = (struct ProfileRow){ PROFILE_OP_NAMES[op], 0, op, *counter };
+            continue;
+        }
+
+        size_t i = 0;
+
+        while (i < n && strcmp(rows[i].name, PROFILE_MODE_NAMES[op]))
+        {
+            i++;
+        }
+
+        if (i == n)
+        {
+            rows[n++] = (struct ProfileRow){ .name = PROFILE_MODE_NAMES[op] };
+        }
+
+        rows[i].counter.count += counter->count;
+        rows[i].counter.cycles += counter->cycles;
+    }
+
+    qsort(rows, n, sizeof(struct ProfileRow), profile_row_cmp);
+    *count = n;
+    return rows;
+}
+
+// copies up to the '(' of the handler name, "LDA(snes, m8)" -> "LDA"
+static const char* profile_op_name(char* out, size_t size, const char* handler)
+{
+    const char* end = strchr(handler, '(');
+    snprintf(out, size, "%.*s", end ? (int)(end - handler) : (int)strlen(handler), handler);
+    return out;
+}
+
+bool snes_profile_write_report(const struct SNES_Core* snes, const char* path, size_t max_pcs)
+{
+    const struct SNES_Profile* profile = snes->profile;
+    FILE* file;
+
+    if (!profile || !(file = fopen(path, "w")))
+    {
+        return false;
+    }
+
+    uint64_t total_count = 0;
+    uint64_t total_cycles = 0;
+
+    for (unsigned op = 0; op < 0x100; op++)
+    {
+        total_count += profile->opcodes[op].count;
+        total_cycles += profile->opcodes[op].cycles;
+    }
+
+    fprintf(file, "instructions: %llu master cycles: %llu unique pcs: %u\n",
+        (unsigned long long)total_count, (unsigned long long)total_cycles, profile->pc_count);
+
+    static const char* const titles[] = { "opcodes", "addressing modes", "pcs" };
+
+    for (unsigned kind = ProfileKind_OPCODE; kind <= ProfileKind_PC; kind++)
+    {
+        size_t count = 0;
+        struct ProfileRow* rows = profile_rows(profile, kind, &count);
+
+        if (kind == ProfileKind_PC && count > max_pcs)
+        {
+            count = max_pcs;
+        }
+
+        fprintf(file, "\n%s (by cycles)\n", titles[kind]);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const struct ProfileRow* row = &rows[i];
+            const double percent = total_cycles ? 100.0 * (double)row->counter.cycles / (double)total_cycles : 0.0;
+
+            if (kind == ProfileKind_PC)
+            {
+                fprintf(file, "  %02X:%04X", row->pc >> 16, row->pc & 0xFFFF);
+            }
+
+            if (kind == ProfileKind_MODE)
+            {
+                fprintf(file, "  %-24s", row->name);
+            }
+            else
+            {
+                char name[32];
+                fprintf(file, "%s%02X %-8s", kind == ProfileKind_PC ? " " : "  ", row->opcode, profile_op_name(name, sizeof(name), row->name));
+            }
+
+            fprintf(file, " %6.2f%% count: %12llu cycles: %14llu\n", percent,
+                (unsigned long long)row->counter.count, (unsigned long long)row->counter.cycles);
+        }
+
+        free(rows);
+    }
+
+    fclose(file);
+    return true;
+}
+
+bool snes_profile_write_csv(const struct SNES_Core* snes, const char* path)
+{
+    const struct SNES_Profile* profile = snes->profile;
+    FILE* file;
+
+    if (!profile || !(file = fopen(path, "w")))
+    {
+        return false;
+    }
+
+    static const char* const kinds[] = { "opcode", "mode", "pc" };
+
+    fprintf(file, "kind,key,opcode,name,count,cycles\n");
+
+    for (unsigned kind = ProfileKind_OPCODE; kind <= ProfileKind_PC; kind++)
+    {
+        size_t count = 0;
+        struct ProfileRow* rows = profile_rows(profile, kind, &count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const struct ProfileRow* row = &rows[i];
+            char name[32];
+
+            fprintf(file, "%s,", kinds[kind]);
+
+            switch (kind)
+            {
+                case ProfileKind_OPCODE: fprintf(file, "0x%02X,0x%02X,", row->opcode, row->opcode); break;
+                case ProfileKind_MODE: fprintf(file, "%s,,", row->name); break;
+                case ProfileKind_PC: fprintf(file, "0x%06X,0x%02X,", row->pc, row->opcode); break;
+            }
+
+            fprintf(file, "%s,%llu,%llu\n", kind == ProfileKind_MODE ? row->name : profile_op_name(name, sizeof(name), row->name),
+                (unsigned long long)row->counter.count, (unsigned long long)row->counter.cycles);
+        }
+
+        free(rows);
+    }
+
+    fclose(file);
+    return true;
+}
+
+#else
+
+bool snes_profile_start(struct SNES_Core* snes)
+{
+    (void)snes;
+    return false;
+}
+
+void snes_profile_stop(struct SNES_Core* snes)
+{
+    (void)snes;
+}
+
+bool snes_profile_write_report(const struct SNES_Core* snes, const char* path, size_t max_pcs)
+{
+    (void)snes; (void)path; (void)max_pcs;
+    return false;
+}
+
+bool snes_profile_write_csv(const struct SNES_Core* snes, const char* path)
+{
+    (void)snes; (void)path;
+    return false;
+}
+
+#endif // SNES_PROFILE
+
+#if SNES_TRACE
+// reads through the page table only, io reads have side effects so
+// they're not traced (and unmapped memory reads as 0)
+static uint8_t trace_peek(const struct SNES_Core* snes, uint32_t addr)
+{
+    addr &= 0x00FFFFFF;
+    const uint8_t* page = snes->mem.rmap[addr >> SNES_MEM_PAGE_SHIFT];
+    return page ? page[addr & SNES_MEM_PAGE_MASK] : 0;
+}
+
+// records the instruction at PBR:PC before it runs
+static void trace_instruction(const struct SNES_Core* snes)
+{
+    const uint32_t pc = addr(REG_PBR, REG_PC);
+    const struct SNES_TraceRecord record =
+    {
+        .cycles = snes->scheduler.cycles,
+        .pc = pc,
+        .operand =
+            trace_peek(snes, addr(REG_PBR, REG_PC + 1)) << 0 |
+            trace_peek(snes, addr(REG_PBR, REG_PC + 2)) << 8 |
+            trace_peek(snes, addr(REG_PBR, REG_PC + 3)) << 16,
+        .A = REG_A,
+        .X = REG_X,
+        .Y = REG_Y,
+        .SP = REG_SP,
+        .D = REG_D,
+        .DBR = REG_DBR,
+        .P = get_status_flags(snes),
+        .opcode = trace_peek(snes, pc),
+        .E = FLAG_E,
+    };
+
+    snes_trace_push(snes->trace, &record);
+}
+#endif // SNES_TRACE
+
+// fetch, decode and execute a single instruction
+static void interpret(struct SNES_Core* snes)
+{
+#if SNES_TRACE
+    if (snes->trace)
+    {
+        trace_instruction(snes);
+    }
+#endif
+
+#if SNES_PROFILE
+    const uint32_t pc = addr(REG_PBR, REG_PC);
+    const uint64_t cycles = snes->scheduler.cycles;
+#endif
+
+    const uint8_t opcode = snes_cpu_read8(snes, addr(REG_PBR, REG_PC++));
+    snes->opcode = opcode;
+
+    execute(snes, opcode);
+
+    snes->ticks++;
+
+#if SNES_PROFILE
+    if (snes->profile)
+    {
+        profile_instruction(snes->profile, pc, opcode, snes->scheduler.cycles - cycles);
+    }
+#endif
+}
+
+#if SNES_CPU_CACHE || SNES_CPU_IDLE_SKIP
+// returns the operand length of an opcode or -1 if not implemented
+static int opcode_len(uint8_t opcode, bool m8, bool x8)
+{
+    #define OP(num, mode, op) case num: return LEN_##mode;
+
+    switch (opcode)
+    {
+        CPU_OPCODES(OP)
+    }
+
+    #undef OP
+
+    return -1;
+}
+#endif
+
+#if SNES_CPU_IDLE_SKIP
+
+// idle loops are short backward branch loops that only read memory,
+// such as "LDA $4210 / BPL" or "LDA $10 / BEQ" waiting on nmi.
+// once a full iteration ends in the exact same state as the one before,
+// every following iteration is the same until an event changes something,
+// so whole iterations are skipped up to the next event.
+enum
+{
+    IDLE_LOOP_MAX_SIZE = 32, // bytes
+};
+
+// io that is safe to poll, reading it has no effect other than
+// what the next iteration would see anyway.
+static bool idle_io_ok(uint32_t addr)
+{
+    switch (addr & 0xFFFF)
+    {
+        case 0x2140 ... 0x2143: // APUIO
+        case 0x4210: // RDNMI
+        case 0x4211: // TIMEUP
+        case 0x4212: // HVBJOY
+            return true;
+    }
+
+    return false;
+}
+
+static bool idle_read_ok(const struct SNES_Core* snes, uint32_t addr, uint8_t size)
+{
+    for (uint8_t i = 0; i < size; i++)
+    {
+        const uint32_t a = (addr + i) & 0xFFFFFF;
+
+        if (!snes->mem.rmap[a >> SNES_MEM_PAGE_SHIFT] && !idle_io_ok(a))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// decodes the loop (start to end) and checks that every instruction
+// only reads memory that is plain memory or safe io.
+static bool idle_loop_ok(struct SNES_Core* snes, uint16_t start, uint16_t end)
+{
+    const bool m8 = FLAG_M || FLAG_E;
+    const bool x8 = FLAG_X || FLAG_E;
+    uint16_t pc = start;
+
+    if ((uint16_t)(end - start) > IDLE_LOOP_MAX_SIZE)
+    {
+        return false;
+    }
+
+    while (pc != end)
+    {
+        const uint32_t op_addr = addr(REG_PBR, pc);
+        const uint8_t* page = snes->mem.rmap[op_addr >> SNES_MEM_PAGE_SHIFT];
+
+        if (!page || !snes->mem.rmap[addr(REG_PBR, pc + 3) >> SNES_MEM_PAGE_SHIFT])
+        {
+            return false;
+        }
+
+        const uint8_t* code = page + (op_addr & SNES_MEM_PAGE_MASK);
+        const int len = opcode_len(code[0], m8, x8);
+        const uint32_t raw = code[1] | (code[2] << 8) | (code[3] << 16);
+        // size of the value read, only loads / compares are allowed
+        const uint8_t size_m = m8 ? 1 : 2;
+        const uint8_t size_x = x8 ? 1 : 2;
+        bool ok = false;
+
+        switch (code[0])
+        {
+            case 0xA9: case 0xA2: case 0xA0: case 0xC9: case 0xE0: case 0xC0: // immediate
+            case 0x89: case 0x29: case 0x09: case 0x49:
+            case 0xEA: // NOP
+            case 0x10: case 0x30: case 0x50: case 0x70: case 0x80: // branches
+            case 0x90: case 0xB0: case 0xD0: case 0xF0:
+                ok = true;
+                break;
+
+            case 0xA5: case 0xC5: case 0x24: case 0x25: case 0x05: case 0x45: // direct page
+                ok = idle_read_ok(snes, (raw + REG_D) & 0xFFFF, size_m);
+                break;
+
+            case 0xA6: case 0xA4: case 0xE4: case 0xC4:
+                ok = idle_read_ok(snes, (raw + REG_D) & 0xFFFF, size_x);
+                break;
+
+            case 0xAD: case 0xCD: case 0x2C: case 0x2D: case 0x0D: case 0x4D: // absolute
+                ok = idle_read_ok(snes, addr(REG_DBR, raw), size_m);
+                break;
+
+            case 0xAE: case 0xAC: case 0xEC: case 0xCC:
+                ok = idle_read_ok(snes, addr(REG_DBR, raw), size_x);
+                break;
+
+            case 0xAF: case 0xCF: case 0x2F: case 0x0F: case 0x4F: // absolute long
+                ok = idle_read_ok(snes, raw, size_m);
+                break;
+        }
+
+        if (!ok || len < 0)
+        {
+            return false;
+        }
+
+        pc += 1 + len;
+
+        // the loop has to end on the branch that was taken
+        if ((uint16_t)(pc - start) > (uint16_t)(end - start))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void idle_save(struct SNES_Core* snes)
+{
+    struct SNES_CpuIdle* idle = &snes->cpu_idle;
+
+    idle->A = REG_A;
+    idle->X = REG_X;
+    idle->Y = REG_Y;
+    idle->P = get_status_flags(snes);
+    idle->open_bus = snes->mem.open_bus;
+    idle->cycles = snes->scheduler.cycles;
+    idle->ticks = snes->ticks;
+    idle->armed = true;
+}
+
+static bool idle_same(const struct SNES_Core* snes)
+{
+    const struct SNES_CpuIdle* idle = &snes->cpu_idle;
+
+    // the loop can't change anything else (PC, S, D, DBR, E)
+    return idle->A == REG_A && idle->X == REG_X && idle->Y == REG_Y &&
+        idle->P == get_status_flags(snes) && idle->open_bus == snes->mem.open_bus;
+}
+
+// called on every backward branch, loop_end is the address after the branch
+static void idle_check(struct SNES_Core* snes, uint16_t loop_end)
+{
+    struct SNES_CpuIdle* idle = &snes->cpu_idle;
+    const uint32_t key = addr(REG_PBR, loop_end) | (snes->cpu.width << 24);
+
+    // the operand addresses depend on D and DBR
+    if (idle->key != key || idle->D != REG_D || idle->DBR != REG_DBR)
+    {
+        idle->key = key;
+        idle->D = REG_D;
+        idle->DBR = REG_DBR;
+        idle->loop_ok = idle_loop_ok(snes, REG_PC, loop_end);
+        idle->armed = false;
+    }
+
+    if (!idle->loop_ok)
+    {
+        return;
+    }
+
+    const uint64_t now = snes->scheduler.cycles;
+    const uint64_t next = snes->scheduler.next;
+
+    if (idle->armed && idle_same(snes) && now < next && now > idle->cycles)
+    {
+        const uint64_t iter_cycles = now - idle->cycles;
+        const uint64_t iter_ticks = snes->ticks - idle->ticks;
+        const uint64_t n = (next - now) / iter_cycles;
+
+        snes->scheduler.cycles += n * iter_cycles;
+        snes->ticks += n * iter_ticks;
+        idle->skipped += n * iter_cycles;
+    }
+
+    idle_save(snes);
+}
+
+#endif // SNES_CPU_IDLE_SKIP
+
+#if SNES_CPU_CACHE
+
+// the cached interpreter decodes runs of instructions (blocks) up to the
+// next branch / jump / width change into a list of ops with the operand
+// already fetched. blocks are keyed by PBR:PC and the cpu width.
+// only code in plain memory (rom, wram, sram) is cached, blocks that
+// contain wram are invalidated when that wram is written to.
+
+typedef void(*cpu_exec_t)(struct SNES_Core* snes, uint32_t raw);
+
+#if SNES_JIT
+// number of runs before a block is translated by the jit
+#define SNES_JIT_HOT_BLOCK 16
+#endif
+
+#define CPU_EXEC_FUNC(name, M8, X8, num, mode, op) \
+    static void exec_##name##_##num(struct SNES_Core* snes, uint32_t raw) \
+    { \
+        const bool m8 = M8; \
+        const bool x8 = X8; \
+        (void)m8; (void)x8; \
+        mode(snes, raw); \
+        op; \
+    }
+
+#define CPU_EXEC_ENTRY(name, M8, X8, num, mode, op) [num] = exec_##name##_##num,
+
+#define EXEC_FUNC_M8_X8(num, mode, op) OP_M8_X8(CPU_EXEC_FUNC, num, mode, op)
+#define EXEC_FUNC_M8_X16(num, mode, op) OP_M8_X16(CPU_EXEC_FUNC, num, mode, op)
+#define EXEC_FUNC_M16_X8(num, mode, op) OP_M16_X8(CPU_EXEC_FUNC, num, mode, op)
+#define EXEC_FUNC_M16_X16(num, mode, op) OP_M16_X16(CPU_EXEC_FUNC, num, mode, op)
+#define EXEC_ENTRY_M8_X8(num, mode, op) OP_M8_X8(CPU_EXEC_ENTRY, num, mode, op)
+#define EXEC_ENTRY_M8_X16(num, mode, op) OP_M8_X16(CPU_EXEC_ENTRY, num, mode, op)
+#define EXEC_ENTRY_M16_X8(num, mode, op) OP_M16_X8(CPU_EXEC_ENTRY, num, mode, op)
+#define EXEC_ENTRY_M16_X16(num, mode, op) OP_M16_X16(CPU_EXEC_ENTRY, num, mode, op)
+
+CPU_OPCODES(EXEC_FUNC_M8_X8)
+CPU_OPCODES(EXEC_FUNC_M8_X16)
+CPU_OPCODES(EXEC_FUNC_M16_X8)
+CPU_OPCODES(EXEC_FUNC_M16_X16)
+
+// unimplemented opcodes are NULL, they are never cached.
+static const cpu_exec_t CPU_EXEC_TABLES[SNES_CpuWidth_MAX][0x100] =
+{
+    [SNES_CpuWidth_M8_X8] = { CPU_OPCODES(EXEC_ENTRY_M8_X8) },
+    [SNES_CpuWidth_M8_X16] = { CPU_OPCODES(EXEC_ENTRY_M8_X16) },
+    [SNES_CpuWidth_M16_X8] = { CPU_OPCODES(EXEC_ENTRY_M16_X8) },
+    [SNES_CpuWidth_M16_X16] = { CPU_OPCODES(EXEC_ENTRY_M16_X16) },
+    [SNES_CpuWidth_EMULATION] = { CPU_OPCODES(EXEC_ENTRY_M8_X8) },
+};
+
+
+// opcodes that change PC (other than by their length) or the cpu width.
+// this also includes unimplemented control flow opcodes.
+static bool opcode_ends_block(uint8_t opcode)
+{
+    switch (opcode)
+    {
+        case 0x00: case 0x02: case 0x40: case 0xCB: case 0xDB: // BRK COP RTI WAI STP
+        case 0x10: case 0x30: case 0x50: case 0x70: // BPL BMI BVC BVS
+        case 0x80: case 0x82: case 0x90: case 0xB0: // BRA BRL BCC BCS
+        case 0xD0: case 0xF0: // BNE BEQ
+        case 0x20: case 0x22: case 0xFC: // JSR JSL
+        case 0x4C: case 0x5C: case 0x6C: case 0x7C: case 0xDC: // JMP JML
+        case 0x60: case 0x6B: // RTS RTL
+        case 0x44: case 0x54: // MVP MVN
+        case 0xC2: case 0xE2: case 0x28: case 0xFB: // REP SEP PLP XCE
+            return true;
+    }
+
+    return false;
+}
+
+// reads a byte of code without side effects, fails if not plain memory
+static bool cache_peek(struct SNES_Core* snes, uint32_t addr, uint8_t* value)
+{
+    addr &= 0xFFFFFF;
+    const uint8_t* page = snes->mem.rmap[addr >> SNES_MEM_PAGE_SHIFT];
+    uint32_t offset = 0;
+
+    if (!page)
+    {
+        return false;
+    }
+
+    // writable memory that isn't wram is sram, which isn't tracked
+    if (snes->mem.wmap[addr >> SNES_MEM_PAGE_SHIFT] && !snes_mem_wram_offset(addr, &offset))
+    {
+        return false;
+    }
+
+    *value = page[addr & SNES_MEM_PAGE_MASK];
+    return true;
+}
+
+static void cache_mark_wram(struct SNES_Core* snes, struct SNES_CpuBlock* block, uint32_t addr)
+{
+    uint32_t offset = 0;
+
+    if (!snes_mem_wram_offset(addr & 0xFFFFFF, &offset))
+    {
+        return;
+    }
+
+    const uint8_t page = offset >> SNES_MEM_PAGE_SHIFT;
+    const uint16_t line = offset / SNES_CPU_CACHE_LINE_SIZE;
+
+    block->wram = true;
+    snes->cpu_cache.wram_code_lines[line / 8] |= 1 << (line % 8);
+
+    if (!(snes->cpu_cache.wram_code_pages & (1 << page)))
+    {
+        snes->cpu_cache.wram_code_pages |= 1 << page;
+        snes_mem_trap_wram_writes(snes, page, SNES_WramTrap_CODE, true);
+    }
+}
+
+// the same cost snes_cpu_read8() would add for addr
+static uint8_t cache_access_cycles(const struct SNES_Core* snes, uint32_t addr)
+{
+    return snes->mem.access_cycles[(addr & 0xFFFFFF) >> SNES_MEM_PAGE_SHIFT];
+}
+
+static bool cache_compile(struct SNES_Core* snes, struct SNES_CpuBlock* block, uint32_t key)
+{
+    const uint8_t width = key >> 24;
+    const bool m8 = width != SNES_CpuWidth_M16_X8 && width != SNES_CpuWidth_M16_X16;
+    const bool x8 = width != SNES_CpuWidth_M8_X16 && width != SNES_CpuWidth_M16_X16;
+    const uint8_t pbr = key >> 16;
+    uint16_t pc = key & 0xFFFF;
+
+    block->key = key;
+    block->count = 0;
+    block->wram = false;
+    block->hits = 0;
+    block->native = NULL;
+    block->wram_gen = snes->cpu_cache.wram_gen;
+
+    while (block->count < SNES_CPU_BLOCK_MAX_OPS)
+    {
+        struct SNES_CpuOp* op = &block->ops[block->count];
+        const uint32_t opcode_addr = addr(pbr, pc);
+        const uint32_t operand_addr = addr(pbr, pc + 1);
+        uint8_t opcode = 0;
+        uint8_t bytes[3] = {0};
+
+        if (!cache_peek(snes, opcode_addr, &opcode))
+        {
+            break;
+        }
+
+        const int len = opcode_len(opcode, m8, x8);
+
+        if (len < 0)
+        {
+            break;
+        }
+
+        int i = 0;
+
+        for (; i < len; i++)
+        {
+            if (!cache_peek(snes, operand_addr + i, &bytes[i]))
+            {
+                break;
+            }
+        }
+
+        if (i != len)
+        {
+            break;
+        }
+
+        cache_mark_wram(snes, block, opcode_addr);
+        op->cycles = cache_access_cycles(snes, opcode_addr);
+
+        for (i = 0; i < len; i++)
+        {
+            cache_mark_wram(snes, block, operand_addr + i);
+            op->cycles += cache_access_cycles(snes, operand_addr + i);
+        }
+
+        op->exec = CPU_EXEC_TABLES[width][opcode];
+        op->raw = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+        op->oprand = operand_addr;
+        op->pc_next = pc + 1 + len;
+        op->opcode = opcode;
+        op->open_bus = len ? bytes[len - 1] : opcode;
+
+        block->count++;
+        pc = op->pc_next;
+
+        if (opcode_ends_block(opcode))
+        {
+            break;
+        }
+    }
+
+    return block->count > 0;
+}
+
+static struct SNES_CpuBlock* cache_lookup(struct SNES_Core* snes, uint32_t key)
+{
+    const uint32_t index = (key ^ (key >> 11) ^ (key >> 22)) & (SNES_CPU_BLOCK_COUNT - 1);
+    struct SNES_CpuBlock* block = &snes->cpu_cache.blocks[index];
+
+    if (block->count && block->key == key && (!block->wram || block->wram_gen == snes->cpu_cache.wram_gen))
+    {
+        return block;
+    }
+
+    if (cache_compile(snes, block, key))
+    {
+        return block;
+    }
+
+    return NULL;
+}
+
+static void cache_run(struct SNES_Core* snes)
+{
+    const uint32_t key = addr(REG_PBR, REG_PC) | (snes->cpu.width << 24);
+    struct SNES_CpuBlock* block = cache_lookup(snes, key);
+
+    // code in io / unmapped memory or unimplemented opcode
+    if (!block)
+    {
+        interpret(snes);
+        return;
+    }
+
+#if SNES_JIT
+    // native blocks don't stop per instruction, so they can't be traced
+    if (!instrumented(snes))
+    {
+        if (block->native)
+        {
+            block->native(snes);
+            return;
+        }
+
+        if (++block->hits >= SNES_JIT_HOT_BLOCK && snes_jit_compile(snes, block))
+        {
+            block->native(snes);
+            return;
+        }
+    }
+#endif
+
+    const uint32_t wram_gen = snes->cpu_cache.wram_gen;
+
+    for (uint8_t i = 0; i < block->count; i++)
+    {
+        const struct SNES_CpuOp* op = &block->ops[i];
+
+#if SNES_TRACE
+        if (snes->trace)
+        {
+            trace_instruction(snes);
+        }
+#endif
+
+#if SNES_PROFILE
+        const uint32_t pc = addr(REG_PBR, REG_PC);
+        const uint64_t cycles = snes->scheduler.cycles;
+#endif
+
+        REG_PC = op->pc_next;
+        snes->cpu.oprand = op->oprand;
+        snes->mem.open_bus = op->open_bus;
+        snes->opcode = op->opcode;
+        snes->scheduler.cycles += op->cycles;
+
+        op->exec(snes, op->raw);
+        snes->ticks++;
+
+#if SNES_PROFILE
+        if (snes->profile)
+        {
+            profile_instruction(snes->profile, pc, op->opcode, snes->scheduler.cycles - cycles);
+        }
+#endif
+
+        // the block wrote over cached wram code, possibly itself
+        if (wram_gen != snes->cpu_cache.wram_gen)
+        {
+            break;
+        }
+
+        // stop at the same instruction the interpreter would
+        if (snes->scheduler.cycles >= snes->scheduler.next)
+        {
+            break;
+        }
+    }
+}
+
+#endif // SNES_CPU_CACHE
+
+void snes_cpu_cache_reset(struct SNES_Core* snes)
+{
+    struct SNES_CpuCache* cache = &snes->cpu_cache;
+
+    for (size_t i = 0; i < ARRAY_SIZE(cache->blocks); i++)
+    {
+        cache->blocks[i].count = 0;
+        cache->blocks[i].native = NULL;
+    }
+
+    snes_cpu_cache_invalidate_wram(snes);
+}
+
+void snes_cpu_cache_invalidate_wram(struct SNES_Core* snes)
+{
+    struct SNES_CpuCache* cache = &snes->cpu_cache;
+
+    for (uint8_t page = 0; page < 16; page++)
+    {
+        if (cache->wram_code_pages & (1 << page))
+        {
+            snes_mem_trap_wram_writes(snes, page, SNES_WramTrap_CODE, false);
+        }
+    }
+
+    cache->wram_gen++;
+    cache->wram_code_pages = 0;
+    memset(cache->wram_code_lines, 0, sizeof(cache->wram_code_lines));
+}
+
+void snes_cpu_cache_on_wram_write(struct SNES_Core* snes, uint32_t offset)
+{
+    const uint16_t line = offset / SNES_CPU_CACHE_LINE_SIZE;
+
+    if (snes->cpu_cache.wram_code_lines[line / 8] & (1 << (line % 8)))
+    {
+        snes_cpu_cache_invalidate_wram(snes);
+    }
+}
+
+void snes_cpu_step(struct SNES_Core* snes)
+{
+    interpret(snes);
+}
+
+void snes_cpu_nmi(struct SNES_Core* snes)
+{
+    snes->cpu.nmi_pending = true;
+    snes_scheduler_add(snes, SNES_Event_INTERRUPT, snes->scheduler.cycles);
+}
+
+void snes_cpu_irq(struct SNES_Core* snes, bool line)
+{
+    snes->cpu.irq_line = line;
+    check_irq(snes);
+}
+
+void snes_cpu_poll_interrupts(struct SNES_Core* snes)
+{
+    if (snes->cpu.nmi_pending)
+    {
+        snes->cpu.nmi_pending = false;
+        on_nmi(snes);
+    }
+    else if (snes->cpu.irq_line && !FLAG_I)
+    {
+        on_irq(snes);
+    }
+}
+
+void snes_cpu_run(struct SNES_Core* snes)
+{
+#if SNES_CPU_CACHE
+    cache_run(snes);
+#else
+    interpret(snes);
+#endif
+
+#if SNES_JIT_LOCKSTEP
+    snes_jit_lockstep(snes);
+#endif
 }
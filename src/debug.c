@@ -0,0 +1,219 @@
+#include "internal.h"
+#include "snes.h"
+#include "types.h"
+#include <stdint.h>
+#include <string.h>
+
+
+// NOTE: breakpoints cost nothing unless they're set, see struct SNES_Debug.
+// a hit stops the cpu at the end of the current instruction (the start
+// of it for exec breakpoints) and snes_run_frame() returns SNES_RunResult_BREAK.
+
+enum
+{
+    // a cached block runs at most this many bytes past PC
+    DEBUG_BLOCK_BYTES = SNES_CPU_BLOCK_MAX_OPS * 4,
+};
+
+static void flag_pages(struct SNES_Debug* debug, uint32_t start, uint32_t end, uint8_t flags)
+{
+    for (uint32_t page = start >> SNES_MEM_PAGE_SHIFT; page <= end >> SNES_MEM_PAGE_SHIFT; page++)
+    {
+        debug->page_flags[page] |= flags;
+    }
+}
+
+// rebuilds the page flags and the memory map after a breakpoint change
+static void update_pages(struct SNES_Core* snes)
+{
+    struct SNES_Debug* debug = &snes->debug;
+
+    memset(debug->page_flags, 0, sizeof(debug->page_flags));
+    debug->exec_count = 0;
+
+    for (size_t i = 0; i < ARRAY_SIZE(debug->breakpoints); i++)
+    {
+        const struct SNES_BreakpointEntry* bp = &debug->breakpoints[i];
+        const uint8_t flags = bp->type & (SNES_Breakpoint_EXEC | SNES_Breakpoint_READ | SNES_Breakpoint_WRITE);
+
+        if (!bp->type)
+        {
+            continue;
+        }
+
+        if (bp->type & SNES_Breakpoint_EXEC)
+        {
+            debug->exec_count++;
+        }
+
+        if (bp->type & SNES_Breakpoint_IO)
+        {
+            for (unsigned bank = 0x00; bank < 0x40; bank++)
+            {
+                flag_pages(debug, bank << 16 | bp->start, bank << 16 | bp->end, flags);
+                flag_pages(debug, (bank | 0x80) << 16 | bp->start, (bank | 0x80) << 16 | bp->end, flags);
+            }
+        }
+        else
+        {
+            flag_pages(debug, bp->start, bp->end, flags);
+        }
+    }
+
+    for (unsigned page = 0; page < SNES_MEM_PAGE_COUNT; page++)
+    {
+        snes_mem_remap_page(snes, page);
+    }
+
+    // cached blocks and idle loops were built from the old map
+    snes_cpu_cache_reset(snes);
+    snes->cpu_idle.key = UINT32_MAX;
+    snes->cpu_idle.armed = false;
+}
+
+static bool breakpoint_match(const struct SNES_BreakpointEntry* bp, uint32_t addr)
+{
+    if (bp->type & SNES_Breakpoint_IO)
+    {
+        if (((addr >> 16) & 0x7F) >= 0x40)
+        {
+            return false;
+        }
+
+        addr &= 0xFFFF;
+    }
+
+    return addr >= bp->start && addr <= bp->end;
+}
+
+static void on_hit(struct SNES_Core* snes, uint8_t id, uint32_t addr, uint8_t value, enum SNES_Breakpoint type)
+{
+    // only the first hit of an instruction is reported
+    if (snes->debug.hit)
+    {
+        return;
+    }
+
+    snes->debug.hit = true;
+    snes->debug.last_hit = (struct SNES_DebugHit)
+    {
+        .addr = addr,
+        .pc = (snes->cpu.PBR << 16) | snes->cpu.PC,
+        .type = type,
+        .value = value,
+        .id = id,
+    };
+
+    snes_scheduler_break(snes);
+}
+
+static bool find_hit(struct SNES_Core* snes, uint32_t addr, uint8_t value, enum SNES_Breakpoint type)
+{
+    for (uint8_t i = 0; i < ARRAY_SIZE(snes->debug.breakpoints); i++)
+    {
+        const struct SNES_BreakpointEntry* bp = &snes->debug.breakpoints[i];
+
+        if ((bp->type & type) && breakpoint_match(bp, addr))
+        {
+            on_hit(snes, i, addr, value, type);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void snes_debug_watch(struct SNES_Core* snes, uint32_t addr, uint8_t value, enum SNES_Breakpoint type)
+{
+    find_hit(snes, addr, value, type);
+}
+
+// the opcode is reported without a bus read, io pages read as 0
+static uint8_t peek_opcode(const struct SNES_Core* snes, uint32_t pc)
+{
+    const uint8_t* page = snes->debug.rmap[pc >> SNES_MEM_PAGE_SHIFT];
+    return page ? page[pc & SNES_MEM_PAGE_MASK] : 0;
+}
+
+bool snes_debug_run(struct SNES_Core* snes)
+{
+    struct SNES_Debug* debug = &snes->debug;
+
+    while (snes->scheduler.cycles < snes->scheduler.next)
+    {
+        const uint32_t pc = (snes->cpu.PBR << 16) | snes->cpu.PC;
+        const uint32_t block_end = (pc & 0xFF0000) | ((pc + DEBUG_BLOCK_BYTES) & 0xFFFF);
+        const uint8_t flags = debug->page_flags[pc >> SNES_MEM_PAGE_SHIFT] | debug->page_flags[block_end >> SNES_MEM_PAGE_SHIFT];
+
+        // no exec breakpoint can be reached by the next block
+        if (!(flags & SNES_Breakpoint_EXEC))
+        {
+            debug->skip_exec = false;
+            snes_cpu_run(snes);
+            continue;
+        }
+
+        if (!debug->skip_exec && find_hit(snes, pc, peek_opcode(snes, pc), SNES_Breakpoint_EXEC))
+        {
+            debug->skip_exec = true;
+            return true;
+        }
+
+        debug->skip_exec = false;
+        snes_cpu_step(snes);
+    }
+
+    return false;
+}
+
+int snes_debug_add_breakpoint(struct SNES_Core* snes, uint8_t type, uint32_t start, uint32_t end)
+{
+    struct SNES_Debug* debug = &snes->debug;
+    const uint32_t mask = (type & SNES_Breakpoint_IO) ? 0xFFFF : 0xFFFFFF;
+
+    if (!type || start > end)
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(debug->breakpoints); i++)
+    {
+        if (!debug->breakpoints[i].type)
+        {
+            debug->breakpoints[i] = (struct SNES_BreakpointEntry)
+            {
+                .start = start & mask,
+                .end = end & mask,
+                .type = type,
+            };
+
+            update_pages(snes);
+            return i;
+        }
+    }
+
+    snes_log_err("[DEBUG] no free breakpoint slots\n");
+    return -1;
+}
+
+void snes_debug_remove_breakpoint(struct SNES_Core* snes, int id)
+{
+    if (id < 0 || id >= SNES_DEBUG_MAX_BREAKPOINTS)
+    {
+        return;
+    }
+
+    snes->debug.breakpoints[id].type = 0;
+    update_pages(snes);
+}
+
+void snes_debug_clear_breakpoints(struct SNES_Core* snes)
+{
+    memset(snes->debug.breakpoints, 0, sizeof(snes->debug.breakpoints));
+    update_pages(snes);
+}
+
+const struct SNES_DebugHit* snes_debug_get_hit(const struct SNES_Core* snes)
+{
+    return snes->debug.hit ? &snes->debug.last_hit : NULL;
+}
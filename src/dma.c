@@ -0,0 +1,363 @@
+#include "internal.h"
+#include "types.h"
+#include <stdint.h>
+#include <string.h>
+
+
+// NOTE: general purpose dma halts the cpu and moves DAS bytes per channel
+// between the a-bus (A1B:A1T) and a b-bus register ($2100 | BBAD).
+// nothing else runs until every channel is done, so each channel is run
+// to completion and the cycles are charged up front.
+// transfers into vram, cgram, oam and wram (which is nearly all of them)
+// are copied in bulk straight into ppu / wram state, the rest go through
+// the b-bus a byte at a time.
+
+// the overhead of a whole transfer is 12-24 cycles: it starts on the next
+// tick of the 8 cycle dma clock, and the cpu resumes on its own cycle.
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesdmatransfers
+enum
+{
+    DMA_CYCLES_START = 12,
+    DMA_CYCLES_CLOCK = 8,
+    DMA_CYCLES_CHANNEL = 8,
+    DMA_CYCLES_BYTE = 8,
+};
+
+const uint8_t snes_dma_pattern[8][4] =
+{
+    [0] = { 0, 0, 0, 0 },
+    [1] = { 0, 1, 0, 1 },
+    [2] = { 0, 0, 0, 0 },
+    [3] = { 0, 0, 1, 1 },
+    [4] = { 0, 1, 2, 3 },
+    [5] = { 0, 1, 0, 1 },
+    [6] = { 0, 0, 0, 0 },
+    [7] = { 0, 0, 1, 1 },
+};
+
+static uint32_t min_u32(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
+}
+
+// same as a VMDATAL then VMDATAH write per word, with the increment on VMDATAH
+static void vram_write_words(struct SNES_Ppu* ppu, const uint8_t* src, bool fixed, uint32_t words)
+{
+    const uint8_t step = ppu->vram_addr_step;
+    uint16_t addr = ppu->vram_addr & 0x7FFF;
+
+    if (step != 1)
+    {
+        for (uint32_t i = 0; i < words; i++, src += fixed ? 0 : 2)
+        {
+            ppu->vram[addr] = src[0] | (src[fixed ? 0 : 1] << 8);
+            snes_ppu_on_vram_write(ppu, addr, 1);
+            addr = (addr + step) & 0x7FFF;
+        }
+
+        ppu->vram_addr = addr;
+        return;
+    }
+
+    // split at the wrap so that the loops below are plain copies / fills
+    while (words)
+    {
+        const uint32_t n = min_u32(words, 0x8000 - addr);
+        uint16_t* dst = ppu->vram + addr;
+
+        if (fixed)
+        {
+            const uint16_t value = src[0] * 0x0101;
+
+            for (uint32_t i = 0; i < n; i++)
+            {
+                dst[i] = value;
+            }
+        }
+        else
+        {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            memcpy(dst, src, n * 2);
+#else
+            for (uint32_t i = 0; i < n; i++)
+            {
+                dst[i] = src[i * 2] | (src[i * 2 + 1] << 8);
+            }
+#endif
+            src += n * 2;
+        }
+
+        snes_ppu_on_vram_write(ppu, addr, n);
+        addr = (addr + n) & 0x7FFF;
+        words -= n;
+    }
+
+    ppu->vram_addr = addr;
+}
+
+// same as a run of VMDATAL (or VMDATAH) writes that each increment
+static void vram_write_bytes(struct SNES_Ppu* ppu, const uint8_t* src, bool fixed, bool high, uint32_t len)
+{
+    const uint8_t step = ppu->vram_addr_step;
+    const uint16_t keep = high ? 0x00FF : 0xFF00;
+    const uint8_t shift = high ? 8 : 0;
+    uint16_t addr = ppu->vram_addr & 0x7FFF;
+
+    for (uint32_t i = 0; i < len; i++, src += !fixed)
+    {
+        ppu->vram[addr] = (ppu->vram[addr] & keep) | (src[0] << shift);
+        snes_ppu_on_vram_write(ppu, addr, 1);
+        addr = (addr + step) & 0x7FFF;
+    }
+
+    ppu->vram_addr = addr;
+}
+
+// same as pairs of CGDATA writes, the flipflop must be clear
+static void cgram_write_words(struct SNES_Ppu* ppu, const uint8_t* src, bool fixed, uint32_t words)
+{
+    for (uint32_t i = 0; i < words; i++, src += fixed ? 0 : 2)
+    {
+        ppu->cgram[ppu->cgram_addr] = src[0] | (src[fixed ? 0 : 1] << 8);
+        snes_ppu_on_cgram_write(ppu, ppu->cgram_addr++);
+    }
+
+    if (words)
+    {
+        ppu->cgram_cached_byte = src[fixed ? 0 : -2];
+    }
+}
+
+// same as pairs of OAMDATA writes, the write addr must be even
+static void oam_write_words(struct SNES_Ppu* ppu, const uint8_t* src, bool fixed, uint32_t words)
+{
+    uint16_t addr = ppu->oam_write_addr;
+
+    while (words)
+    {
+        if (addr >= 0x200)
+        {
+            ppu->oam[0x200 | (addr & 0x1F)] = src[0];
+            ppu->oam[0x200 | ((addr + 1) & 0x1F)] = src[fixed ? 0 : 1];
+            snes_ppu_on_oam_write(ppu, 0x200 | (addr & 0x1F), 1);
+            snes_ppu_on_oam_write(ppu, 0x200 | ((addr + 1) & 0x1F), 1);
+            ppu->oam_latch = src[0];
+            addr = (addr + 2) & 0x3FF;
+            src += fixed ? 0 : 2;
+            words--;
+            continue;
+        }
+
+        // the low table is written a word at a time, which is a plain copy
+        const uint32_t n = min_u32(words, (0x200 - addr) / 2);
+
+        if (fixed)
+        {
+            memset(ppu->oam + addr, src[0], n * 2);
+            ppu->oam_latch = src[0];
+        }
+        else
+        {
+            memcpy(ppu->oam + addr, src, n * 2);
+            ppu->oam_latch = src[n * 2 - 2];
+            src += n * 2;
+        }
+
+        snes_ppu_on_oam_write(ppu, addr, n * 2);
+        addr += n * 2;
+        words -= n;
+    }
+
+    ppu->oam_write_addr = addr;
+}
+
+// same as a run of WMDATA writes
+static void wram_write(struct SNES_Core* snes, const uint8_t* src, bool fixed, uint32_t len)
+{
+    uint32_t addr = snes->mem.WMADD;
+
+    while (len)
+    {
+        const uint32_t n = min_u32(len, sizeof(snes->mem.wram) - addr);
+
+        for (uint32_t line = addr & ~(SNES_CPU_CACHE_LINE_SIZE - 1); line < addr + n; line += SNES_CPU_CACHE_LINE_SIZE)
+        {
+            snes_cpu_cache_on_wram_write(snes, line);
+        }
+
+        for (uint32_t page = addr & ~SNES_MEM_PAGE_MASK; page < addr + n; page += SNES_MEM_PAGE_SIZE)
+        {
+            snes_hdma_on_wram_write(snes, page);
+        }
+
+        if (fixed)
+        {
+            memset(snes->mem.wram + addr, src[0], n);
+        }
+        else
+        {
+            memmove(snes->mem.wram + addr, src, n);
+            src += n;
+        }
+
+        addr = (addr + n) & 0x1FFFF;
+        len -= n;
+    }
+
+    snes->mem.WMADD = addr;
+}
+
+// copies as many bytes as it can from a mapped page in one go.
+// returns the number of bytes moved, 0 if the channel has no fast path.
+static uint32_t transfer_bulk(struct SNES_Core* snes, const struct SNES_DmaChannel* ch, uint8_t index, uint32_t count)
+{
+    struct SNES_Ppu* ppu = &snes->ppu;
+    const uint8_t mode = ch->DMAP & SNES_DMAP_MODE;
+    const bool fixed = ch->DMAP & SNES_DMAP_FIXED;
+    const uint32_t addr = (ch->A1B << 16) | ch->A1T;
+    const uint8_t* page = snes->debug.rmap[addr >> SNES_MEM_PAGE_SHIFT];
+    uint32_t len = count;
+
+    if (!page)
+    {
+        return 0;
+    }
+
+    // A1T wraps within the bank, which is also the end of a page
+    if (!fixed)
+    {
+        len = min_u32(len, SNES_MEM_PAGE_SIZE - (addr & SNES_MEM_PAGE_MASK));
+    }
+
+    const uint8_t* src = page + (addr & SNES_MEM_PAGE_MASK);
+
+    // BBAD, BBAD + 1, ...
+    if (mode == 1 || mode == 5)
+    {
+        if (ch->BBAD != 0x18 || !ppu->vram_addr_increment_mode || (index & 1))
+        {
+            return 0;
+        }
+
+        vram_write_words(ppu, src, fixed, len / 2);
+        return len & ~1u;
+    }
+
+    // every other mode that only ever writes BBAD
+    if (mode != 0 && mode != 2 && mode != 6)
+    {
+        return 0;
+    }
+
+    switch (ch->BBAD)
+    {
+        case 0x04: // OAMDATA
+            if (ppu->oam_write_addr & 1)
+            {
+                return 0;
+            }
+
+            oam_write_words(ppu, src, fixed, len / 2);
+            return len & ~1u;
+
+        case 0x18: // VMDATAL
+        case 0x19: // VMDATAH
+            // otherwise every byte goes to the same word
+            if (ppu->vram_addr_increment_mode != (ch->BBAD == 0x19))
+            {
+                return 0;
+            }
+
+            vram_write_bytes(ppu, src, fixed, ch->BBAD == 0x19, len);
+            return len;
+
+        case 0x22: // CGDATA
+            if (ppu->cgram_flipflop)
+            {
+                return 0;
+            }
+
+            cgram_write_words(ppu, src, fixed, len / 2);
+            return len & ~1u;
+
+        case 0x80: // WMDATA
+            wram_write(snes, src, fixed, len);
+            return len;
+    }
+
+    return 0;
+}
+
+static void transfer_byte(struct SNES_Core* snes, const struct SNES_DmaChannel* ch, uint8_t index)
+{
+    const uint32_t addr = (ch->A1B << 16) | ch->A1T;
+    const uint8_t bbad = ch->BBAD + snes_dma_pattern[ch->DMAP & SNES_DMAP_MODE][index & 3];
+
+    if (ch->DMAP & SNES_DMAP_B_TO_A)
+    {
+        snes_mem_abus_write(snes, addr, snes_mem_bbus_read(snes, bbad));
+    }
+    else
+    {
+        snes_mem_bbus_write(snes, bbad, snes_mem_abus_read(snes, addr));
+    }
+}
+
+static void run_channel(struct SNES_Core* snes, struct SNES_DmaChannel* ch)
+{
+    const bool bulk = !(ch->DMAP & SNES_DMAP_B_TO_A) && ((ch->DMAP & SNES_DMAP_FIXED) || !(ch->DMAP & SNES_DMAP_DECREMENT));
+    uint32_t count = ch->DAS ? ch->DAS : 0x10000;
+    uint8_t index = 0;
+
+    snes->scheduler.cycles += DMA_CYCLES_CHANNEL + count * DMA_CYCLES_BYTE;
+
+    while (count)
+    {
+        uint32_t n = bulk ? transfer_bulk(snes, ch, index, count) : 0;
+
+        if (!n)
+        {
+            transfer_byte(snes, ch, index);
+            n = 1;
+        }
+
+        if (!(ch->DMAP & SNES_DMAP_FIXED))
+        {
+            ch->A1T += (ch->DMAP & SNES_DMAP_DECREMENT) ? -n : n;
+        }
+
+        index += n;
+        count -= n;
+    }
+
+    ch->DAS = 0;
+}
+
+void snes_dma_run(struct SNES_Core* snes)
+{
+    if (!snes->mem.MDMAEN)
+    {
+        return;
+    }
+
+    // the bulk copies write ppu state directly
+    snes_ppu_flush(snes);
+
+    const uint64_t start = snes->scheduler.cycles;
+    snes->scheduler.cycles += DMA_CYCLES_START + (DMA_CYCLES_CLOCK - start % DMA_CYCLES_CLOCK) % DMA_CYCLES_CLOCK;
+
+    // channel 0 goes first
+    for (uint8_t i = 0; i < ARRAY_SIZE(snes->mem.dma); i++)
+    {
+        if (snes->mem.MDMAEN & (1 << i))
+        {
+            run_channel(snes, &snes->mem.dma[i]);
+        }
+    }
+
+    // back in step with the cpu clock, counted in its fastest (6 cycle) steps
+    const uint64_t elapsed = snes->scheduler.cycles - start;
+    snes->scheduler.cycles += (SNES_CYCLES_IO - elapsed % SNES_CYCLES_IO) % SNES_CYCLES_IO;
+
+    snes->mem.MDMAEN = 0;
+}
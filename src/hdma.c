@@ -0,0 +1,317 @@
+#include "internal.h"
+#include "types.h"
+#include <stdint.h>
+#include <string.h>
+
+
+// NOTE: hdma tables are walked once per frame rather than a line at a time.
+// at the start of the frame each enabled channel's table is walked for
+// every visible line, which gives the bytes to write and the channel
+// registers after each line (struct SNES_HdmaWalk). at hblank the writes
+// of the line are then just sent to the b-bus.
+//
+// a walk only depends on the channel setup and the memory it read from,
+// so it's used again the next frame unless either changed. tables in rom
+// never change, wram pages a walk read from are trapped and a write to
+// them (or to the channel registers) walks the rest of the frame again
+// from the live registers.
+//
+// anything else (io, open bus, sram) can't be read ahead of time, the
+// walk stops at the first line that reads it and that line is walked
+// when its hblank comes, one line at a time.
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesdmatransfers
+enum
+{
+    HDMA_CYCLES_START = 18, // per line (and frame) with an active channel
+    HDMA_CYCLES_CHANNEL = 8,
+    HDMA_CYCLES_BYTE = 8,
+    HDMA_CYCLES_INDIRECT = 16, // reading the indirect addr from the table
+};
+
+// bytes written per line by each mode
+static const uint8_t HDMA_LEN[8] = { 1, 2, 2, 4, 4, 4, 2, 4 };
+
+static uint8_t walk_read(struct SNES_Core* snes, struct SNES_HdmaWalk* walk, uint8_t bank, uint16_t addr)
+{
+    const uint32_t full = (bank << 16) | addr;
+    const uint16_t page = full >> SNES_MEM_PAGE_SHIFT;
+    uint32_t offset = 0;
+
+    if (snes_mem_wram_offset(full, &offset))
+    {
+        walk->wram_pages |= 1 << (offset >> SNES_MEM_PAGE_SHIFT);
+    }
+    else if (snes->debug.wmap[page] || !snes->debug.rmap[page])
+    {
+        walk->cacheable = false;
+        walk->live_read = true;
+    }
+
+    return snes_mem_abus_read(snes, full);
+}
+
+// reads the line counter (and indirect addr) of the next table entry
+static void walk_reload(struct SNES_Core* snes, struct SNES_HdmaWalk* walk, const struct SNES_DmaChannel* ch, struct SNES_HdmaLine* state)
+{
+    state->NTRL = walk_read(snes, walk, ch->A1B, state->A2A++);
+    state->cycles += HDMA_CYCLES_CHANNEL;
+
+    if (!state->NTRL)
+    {
+        state->done = true;
+        return;
+    }
+
+    if (ch->DMAP & SNES_DMAP_INDIRECT)
+    {
+        const uint8_t lo = walk_read(snes, walk, ch->A1B, state->A2A++);
+        const uint8_t hi = walk_read(snes, walk, ch->A1B, state->A2A++);
+        state->DAS = (hi << 8) | lo;
+        state->cycles += HDMA_CYCLES_INDIRECT;
+    }
+
+    state->transfer = true;
+}
+
+// the live registers and flags of a channel are set to state
+static void load_state(struct SNES_Core* snes, uint8_t channel, const struct SNES_HdmaLine* state)
+{
+    struct SNES_DmaChannel* ch = &snes->mem.dma[channel];
+    const uint8_t bit = 1 << channel;
+
+    ch->A2A = state->A2A;
+    ch->DAS = state->DAS;
+    ch->NTRL = state->NTRL;
+    snes->hdma.transfer = state->transfer ? snes->hdma.transfer | bit : snes->hdma.transfer & ~bit;
+    snes->hdma.done = state->done ? snes->hdma.done | bit : snes->hdma.done & ~bit;
+}
+
+// only pages a valid walk read from are trapped
+static void update_traps(struct SNES_Core* snes)
+{
+    uint16_t pages = 0;
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(snes->hdma.walks); i++)
+    {
+        if (snes->hdma.walks[i].valid)
+        {
+            pages |= snes->hdma.walks[i].wram_pages;
+        }
+    }
+
+    const uint16_t changed = pages ^ snes->hdma.wram_pages;
+    snes->hdma.wram_pages = pages;
+
+    for (uint8_t page = 0; page < 16; page++)
+    {
+        if (changed & (1 << page))
+        {
+            snes_mem_trap_wram_writes(snes, page, SNES_WramTrap_HDMA, pages & (1 << page));
+        }
+    }
+}
+
+// walks one line, the transfer then the reload if the line count ran out
+static void walk_line(struct SNES_Core* snes, struct SNES_HdmaWalk* walk, const struct SNES_DmaChannel* ch, struct SNES_HdmaLine* state)
+{
+    const uint8_t len = HDMA_LEN[ch->DMAP & SNES_DMAP_MODE];
+
+    state->len = 0;
+    state->cycles = 0;
+
+    if (state->done)
+    {
+        return;
+    }
+
+    state->cycles = HDMA_CYCLES_CHANNEL;
+
+    if (state->transfer)
+    {
+        for (uint8_t i = 0; i < len; i++)
+        {
+            if (ch->DMAP & SNES_DMAP_INDIRECT)
+            {
+                state->data[i] = walk_read(snes, walk, ch->DASB, state->DAS++);
+            }
+            else
+            {
+                state->data[i] = walk_read(snes, walk, ch->A1B, state->A2A++);
+            }
+        }
+
+        state->len = len;
+        state->cycles += len * HDMA_CYCLES_BYTE;
+    }
+
+    state->NTRL--;
+    state->transfer = state->NTRL & 0x80;
+
+    if (!(state->NTRL & 0x7F))
+    {
+        walk_reload(snes, walk, ch, state);
+    }
+}
+
+// walks the table from the live registers, from first_line until the end
+// of the frame or a line that reads io / sram. that line is only kept if
+// it's walked at its own hblank, so never when ahead (at the start of the
+// frame). a walk from line 0 starts from the top of the table.
+static void walk_channel(struct SNES_Core* snes, uint8_t channel, uint8_t first_line, bool ahead)
+{
+    struct SNES_HdmaWalk* walk = &snes->hdma.walks[channel];
+    const struct SNES_DmaChannel* ch = &snes->mem.dma[channel];
+    struct SNES_HdmaLine state =
+    {
+        .A2A = ch->A2A,
+        .DAS = ch->DAS,
+        .NTRL = ch->NTRL,
+        .transfer = snes->hdma.transfer & (1 << channel),
+        .done = snes->hdma.done & (1 << channel),
+    };
+
+    walk->DMAP = ch->DMAP;
+    walk->A1B = ch->A1B;
+    walk->A1T = ch->A1T;
+    walk->DASB = ch->DASB;
+    walk->first_line = first_line;
+    walk->end_line = SNES_HDMA_LINES;
+    walk->cacheable = true;
+    walk->wram_pages = 0;
+
+    if (first_line == 0)
+    {
+        state = (struct SNES_HdmaLine){ .A2A = ch->A1T };
+        walk_reload(snes, walk, ch, &state);
+        walk->init = state;
+        load_state(snes, channel, &state);
+    }
+
+    for (uint16_t line = first_line; line < SNES_HDMA_LINES; line++)
+    {
+        walk->live_read = false;
+        walk_line(snes, walk, ch, &state);
+
+        if (walk->live_read && (ahead || line != first_line))
+        {
+            walk->end_line = line;
+            break;
+        }
+
+        walk->lines[line] = state;
+    }
+
+    walk->valid = true;
+    snes->hdma.dirty &= ~(1 << channel);
+    update_traps(snes);
+}
+
+static bool walk_reusable(const struct SNES_HdmaWalk* walk, const struct SNES_DmaChannel* ch)
+{
+    return walk->valid && walk->cacheable && walk->first_line == 0 &&
+        walk->DMAP == ch->DMAP && walk->A1B == ch->A1B && walk->A1T == ch->A1T && walk->DASB == ch->DASB;
+}
+
+void snes_hdma_start_frame(struct SNES_Core* snes)
+{
+    uint64_t cycles = HDMA_CYCLES_START;
+
+    snes->hdma.transfer = 0;
+    snes->hdma.done = 0;
+    snes->hdma.dirty = 0;
+
+    if (!snes->mem.HDMAEN)
+    {
+        return;
+    }
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(snes->hdma.walks); i++)
+    {
+        struct SNES_HdmaWalk* walk = &snes->hdma.walks[i];
+
+        if (!(snes->mem.HDMAEN & (1 << i)))
+        {
+            continue;
+        }
+
+        if (walk_reusable(walk, &snes->mem.dma[i]))
+        {
+            load_state(snes, i, &walk->init);
+        }
+        else
+        {
+            walk_channel(snes, i, 0, true);
+        }
+
+        cycles += walk->init.cycles;
+    }
+
+    snes->scheduler.cycles += cycles;
+}
+
+void snes_hdma_run_line(struct SNES_Core* snes)
+{
+    const uint8_t line = snes->ppu.vcounter;
+    uint64_t cycles = HDMA_CYCLES_START;
+
+    if (!(snes->mem.HDMAEN & ~snes->hdma.done))
+    {
+        return;
+    }
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(snes->hdma.walks); i++)
+    {
+        const struct SNES_HdmaWalk* walk = &snes->hdma.walks[i];
+        const struct SNES_DmaChannel* ch = &snes->mem.dma[i];
+
+        if (!(snes->mem.HDMAEN & ~snes->hdma.done & (1 << i)))
+        {
+            continue;
+        }
+
+        if ((snes->hdma.dirty & (1 << i)) || !walk->valid || line < walk->first_line || line >= walk->end_line)
+        {
+            walk_channel(snes, i, line, false);
+        }
+
+        const struct SNES_HdmaLine* state = &walk->lines[line];
+        const uint8_t* pattern = snes_dma_pattern[ch->DMAP & SNES_DMAP_MODE];
+
+        for (uint8_t j = 0; j < state->len; j++)
+        {
+            snes_mem_bbus_write(snes, ch->BBAD + pattern[j], state->data[j]);
+        }
+
+        load_state(snes, i, state);
+        cycles += state->cycles;
+    }
+
+    snes->scheduler.cycles += cycles;
+}
+
+void snes_hdma_on_channel_write(struct SNES_Core* snes, uint8_t channel)
+{
+    snes->hdma.dirty |= 1 << channel;
+}
+
+void snes_hdma_on_wram_write(struct SNES_Core* snes, uint32_t offset)
+{
+    const uint16_t page = 1 << (offset >> SNES_MEM_PAGE_SHIFT);
+
+    if (!(snes->hdma.wram_pages & page))
+    {
+        return;
+    }
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(snes->hdma.walks); i++)
+    {
+        if (snes->hdma.walks[i].wram_pages & page)
+        {
+            snes->hdma.walks[i].valid = false;
+            snes->hdma.dirty |= 1 << i;
+        }
+    }
+
+    update_traps(snes);
+}
@@ -13,6 +13,55 @@ extern "C" {
 
 #define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
 
+// build time option (see SNES_CPU_DISPATCH_TABLES in CMakeLists.txt)
+#ifndef SNES_CPU_DISPATCH_TABLES
+    #define SNES_CPU_DISPATCH_TABLES 0
+#endif
+
+// build time option (see SNES_CPU_CACHE in CMakeLists.txt)
+#ifndef SNES_CPU_CACHE
+    #define SNES_CPU_CACHE 0
+#endif
+
+// build time option (see SNES_CPU_IDLE_SKIP in CMakeLists.txt)
+#ifndef SNES_CPU_IDLE_SKIP
+    #define SNES_CPU_IDLE_SKIP 0
+#endif
+
+// build time option (see SNES_TRACE in CMakeLists.txt)
+#ifndef SNES_TRACE
+    #define SNES_TRACE 0
+#endif
+
+// build time option (see SNES_PROFILE in CMakeLists.txt)
+#ifndef SNES_PROFILE
+    #define SNES_PROFILE 0
+#endif
+
+// build time options (see SNES_JIT in CMakeLists.txt)
+#ifndef SNES_JIT
+    #define SNES_JIT 0
+#endif
+
+#ifndef SNES_JIT_LOCKSTEP
+    #define SNES_JIT_LOCKSTEP 0
+#endif
+
+// build time option (see SNES_PPU_SIMD in CMakeLists.txt)
+#ifndef SNES_PPU_SIMD
+    #define SNES_PPU_SIMD 0
+#endif
+
+// build time option (see SNES_PPU_THREAD in CMakeLists.txt)
+#ifndef SNES_PPU_THREAD
+    #define SNES_PPU_THREAD 0
+#endif
+
+// build time option (see SNES_PPU_BANDS in CMakeLists.txt)
+#ifndef SNES_PPU_BANDS
+    #define SNES_PPU_BANDS 0
+#endif
+
 #if SNES_DEBUG
     #include <stdio.h>
     #include <assert.h>
@@ -32,13 +81,131 @@ uint32_t snes_cpu_read24(struct SNES_Core* snes, uint32_t addr);
 void snes_cpu_write8(struct SNES_Core* snes, uint32_t addr, uint8_t value);
 void snes_cpu_write16(struct SNES_Core* snes, uint32_t addr, uint16_t value);
 
+// returns true if addr maps to wram, offset is set to the wram offset
+bool snes_mem_wram_offset(uint32_t addr, uint32_t* offset);
+// makes all writes to a wram page (8KiB) take the slow path, the page
+// stays trapped while any reason (enum SNES_WramTrap) is set
+void snes_mem_trap_wram_writes(struct SNES_Core* snes, uint8_t page, uint8_t reason, bool trap);
+// re-applies debug.page_flags to a page of rmap / wmap
+void snes_mem_remap_page(struct SNES_Core* snes, uint16_t page);
+
+// accesses made by dma, see snes_mem_abus_read() in mem.c
+uint8_t snes_mem_abus_read(struct SNES_Core* snes, uint32_t addr);
+void snes_mem_abus_write(struct SNES_Core* snes, uint32_t addr, uint8_t value);
+// addr is the low byte of a $21xx register
+uint8_t snes_mem_bbus_read(struct SNES_Core* snes, uint8_t addr);
+void snes_mem_bbus_write(struct SNES_Core* snes, uint8_t addr, uint8_t value);
+
+// b-bus offset from BBAD of each byte per mode, every mode repeats within 4 bytes
+extern const uint8_t snes_dma_pattern[8][4];
+// runs every channel enabled in MDMAEN
+void snes_dma_run(struct SNES_Core* snes);
+
+// walks the table of each channel enabled in HDMAEN at the start of the frame
+void snes_hdma_start_frame(struct SNES_Core* snes);
+// applies the walked writes of the current line, run at the start of hblank
+void snes_hdma_run_line(struct SNES_Core* snes);
+// the channel registers changed, the rest of the frame is walked again
+void snes_hdma_on_channel_write(struct SNES_Core* snes, uint8_t channel);
+void snes_hdma_on_wram_write(struct SNES_Core* snes, uint32_t offset);
+
+// checks an access to a watched page against the watchpoints
+void snes_debug_watch(struct SNES_Core* snes, uint32_t addr, uint8_t value, enum SNES_Breakpoint type);
+// runs the cpu until the next event, returns true if an exec breakpoint is hit
+bool snes_debug_run(struct SNES_Core* snes);
+
+void snes_cpu_cache_reset(struct SNES_Core* snes);
+void snes_cpu_cache_invalidate_wram(struct SNES_Core* snes);
+void snes_cpu_cache_on_wram_write(struct SNES_Core* snes, uint32_t offset);
+
+// events are added with an absolute master cycle
+void snes_scheduler_add(struct SNES_Core* snes, enum SNES_Event event, uint64_t when);
+void snes_scheduler_remove(struct SNES_Core* snes, enum SNES_Event event);
+// runs every event that is due
+void snes_scheduler_fire(struct SNES_Core* snes);
+// stops the cpu after the current instruction, even mid block
+void snes_scheduler_break(struct SNES_Core* snes);
+void snes_scheduler_update_irq(struct SNES_Core* snes);
+
+// latches an nmi / sets the irq line, both are taken by the interrupt event
+void snes_cpu_nmi(struct SNES_Core* snes);
+void snes_cpu_irq(struct SNES_Core* snes, bool line);
+void snes_cpu_poll_interrupts(struct SNES_Core* snes);
+
+bool snes_scheduler_init(struct SNES_Core* snes);
+bool snes_mem_init(struct SNES_Core* snes);
 bool snes_cpu_init(struct SNES_Core* snes);
 bool snes_ppu_init(struct SNES_Core* snes);
 bool snes_apu_init(struct SNES_Core* snes);
+// runs the apu up to the cpu's master clock, called before the cpu talks
+// to it (APUIO) and on the apu sync event.
+void snes_apu_catch_up(struct SNES_Core* snes);
 
 void snes_cpu_run(struct SNES_Core* snes);
-// void snes_ppu_run(struct SNES_Core* snes);
-// void snes_apu_run(struct SNES_Core* snes);
+// runs a single instruction with the plain interpreter
+void snes_cpu_step(struct SNES_Core* snes);
+
+#if SNES_TRACE
+// copies the record into the ring, blocks only if the ring is full
+void snes_trace_push(struct SNES_Trace* trace, const struct SNES_TraceRecord* record);
+#endif
+
+#if SNES_JIT
+bool snes_jit_init(struct SNES_Core* snes);
+void snes_jit_quit(struct SNES_Core* snes);
+void snes_jit_flush(struct SNES_Core* snes);
+bool snes_jit_compile(struct SNES_Core* snes, struct SNES_CpuBlock* block);
+void snes_jit_lockstep(struct SNES_Core* snes);
+void snes_jit_lockstep_fire(struct SNES_Core* snes);
+#endif
+// renders every line that is done (reached hblank) and hasn't been
+// rendered yet. called before anything that changes or reads ppu state.
+void snes_ppu_catch_up(struct SNES_Core* snes);
+// same as snes_ppu_catch_up(), but lines caught up by the render bands
+// are rendered too. called before ppu memory (vram / cgram / oam) is
+// written.
+void snes_ppu_flush(struct SNES_Core* snes);
+void snes_ppu_start_frame(struct SNES_Core* snes);
+// called after words [addr, addr + words) are written, marks their cached
+// tiles dirty (and queues them for the render thread). must not wrap.
+void snes_ppu_on_vram_write(struct SNES_Ppu* ppu, uint16_t addr, uint32_t words);
+// converts the cgram entry into the palette cache
+void snes_ppu_on_cgram_write(struct SNES_Ppu* ppu, uint8_t index);
+void snes_ppu_update_palette(struct SNES_Ppu* ppu);
+// called after oam bytes [addr, addr + bytes) are written, moves the
+// sprites they belong to between lines. must not wrap.
+void snes_ppu_on_oam_write(struct SNES_Ppu* ppu, uint16_t addr, uint16_t bytes);
+void snes_ppu_set_pixel_format(struct SNES_Ppu* ppu, enum SNES_PixelFormat format);
+// the rest of the frame is rendered before it's handed out
+void snes_ppu_end_frame(struct SNES_Core* snes);
+// renders line from regs and the ppu's memory, with palette converted to
+// the line's brightness first. see ppu_thread.c for the thread that calls
+// this with its own copy of the ppu and ppu_bands.c for the workers that
+// call it at once, each with its own palette.
+void snes_ppu_render_line(struct SNES_Ppu* ppu, const struct SNES_PpuRegs* regs, struct SNES_PpuPalette* palette, uint16_t line);
+// decodes the dirty tiles that count lines rendered from regs could use,
+// after which rendering them only reads the ppu
+void snes_ppu_prepare_lines(struct SNES_Ppu* ppu, const struct SNES_PpuRegs* regs, uint16_t count);
+
+#if SNES_PPU_THREAD
+// queues what's changed since the last catch up and the lines before end
+void snes_ppu_thread_push_lines(struct SNES_Ppu* ppu, uint16_t end);
+void snes_ppu_thread_push_vram(struct SNES_Ppu* ppu, uint16_t addr, uint32_t words);
+void snes_ppu_thread_push_cgram(struct SNES_Ppu* ppu, uint8_t index);
+void snes_ppu_thread_push_oam(struct SNES_Ppu* ppu, uint16_t addr, uint16_t bytes);
+void snes_ppu_thread_push_format(struct SNES_Ppu* ppu);
+void snes_ppu_thread_start_frame(struct SNES_Ppu* ppu);
+// hands out the frame before the one that just ended
+void snes_ppu_thread_end_frame(struct SNES_Ppu* ppu);
+#endif
+
+#if SNES_PPU_BANDS
+// keeps the registers of the lines before end, to render later
+void snes_ppu_bands_push_lines(struct SNES_Ppu* ppu, uint16_t end);
+// renders the kept lines across the workers
+void snes_ppu_bands_flush(struct SNES_Ppu* ppu);
+void snes_ppu_bands_start_frame(struct SNES_Ppu* ppu);
+#endif
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,643 @@
+// x86-64 jit for the 65816, built on top of the cached interpreter.
+// hot blocks are translated into a single native function that calls the
+// same exec handlers the cached interpreter uses for most instructions.
+// simple register only instructions are emitted inline, and plain loads /
+// stores (LDA, STA, LDX...) look up the page table themselves and only
+// call the handler when the page is io (or watched / trapped).
+//
+// only built with SNES_JIT (x86-64 linux), see src/CMakeLists.txt
+#include "internal.h"
+#include "types.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+enum
+{
+    JIT_CODE_SIZE = 1024 * 1024 * 4,
+    // worst case size of a single translated op
+    JIT_MAX_OP_SIZE = 320,
+};
+
+struct SNES_Jit
+{
+    uint8_t* code;
+    size_t used;
+
+    // only used in lockstep mode, runs the plain interpreter
+    struct SNES_Core* shadow;
+};
+
+// offsets of the fields the native code touches, rbx holds snes
+#define OFF(member) ((int32_t)offsetof(struct SNES_Core, member))
+
+struct Emitter
+{
+    uint8_t* ptr;
+};
+
+static void emit8(struct Emitter* e, uint8_t v)
+{
+    *e->ptr++ = v;
+}
+
+static void emit16(struct Emitter* e, uint16_t v)
+{
+    memcpy(e->ptr, &v, sizeof(v));
+    e->ptr += sizeof(v);
+}
+
+static void emit32(struct Emitter* e, uint32_t v)
+{
+    memcpy(e->ptr, &v, sizeof(v));
+    e->ptr += sizeof(v);
+}
+
+static void emit64(struct Emitter* e, uint64_t v)
+{
+    memcpy(e->ptr, &v, sizeof(v));
+    e->ptr += sizeof(v);
+}
+
+// mov byte [rbx + off], imm8
+static void emit_store8(struct Emitter* e, int32_t off, uint8_t v)
+{
+    emit8(e, 0xC6); emit8(e, 0x83); emit32(e, off); emit8(e, v);
+}
+
+// mov word [rbx + off], imm16
+static void emit_store16(struct Emitter* e, int32_t off, uint16_t v)
+{
+    emit8(e, 0x66); emit8(e, 0xC7); emit8(e, 0x83); emit32(e, off); emit16(e, v);
+}
+
+// mov dword [rbx + off], imm32
+static void emit_store32(struct Emitter* e, int32_t off, uint32_t v)
+{
+    emit8(e, 0xC7); emit8(e, 0x83); emit32(e, off); emit32(e, v);
+}
+
+// inc qword [rbx + ticks]
+static void emit_tick(struct Emitter* e)
+{
+    emit8(e, 0x48); emit8(e, 0xFF); emit8(e, 0x83); emit32(e, OFF(ticks));
+}
+
+// add qword [rbx + cycles], imm32
+static void emit_cycles(struct Emitter* e, uint32_t cycles)
+{
+    emit8(e, 0x48); emit8(e, 0x81); emit8(e, 0x83); emit32(e, OFF(scheduler.cycles)); emit32(e, cycles);
+}
+
+// jcc rel32 with the target filled in later by patch_rel32()
+static uint8_t* emit_jcc(struct Emitter* e, uint8_t cc)
+{
+    emit8(e, 0x0F); emit8(e, cc);
+    uint8_t* rel = e->ptr;
+    emit32(e, 0);
+    return rel;
+}
+
+static void patch_rel32(uint8_t* rel, const uint8_t* target)
+{
+    const int32_t value = (int32_t)(target - (rel + 4));
+    memcpy(rel, &value, sizeof(value));
+}
+
+// jne / jae rel32 to the exit path, patched once the block is done
+static void emit_exit(struct Emitter* e, uint8_t cc, uint8_t** exits, uint8_t* exit_count)
+{
+    exits[(*exit_count)++] = emit_jcc(e, cc);
+}
+
+// and / or byte [rbx + P], imm8
+static void emit_flag(struct Emitter* e, uint8_t flag, bool set)
+{
+    emit8(e, 0x80); emit8(e, set ? 0x8B : 0xA3); emit32(e, OFF(cpu.P)); emit8(e, set ? flag : (uint8_t)~flag);
+}
+
+// movzx eax, [rbx + off], imul eax, eax, imm32, mov [rbx + nz], eax
+// same as set_nz_8() / set_nz_16() in cpu.c
+static void emit_set_nz(struct Emitter* e, int32_t off, bool x8)
+{
+    emit8(e, 0x0F); emit8(e, x8 ? 0xB6 : 0xB7); emit8(e, 0x83); emit32(e, off);
+    emit8(e, 0x69); emit8(e, 0xC0); emit32(e, x8 ? 0x01000001 : 0x00010001);
+    emit8(e, 0x89); emit8(e, 0x83); emit32(e, OFF(cpu.nz));
+}
+
+// inc / dec of X or Y, the high byte is always 0 when x8 so the
+// 8-bit form gives the same result as the interpreter.
+static void emit_inc_dec(struct Emitter* e, int32_t off, bool x8, bool dec)
+{
+    if (!x8)
+    {
+        emit8(e, 0x66);
+    }
+
+    emit8(e, x8 ? 0xFE : 0xFF);
+    emit8(e, dec ? 0x8B : 0x83);
+    emit32(e, off);
+    emit_set_nz(e, off, x8);
+}
+
+// returns true if the op was emitted inline
+static bool emit_inline(struct Emitter* e, const struct SNES_CpuOp* op, bool x8)
+{
+    switch (op->opcode)
+    {
+        case 0x18: emit_flag(e, SNES_P_C, false); return true; // CLC
+        case 0x38: emit_flag(e, SNES_P_C, true); return true; // SEC
+        case 0x78: emit_flag(e, SNES_P_I, true); return true; // SEI
+        case 0xB8: emit_flag(e, SNES_P_V, false); return true; // CLV
+        case 0xD8: emit_flag(e, SNES_P_D, false); return true; // CLD
+        case 0xF8: emit_flag(e, SNES_P_D, true); return true; // SED
+        case 0xE8: emit_inc_dec(e, OFF(cpu.X), x8, false); return true; // INX
+        case 0xC8: emit_inc_dec(e, OFF(cpu.Y), x8, false); return true; // INY
+        case 0xCA: emit_inc_dec(e, OFF(cpu.X), x8, true); return true; // DEX
+        case 0x88: emit_inc_dec(e, OFF(cpu.Y), x8, true); return true; // DEY
+    }
+
+    return false;
+}
+
+static void emit_call(struct Emitter* e, const struct SNES_CpuOp* op)
+{
+    emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xDF); // mov rdi, rbx
+    emit8(e, 0xBE); emit32(e, op->raw); // mov esi, raw
+    emit8(e, 0x48); emit8(e, 0xB8); emit64(e, (uint64_t)(uintptr_t)op->exec); // mov rax, exec
+    emit8(e, 0xFF); emit8(e, 0xD0); // call rax
+}
+
+enum MemMode
+{
+    MemMode_ABS, // DBR:raw
+    MemMode_LONG, // raw
+    MemMode_ABS_X, // DBR:raw+X
+    MemMode_ABS_Y, // DBR:raw+Y
+};
+
+struct MemOp
+{
+    uint8_t mode; // enum MemMode
+    bool store;
+    bool wide; // 16-bit
+    bool zero; // STZ, stores 0 rather than a reg
+    int32_t reg; // offset of A, X or Y
+};
+
+// the loads / stores that are emitted natively, everything else is a call.
+// the widths and cycles have to match the handlers in cpu.c exactly.
+static bool mem_op(uint8_t opcode, bool m8, bool x8, struct MemOp* out)
+{
+    #define MEM(mode_, store_, wide_, zero_, reg_) \
+        *out = (struct MemOp){ .mode = mode_, .store = store_, .wide = wide_, .zero = zero_, .reg = reg_ }; return true;
+
+    switch (opcode)
+    {
+        case 0xAD: MEM(MemMode_ABS, false, !m8, false, OFF(cpu.A)); // LDA abs
+        case 0xAF: MEM(MemMode_LONG, false, !m8, false, OFF(cpu.A)); // LDA long
+        case 0xBD: MEM(MemMode_ABS_X, false, !m8, false, OFF(cpu.A)); // LDA abs,X
+        case 0xB9: MEM(MemMode_ABS_Y, false, !m8, false, OFF(cpu.A)); // LDA abs,Y
+        case 0xAE: MEM(MemMode_ABS, false, !x8, false, OFF(cpu.X)); // LDX abs
+        case 0xAC: MEM(MemMode_ABS, false, !x8, false, OFF(cpu.Y)); // LDY abs
+        case 0x8D: MEM(MemMode_ABS, true, !m8, false, OFF(cpu.A)); // STA abs
+        case 0x8F: MEM(MemMode_LONG, true, !m8, false, OFF(cpu.A)); // STA long
+        case 0x9D: MEM(MemMode_ABS_X, true, !m8, false, OFF(cpu.A)); // STA abs,X
+        case 0x99: MEM(MemMode_ABS_Y, true, !m8, false, OFF(cpu.A)); // STA abs,Y
+        case 0x8E: MEM(MemMode_ABS, true, !x8, false, OFF(cpu.X)); // STX abs
+        case 0x8C: MEM(MemMode_ABS, true, !x8, false, OFF(cpu.Y)); // STY abs
+        case 0x9C: MEM(MemMode_ABS, true, false, true, 0); // STZ abs, always 8-bit, see STZ()
+    }
+
+    #undef MEM
+
+    return false;
+}
+
+// true if the access may hit io, those are always a call.
+// for DBR relative modes only the bank offset is known, $2000-$5FFF is
+// io in every bank that code normally points DBR at.
+static bool mem_op_maybe_io(const struct SNES_Core* snes, const struct SNES_CpuOp* op, const struct MemOp* mem)
+{
+    if (mem->mode == MemMode_LONG)
+    {
+        const uint32_t addr = op->raw & 0x00FFFFFF;
+        return !snes->debug.rmap[addr >> SNES_MEM_PAGE_SHIFT];
+    }
+
+    const uint16_t offset = op->raw;
+    return offset >= 0x2000 && offset < 0x6000;
+}
+
+// emits a load / store that reads the page table at runtime, the same as
+// snes_cpu_read8() etc. if the page isn't mapped, or a 16-bit access
+// crosses the end of it, the handler is called instead. nothing is
+// changed before that check, so the handler runs the op from the start.
+static void emit_mem_op(struct Emitter* e, const struct SNES_CpuOp* op, const struct MemOp* mem, bool x8)
+{
+    const uint16_t offset = op->raw;
+    uint32_t index_cycles = 0;
+    bool index_check = false;
+
+    // address in eax, the index page cross (if it's checked) in edi
+    switch (mem->mode)
+    {
+        case MemMode_LONG:
+            emit8(e, 0xB8); emit32(e, op->raw & 0x00FFFFFF); // mov eax, raw
+            break;
+
+        case MemMode_ABS:
+            emit8(e, 0x0F); emit8(e, 0xB6); emit8(e, 0x83); emit32(e, OFF(cpu.DBR)); // movzx eax, byte [DBR]
+            emit8(e, 0xC1); emit8(e, 0xE0); emit8(e, 16); // shl eax, 16
+            emit8(e, 0x0D); emit32(e, offset); // or eax, raw
+            break;
+
+        case MemMode_ABS_X:
+        case MemMode_ABS_Y:
+            emit8(e, 0x0F); emit8(e, 0xB7); emit8(e, 0x8B); emit32(e, mem->mode == MemMode_ABS_X ? OFF(cpu.X) : OFF(cpu.Y)); // movzx ecx, word [X / Y]
+            emit8(e, 0x81); emit8(e, 0xC1); emit32(e, offset); // add ecx, raw
+
+            // see index_penalty() and the *_write modes in cpu.c
+            if (mem->store || !x8)
+            {
+                index_cycles = SNES_CYCLES_IO;
+            }
+            else
+            {
+                emit8(e, 0x89); emit8(e, 0xCF); // mov edi, ecx
+                emit8(e, 0x81); emit8(e, 0xF7); emit32(e, offset); // xor edi, raw
+                emit8(e, 0x81); emit8(e, 0xE7); emit32(e, 0xFF00); // and edi, 0xFF00
+                index_check = true;
+            }
+
+            emit8(e, 0x0F); emit8(e, 0xB7); emit8(e, 0xC9); // movzx ecx, cx
+            emit8(e, 0x0F); emit8(e, 0xB6); emit8(e, 0x83); emit32(e, OFF(cpu.DBR)); // movzx eax, byte [DBR]
+            emit8(e, 0xC1); emit8(e, 0xE0); emit8(e, 16); // shl eax, 16
+            emit8(e, 0x09); emit8(e, 0xC8); // or eax, ecx
+            break;
+    }
+
+    // page in edx, host page in rcx, offset in the page in esi
+    emit8(e, 0x89); emit8(e, 0xC2); // mov edx, eax
+    emit8(e, 0xC1); emit8(e, 0xEA); emit8(e, SNES_MEM_PAGE_SHIFT); // shr edx, shift
+    emit8(e, 0x48); emit8(e, 0x8B); emit8(e, 0x8C); emit8(e, 0xD3); emit32(e, mem->store ? OFF(mem.wmap) : OFF(mem.rmap)); // mov rcx, [map + rdx * 8]
+    emit8(e, 0x48); emit8(e, 0x85); emit8(e, 0xC9); // test rcx, rcx
+    uint8_t* slow = emit_jcc(e, 0x84); // jz slow
+    uint8_t* slow_edge = NULL;
+
+    emit8(e, 0x89); emit8(e, 0xC6); // mov esi, eax
+    emit8(e, 0x81); emit8(e, 0xE6); emit32(e, SNES_MEM_PAGE_MASK); // and esi, mask
+
+    if (mem->wide)
+    {
+        emit8(e, 0x81); emit8(e, 0xFE); emit32(e, SNES_MEM_PAGE_MASK); // cmp esi, mask
+        slow_edge = emit_jcc(e, 0x84); // je slow
+    }
+
+    emit8(e, 0x89); emit8(e, 0x83); emit32(e, OFF(cpu.oprand)); // mov [oprand], eax
+
+    if (index_cycles)
+    {
+        emit_cycles(e, index_cycles);
+    }
+
+    if (index_check)
+    {
+        emit8(e, 0x85); emit8(e, 0xFF); // test edi, edi
+        emit8(e, 0x74); emit8(e, 11); // jz over the add below
+        emit_cycles(e, SNES_CYCLES_IO);
+    }
+
+    emit8(e, 0x0F); emit8(e, 0xB6); emit8(e, 0x94); emit8(e, 0x13); emit32(e, OFF(mem.access_cycles)); // movzx edx, byte [access_cycles + rdx]
+
+    if (mem->wide)
+    {
+        emit8(e, 0x01); emit8(e, 0xD2); // add edx, edx
+    }
+
+    emit8(e, 0x48); emit8(e, 0x01); emit8(e, 0x93); emit32(e, OFF(scheduler.cycles)); // add [cycles], rdx
+
+    if (mem->store)
+    {
+        if (mem->zero)
+        {
+            emit8(e, 0x31); emit8(e, 0xC0); // xor eax, eax
+        }
+        else
+        {
+            emit8(e, 0x0F); emit8(e, mem->wide ? 0xB7 : 0xB6); emit8(e, 0x83); emit32(e, mem->reg); // movzx eax, [reg]
+        }
+
+        if (mem->wide)
+        {
+            emit8(e, 0x66);
+        }
+
+        emit8(e, mem->wide ? 0x89 : 0x88); emit8(e, 0x04); emit8(e, 0x31); // mov [rcx + rsi], al / ax
+    }
+    else
+    {
+        emit8(e, 0x0F); emit8(e, mem->wide ? 0xB7 : 0xB6); emit8(e, 0x04); emit8(e, 0x31); // movzx eax, [rcx + rsi]
+
+        // an 8-bit load into X / Y clears the high byte, A keeps it
+        if (mem->wide || mem->reg != OFF(cpu.A))
+        {
+            emit8(e, 0x66);
+            emit8(e, 0x89);
+        }
+        else
+        {
+            emit8(e, 0x88);
+        }
+
+        emit8(e, 0x83); emit32(e, mem->reg); // mov [reg], al / ax
+    }
+
+    // the last byte accessed is left on the bus
+    emit8(e, 0x88); emit8(e, mem->wide ? 0xA3 : 0x83); emit32(e, OFF(mem.open_bus)); // mov [open_bus], al / ah
+
+    if (!mem->store)
+    {
+        emit8(e, 0x69); emit8(e, 0xC0); emit32(e, mem->wide ? 0x00010001 : 0x01000001); // imul eax, eax, nz
+        emit8(e, 0x89); emit8(e, 0x83); emit32(e, OFF(cpu.nz)); // mov [nz], eax
+    }
+
+    emit8(e, 0xE9); // jmp done
+    uint8_t* done = e->ptr;
+    emit32(e, 0);
+
+    patch_rel32(slow, e->ptr);
+
+    if (slow_edge)
+    {
+        patch_rel32(slow_edge, e->ptr);
+    }
+
+    emit_call(e, op);
+    patch_rel32(done, e->ptr);
+}
+
+// the code buffer is never writable and executable at the same time,
+// the pages an op is written to are made writable for the compile only.
+static bool protect(uint8_t* start, size_t size, int prot)
+{
+    const uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+    const uintptr_t begin = (uintptr_t)start & ~(page_size - 1);
+    const uintptr_t end = ((uintptr_t)start + size + page_size - 1) & ~(page_size - 1);
+
+    return mprotect((void*)begin, end - begin, prot) == 0;
+}
+
+bool snes_jit_init(struct SNES_Core* snes)
+{
+    snes_jit_quit(snes);
+
+    struct SNES_Jit* jit = calloc(1, sizeof(struct SNES_Jit));
+
+    if (!jit)
+    {
+        return false;
+    }
+
+    jit->code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (jit->code == MAP_FAILED)
+    {
+        snes_log_err("[JIT] failed to map code buffer\n");
+        free(jit);
+        return false;
+    }
+
+#if SNES_JIT_LOCKSTEP
+    jit->shadow = malloc(sizeof(struct SNES_Core));
+
+    if (!jit->shadow)
+    {
+        munmap(jit->code, JIT_CODE_SIZE);
+        free(jit);
+        return false;
+    }
+
+    // the shadow is a copy of the freshly loaded core, only the
+    // memory map has to be rebuilt as it points into the wram.
+    memcpy(jit->shadow, snes, sizeof(struct SNES_Core));
+    jit->shadow->jit = NULL;
+    jit->shadow->trace = NULL;
+    jit->shadow->profile = NULL;
+    snes_mem_init(jit->shadow);
+#endif
+
+    snes->jit = jit;
+    return true;
+}
+
+void snes_jit_quit(struct SNES_Core* snes)
+{
+    if (!snes->jit)
+    {
+        return;
+    }
+
+    munmap(snes->jit->code, JIT_CODE_SIZE);
+    free(snes->jit->shadow);
+    free(snes->jit);
+    snes->jit = NULL;
+}
+
+void snes_jit_flush(struct SNES_Core* snes)
+{
+    if (!snes->jit)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(snes->cpu_cache.blocks); i++)
+    {
+        snes->cpu_cache.blocks[i].native = NULL;
+    }
+
+    snes->jit->used = 0;
+}
+
+bool snes_jit_compile(struct SNES_Core* snes, struct SNES_CpuBlock* block)
+{
+    struct SNES_Jit* jit = snes->jit;
+
+    if (!jit)
+    {
+        return false;
+    }
+
+    // prologue + ops + exit path + epilogue
+    const size_t max_size = 16 + (block->count * JIT_MAX_OP_SIZE) + 16;
+
+    if (jit->used + max_size > JIT_CODE_SIZE)
+    {
+        snes_jit_flush(snes);
+    }
+
+    const uint8_t width = block->key >> 24;
+    const bool m8 = width != SNES_CpuWidth_M16_X8 && width != SNES_CpuWidth_M16_X16;
+    const bool x8 = width != SNES_CpuWidth_M8_X16 && width != SNES_CpuWidth_M16_X16;
+    uint8_t* start = jit->code + jit->used;
+    struct Emitter e = { start };
+
+    if (!protect(start, max_size, PROT_READ | PROT_WRITE))
+    {
+        snes_log_err("[JIT] failed to make the code buffer writable\n");
+        return false;
+    }
+    uint8_t* exits[SNES_CPU_BLOCK_MAX_OPS * 2];
+    uint8_t exit_count = 0;
+
+    emit8(&e, 0x53); // push rbx
+    emit8(&e, 0x48); emit8(&e, 0x89); emit8(&e, 0xFB); // mov rbx, rdi
+
+    for (uint8_t i = 0; i < block->count; i++)
+    {
+        const struct SNES_CpuOp* op = &block->ops[i];
+        const bool last = i + 1 == block->count;
+        struct MemOp mem;
+
+        emit_store8(&e, OFF(mem.open_bus), op->open_bus);
+        emit_store8(&e, OFF(opcode), op->opcode);
+
+        // the block can be left after any op, so PC is always stored
+        emit_store16(&e, OFF(cpu.PC), op->pc_next);
+        emit_store32(&e, OFF(cpu.oprand), op->oprand);
+
+        if (emit_inline(&e, op, x8))
+        {
+            // inline ops are all implied, see implied() in cpu.c
+            emit_cycles(&e, op->cycles + SNES_CYCLES_IO);
+            emit_tick(&e);
+        }
+        else
+        {
+            emit_cycles(&e, op->cycles);
+
+            if (mem_op(op->opcode, m8, x8, &mem) && !mem_op_maybe_io(snes, op, &mem))
+            {
+                emit_mem_op(&e, op, &mem, x8);
+            }
+            else
+            {
+                emit_call(&e, op);
+            }
+
+            emit_tick(&e);
+
+            // stop if cached wram code was written to, see cache_run()
+            if (block->wram && !last)
+            {
+                emit8(&e, 0x81); emit8(&e, 0xBB); emit32(&e, OFF(cpu_cache.wram_gen)); emit32(&e, block->wram_gen);
+                emit_exit(&e, 0x85, exits, &exit_count);
+            }
+        }
+
+        // stop once the next event is due, the same as cache_run()
+        if (!last)
+        {
+            emit8(&e, 0x48); emit8(&e, 0x8B); emit8(&e, 0x83); emit32(&e, OFF(scheduler.cycles)); // mov rax, cycles
+            emit8(&e, 0x48); emit8(&e, 0x3B); emit8(&e, 0x83); emit32(&e, OFF(scheduler.next)); // cmp rax, next
+            emit_exit(&e, 0x83, exits, &exit_count);
+        }
+    }
+
+    for (uint8_t i = 0; i < exit_count; i++)
+    {
+        patch_rel32(exits[i], e.ptr);
+    }
+
+    emit8(&e, 0x5B); // pop rbx
+    emit8(&e, 0xC3); // ret
+
+    if (!protect(start, max_size, PROT_READ | PROT_EXEC))
+    {
+        snes_log_err("[JIT] failed to make the code buffer executable\n");
+        snes_jit_flush(snes);
+        return false;
+    }
+
+    jit->used += e.ptr - start;
+    block->native = (void(*)(struct SNES_Core*))(void*)start;
+
+    return true;
+}
+
+#if SNES_JIT_LOCKSTEP
+
+#define CMP_REG(reg) if (a->reg != b->reg) { fprintf(stderr, "[JIT] lockstep mismatch " #reg ": jit 0x%X interpreter 0x%X\n", a->reg, b->reg); diverged = true; }
+
+// steps the shadow core with the plain interpreter for the same number of
+// instructions that snes just ran and compares the architectural state.
+void snes_jit_lockstep(struct SNES_Core* snes)
+{
+    if (!snes->jit || !snes->jit->shadow)
+    {
+        return;
+    }
+
+    struct SNES_Core* shadow = snes->jit->shadow;
+    const struct SNES_Cpu* a = &snes->cpu;
+    const struct SNES_Cpu* b = &shadow->cpu;
+    bool diverged = false;
+
+    while (shadow->ticks < snes->ticks)
+    {
+        snes_cpu_step(shadow);
+    }
+
+    CMP_REG(PC); CMP_REG(SP); CMP_REG(X); CMP_REG(Y); CMP_REG(A); CMP_REG(D);
+    CMP_REG(PBR); CMP_REG(DBR); CMP_REG(oprand);
+    CMP_REG(P); CMP_REG(flag_E);
+
+    // only N and Z have to match, not the whole nz
+    if ((a->nz >> 31) != (b->nz >> 31) || !(a->nz & 0xFFFF) != !(b->nz & 0xFFFF))
+    {
+        fprintf(stderr, "[JIT] lockstep mismatch N/Z: jit 0x%08X interpreter 0x%08X\n", a->nz, b->nz);
+        diverged = true;
+    }
+
+    if (snes->mem.open_bus != shadow->mem.open_bus)
+    {
+        fprintf(stderr, "[JIT] lockstep mismatch open_bus: jit 0x%02X interpreter 0x%02X\n", snes->mem.open_bus, shadow->mem.open_bus);
+        diverged = true;
+    }
+
+    if (memcmp(snes->mem.wram, shadow->mem.wram, sizeof(snes->mem.wram)))
+    {
+        fprintf(stderr, "[JIT] lockstep mismatch in wram\n");
+        diverged = true;
+    }
+
+    if (snes->scheduler.cycles != shadow->scheduler.cycles)
+    {
+        fprintf(stderr, "[JIT] lockstep mismatch cycles: jit %llu interpreter %llu\n", (unsigned long long)snes->scheduler.cycles, (unsigned long long)shadow->scheduler.cycles);
+        diverged = true;
+    }
+
+    if (diverged)
+    {
+        fprintf(stderr, "[JIT] diverged at %02X:%04X ticks: %zu\n", a->PBR, a->PC, snes->ticks);
+        abort();
+    }
+}
+
+// the shadow gets the same events (and so interrupts) at the same point
+void snes_jit_lockstep_fire(struct SNES_Core* snes)
+{
+    if (!snes->jit || !snes->jit->shadow)
+    {
+        return;
+    }
+
+    snes_scheduler_fire(snes->jit->shadow);
+}
+
+#endif // SNES_JIT_LOCKSTEP
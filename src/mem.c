@@ -3,37 +3,95 @@
 #include "types.h"
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 
-// NOTE: the below is for lorom mapping ONLY.
-// hirom will be implemented later on, once everything is already working
+// NOTE: all cpu accesses go through a page table (rmap / wmap) that is
+// built once in snes_mem_init() from the cart map mode.
+// pages that are plain memory (rom, wram, sram) point directly into host
+// memory, everything else (io, open bus) is NULL and takes the slow path.
 
-static uint8_t fast_rand(void)
+static uint8_t fast_rand(struct SNES_Core* snes)
 {
-    static uint8_t v = 0;
-    return v++;
+    return snes->mem.apuio_counter++;
+}
+
+// lcg with the usual rand() constants, the high bits are the random ones
+static uint8_t slow_rand(struct SNES_Core* snes)
+{
+    snes->mem.apuio_seed = snes->mem.apuio_seed * 1103515245u + 12345u;
+    return snes->mem.apuio_seed >> 16;
 }
 
 static void io_write_INIDISP(struct SNES_Core* snes, uint8_t value)
 {
-    snes->mem.INIDISP.forced_blanking = is_bit_set(7, value);
-    snes->mem.INIDISP.master_brightness = get_bit_range(0, 3, value);
+    snes->ppu.regs.INIDISP.forced_blanking = is_bit_set(7, value);
+    snes->ppu.regs.INIDISP.master_brightness = get_bit_range(0, 3, value);
 
-    if (snes->mem.INIDISP.forced_blanking)
+    if (snes->ppu.regs.INIDISP.forced_blanking)
     {
         snes_log("forced blank enabled! screen is black!\n");
     }
 }
 
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppuspritesobjs
+static void io_write_OBSEL(struct SNES_Core* snes, uint8_t value)
+{
+    const uint16_t base = get_bit_range(0, 2, value) << 13;
+    const uint16_t gap = (get_bit_range(3, 4, value) + 1) << 12;
+
+    snes->ppu.regs.obj.tile_addr[0] = base;
+    snes->ppu.regs.obj.tile_addr[1] = (base + gap) & 0x7FFF;
+    snes->ppu.regs.obj.size = get_bit_range(5, 7, value);
+}
+
+// with rotation, the sprite OAMADD points at has the highest priority
+static void update_obj_first(struct SNES_Ppu* ppu)
+{
+    ppu->regs.obj.first = ppu->obj_priority_actiavtion ? (ppu->oam_addr >> 1) & 0x7F : 0;
+}
+
 static void io_write_OAMADDL(struct SNES_Core* snes, uint8_t value)
 {
     snes->ppu.oam_addr = (snes->ppu.oam_addr & 0xFF00) | value;
+    snes->ppu.oam_write_addr = snes->ppu.oam_addr << 1;
+    update_obj_first(&snes->ppu);
 }
 
 static void io_write_OAMADDH(struct SNES_Core* snes, uint8_t value)
 {
     snes->ppu.oam_addr = (snes->ppu.oam_addr & 0xFF) | ((value & 0x1) << 8);
     snes->ppu.obj_priority_actiavtion = is_bit_set(7, value);
+    snes->ppu.oam_write_addr = snes->ppu.oam_addr << 1;
+    update_obj_first(&snes->ppu);
+}
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppuspritesobjs
+static void io_write_OAMDATA(struct SNES_Core* snes, uint8_t value)
+{
+    const uint16_t addr = snes->ppu.oam_write_addr;
+
+    // the low table is written a word at a time, the high table a byte
+    if (addr < 0x200)
+    {
+        if (addr & 1)
+        {
+            snes->ppu.oam[addr - 1] = snes->ppu.oam_latch;
+            snes->ppu.oam[addr] = value;
+            snes_ppu_on_oam_write(&snes->ppu, addr - 1, 2);
+        }
+        else
+        {
+            snes->ppu.oam_latch = value;
+        }
+    }
+    else
+    {
+        snes->ppu.oam[0x200 | (addr & 0x1F)] = value;
+        snes_ppu_on_oam_write(&snes->ppu, 0x200 | (addr & 0x1F), 1);
+    }
+
+    snes->ppu.oam_write_addr = (addr + 1) & 0x3FF;
 }
 
 static void io_write_VMAIN(struct SNES_Core* snes, uint8_t value)
@@ -45,6 +103,152 @@ static void io_write_VMAIN(struct SNES_Core* snes, uint8_t value)
     // todo: theres another 2 bits that im not saving!
 }
 
+static void io_write_BGMODE(struct SNES_Core* snes, uint8_t value)
+{
+    snes->ppu.regs.bg_mode = get_bit_range(0, 2, value);
+    snes->ppu.regs.bg3_priority = is_bit_set(3, value);
+    snes->ppu.regs.bg_big_tiles = get_bit_range(4, 7, value);
+}
+
+static void io_write_BGSC(struct SNES_Core* snes, uint8_t bg, uint8_t value)
+{
+    snes->ppu.regs.bg[bg].map_addr = (value & 0xFC) << 8;
+    snes->ppu.regs.bg[bg].map_size = value & 0x3;
+}
+
+static void io_write_BGNBA(struct SNES_Core* snes, uint8_t bg, uint8_t value)
+{
+    snes->ppu.regs.bg[bg + 0].tile_addr = (value & 0x0F) << 12;
+    snes->ppu.regs.bg[bg + 1].tile_addr = (value & 0xF0) << 8;
+}
+
+static int16_t sign_extend_13(uint16_t value)
+{
+    return (int16_t)(value << 3) >> 3;
+}
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppubgcontrol
+static void io_write_BGHOFS(struct SNES_Core* snes, uint8_t bg, uint8_t value)
+{
+    struct SNES_Ppu* ppu = &snes->ppu;
+
+    ppu->regs.bg[bg].hofs = ((value << 8) | (ppu->bg_ofs_latch & ~7) | (ppu->bg_hofs_latch & 7)) & 0x3FF;
+    ppu->bg_ofs_latch = value;
+    ppu->bg_hofs_latch = value;
+
+    // BG1HOFS is M7HOFS as well
+    if (bg == 0)
+    {
+        ppu->regs.m7.hofs = sign_extend_13((value << 8) | ppu->m7_latch);
+        ppu->m7_latch = value;
+    }
+}
+
+static void io_write_BGVOFS(struct SNES_Core* snes, uint8_t bg, uint8_t value)
+{
+    struct SNES_Ppu* ppu = &snes->ppu;
+
+    ppu->regs.bg[bg].vofs = ((value << 8) | ppu->bg_ofs_latch) & 0x3FF;
+    ppu->bg_ofs_latch = value;
+
+    // BG1VOFS is M7VOFS as well
+    if (bg == 0)
+    {
+        ppu->regs.m7.vofs = sign_extend_13((value << 8) | ppu->m7_latch);
+        ppu->m7_latch = value;
+    }
+}
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppurotationscalingmode7
+static void io_write_M7SEL(struct SNES_Core* snes, uint8_t value)
+{
+    snes->ppu.regs.m7.screen_over = get_bit_range(6, 7, value);
+    snes->ppu.regs.m7.vflip = is_bit_set(1, value);
+    snes->ppu.regs.m7.hflip = is_bit_set(0, value);
+}
+
+// M7A-M7D / M7X / M7Y, written low byte first
+static uint16_t m7_write(struct SNES_Core* snes, uint8_t value)
+{
+    const uint16_t result = (value << 8) | snes->ppu.m7_latch;
+
+    snes->ppu.m7_latch = value;
+    return result;
+}
+
+// MPYL / MPYM / MPYH, the signed 16-bit M7A times the signed high byte of M7B
+static uint8_t io_read_MPY(struct SNES_Core* snes, uint8_t shift)
+{
+    const int32_t result = snes->ppu.regs.m7.a * (int8_t)(snes->ppu.regs.m7.b >> 8);
+
+    return (uint32_t)result >> shift;
+}
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppuwindow
+static void io_write_WSEL(struct SNES_Core* snes, uint8_t layer, uint8_t value)
+{
+    snes->ppu.regs.windows.select[layer + 0] = get_bit_range(0, 3, value);
+    snes->ppu.regs.windows.select[layer + 1] = get_bit_range(4, 7, value);
+}
+
+static void io_write_WBGLOG(struct SNES_Core* snes, uint8_t value)
+{
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        snes->ppu.regs.windows.logic[SNES_PpuLayer_BG1 + i] = get_bit_range(i * 2, i * 2 + 1, value);
+    }
+}
+
+static void io_write_WOBJLOG(struct SNES_Core* snes, uint8_t value)
+{
+    snes->ppu.regs.windows.logic[SNES_PpuLayer_OBJ] = get_bit_range(0, 1, value);
+    snes->ppu.regs.windows.logic[SNES_PpuLayer_BACKDROP] = get_bit_range(2, 3, value);
+}
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppucolormathematics
+static void io_write_CGWSEL(struct SNES_Core* snes, uint8_t value)
+{
+    snes->ppu.regs.math.force_black = get_bit_range(6, 7, value);
+    snes->ppu.regs.math.prevent = get_bit_range(4, 5, value);
+    snes->ppu.regs.math.add_sub_screen = is_bit_set(1, value);
+    snes->ppu.regs.math.direct_colour = is_bit_set(0, value);
+}
+
+static void io_write_CGADSUB(struct SNES_Core* snes, uint8_t value)
+{
+    snes->ppu.regs.math.subtract = is_bit_set(7, value);
+    snes->ppu.regs.math.half = is_bit_set(6, value);
+    snes->ppu.regs.math.enable = get_bit_range(0, 5, value);
+}
+
+// each of the set channels (bit 5 red, 6 green, 7 blue) gets the intensity
+static void io_write_COLDATA(struct SNES_Core* snes, uint8_t value)
+{
+    const uint16_t intensity = get_bit_range(0, 4, value);
+
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        if (is_bit_set(5 + i, value))
+        {
+            snes->ppu.regs.math.fixed_colour &= ~(0x1F << (i * 5));
+            snes->ppu.regs.math.fixed_colour |= intensity << (i * 5);
+        }
+    }
+}
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppuinterlaceoverscan
+static void io_write_SETINI(struct SNES_Core* snes, uint8_t value)
+{
+    snes->ppu.regs.SETINI.extbg = is_bit_set(6, value);
+    snes->ppu.regs.SETINI.pseudo_hires = is_bit_set(3, value);
+    snes->ppu.regs.SETINI.overscan = is_bit_set(2, value);
+
+    if (value & ~0x4C)
+    {
+        snes_log("[SETINI] WARNING - ignoring bits: 0x%02X\n", value & ~0x4C);
+    }
+}
+
 static void io_write_VMADDL(struct SNES_Core* snes, uint8_t value)
 {
     snes->ppu.vram_addr = (snes->ppu.vram_addr & 0xFF00) | value;
@@ -58,6 +262,7 @@ static void io_write_VMADDH(struct SNES_Core* snes, uint8_t value)
 static void io_write_VMDATAL(struct SNES_Core* snes, uint8_t value)
 {
     snes->ppu.vram[snes->ppu.vram_addr] = (snes->ppu.vram[snes->ppu.vram_addr] & 0xFF00) | value;
+    snes_ppu_on_vram_write(&snes->ppu, snes->ppu.vram_addr, 1);
 
     if (snes->ppu.vram_addr_increment_mode == false)
     {
@@ -69,6 +274,7 @@ static void io_write_VMDATAL(struct SNES_Core* snes, uint8_t value)
 static void io_write_VMDATAH(struct SNES_Core* snes, uint8_t value)
 {
     snes->ppu.vram[snes->ppu.vram_addr] = (snes->ppu.vram[snes->ppu.vram_addr] & 0xFF) | (value << 8);
+    snes_ppu_on_vram_write(&snes->ppu, snes->ppu.vram_addr, 1);
 
     if (snes->ppu.vram_addr_increment_mode == true)
     {
@@ -88,6 +294,7 @@ static void io_write_CGDATA(struct SNES_Core* snes, uint8_t value)
     {
         snes->ppu.cgram_flipflop = false;
         snes->ppu.cgram[snes->ppu.cgram_addr] = (value << 8) | snes->ppu.cgram_cached_byte;
+        snes_ppu_on_cgram_write(&snes->ppu, snes->ppu.cgram_addr++);
     }
     else
     {
@@ -96,41 +303,306 @@ static void io_write_CGDATA(struct SNES_Core* snes, uint8_t value)
     }
 }
 
+// everything that caches wram contents is told about writes to it
+static void wram_written(struct SNES_Core* snes, uint32_t offset)
+{
+    snes_cpu_cache_on_wram_write(snes, offset);
+    snes_hdma_on_wram_write(snes, offset);
+}
+
+static uint8_t io_read_WMDATA(struct SNES_Core* snes)
+{
+    const uint8_t value = snes->mem.wram[snes->mem.WMADD];
+    snes->mem.WMADD = (snes->mem.WMADD + 1) & 0x1FFFF;
+    return value;
+}
+
+static void io_write_WMDATA(struct SNES_Core* snes, uint8_t value)
+{
+    wram_written(snes, snes->mem.WMADD);
+    snes->mem.wram[snes->mem.WMADD] = value;
+    snes->mem.WMADD = (snes->mem.WMADD + 1) & 0x1FFFF;
+}
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesmathsmultiplydivide
+enum
+{
+    ALU_MUL_STEPS = 8,
+    ALU_DIV_STEPS = 16,
+    ALU_CYCLES_PER_STEP = SNES_CYCLES_IO,
+};
+
+static bool alu_busy(const struct SNES_Core* snes)
+{
+    return snes->scheduler.cycles - snes->mem.alu_start < snes->mem.alu_steps * ALU_CYCLES_PER_STEP;
+}
+
+static void io_write_WRMPYB(struct SNES_Core* snes, uint8_t value)
+{
+    // writes while busy are ignored
+    if (alu_busy(snes))
+    {
+        return;
+    }
+
+    snes->mem.WRMPYB = value;
+    snes->mem.RDMPY = snes->mem.WRMPYA * value;
+    snes->mem.RDDIV = value;
+    snes->mem.alu_steps = ALU_MUL_STEPS;
+    snes->mem.alu_start = snes->scheduler.cycles;
+}
+
+static void io_write_WRDIVB(struct SNES_Core* snes, uint8_t value)
+{
+    if (alu_busy(snes))
+    {
+        return;
+    }
+
+    snes->mem.WRDIVB = value;
+    snes->mem.alu_rddiv = snes->mem.RDDIV;
+    // divide by zero gives 0xFFFF and the dividend as the remainder
+    snes->mem.RDDIV = value ? snes->mem.WRDIVA / value : 0xFFFF;
+    snes->mem.RDMPY = value ? snes->mem.WRDIVA % value : snes->mem.WRDIVA;
+    snes->mem.alu_steps = ALU_DIV_STEPS;
+    snes->mem.alu_start = snes->scheduler.cycles;
+}
+
+// the unit does a shift and add (or subtract) per step, reads before it's
+// done see the partial result. only then are the steps actually run.
+// SOURCE: https://github.com/bsnes-emu/bsnes/blob/master/bsnes/sfc/cpu/timing.cpp
+static uint8_t io_read_alu(struct SNES_Core* snes, uint16_t addr)
+{
+    uint16_t rddiv = snes->mem.RDDIV;
+    uint16_t rdmpy = snes->mem.RDMPY;
+
+    if (alu_busy(snes))
+    {
+        const uint8_t steps = (snes->scheduler.cycles - snes->mem.alu_start) / ALU_CYCLES_PER_STEP;
+
+        if (snes->mem.alu_steps == ALU_MUL_STEPS)
+        {
+            uint16_t shift = snes->mem.WRMPYB;
+            rddiv = (snes->mem.WRMPYB << 8) | snes->mem.WRMPYA;
+            rdmpy = 0;
+
+            for (uint8_t i = 0; i < steps; i++, rddiv >>= 1, shift <<= 1)
+            {
+                rdmpy += (rddiv & 1) ? shift : 0;
+            }
+        }
+        else
+        {
+            uint32_t shift = snes->mem.WRDIVB << 16;
+            rddiv = snes->mem.alu_rddiv;
+            rdmpy = snes->mem.WRDIVA;
+
+            for (uint8_t i = 0; i < steps; i++)
+            {
+                rddiv <<= 1;
+                shift >>= 1;
+
+                if (rdmpy >= shift)
+                {
+                    rdmpy -= shift;
+                    rddiv |= 1;
+                }
+            }
+        }
+    }
+
+    switch (addr)
+    {
+        case 0x4214: return rddiv >> 0;
+        case 0x4215: return rddiv >> 8;
+        case 0x4216: return rdmpy >> 0;
+        default: return rdmpy >> 8;
+    }
+}
+
 static void io_write_NMITIMEN(struct SNES_Core* snes, uint8_t value)
 {
+    const bool was_enabled = snes->mem.NMITIMEN.vblank_enable;
+
     snes->mem.NMITIMEN.vblank_enable = is_bit_set(7, value);
     snes->mem.NMITIMEN.irq = get_bit_range(4, 5, value);
     snes->mem.NMITIMEN.joypad_enable = is_bit_set(0, value);
+
+    // enabling nmi during vblank (before RDNMI is read) fires it straight away
+    if (!was_enabled && snes->mem.NMITIMEN.vblank_enable && snes->mem.RDNMI)
+    {
+        snes_cpu_nmi(snes);
+    }
+
+    // disabling the h/v irq also acknowledges it
+    if (!snes->mem.NMITIMEN.irq)
+    {
+        snes->mem.TIMEUP = false;
+        snes_cpu_irq(snes, false);
+    }
+
+    snes_scheduler_update_irq(snes);
+}
+
+static void io_write_HTIME(struct SNES_Core* snes, uint16_t value)
+{
+    snes->mem.HTIME = value & 0x1FF;
+    snes_scheduler_update_irq(snes);
+}
+
+static void io_write_VTIME(struct SNES_Core* snes, uint16_t value)
+{
+    snes->mem.VTIME = value & 0x1FF;
+    snes_scheduler_update_irq(snes);
+}
+
+static uint8_t io_read_RDNMI(struct SNES_Core* snes)
+{
+    // bit 0-3 is the cpu version
+    const uint8_t value = (snes->mem.RDNMI << 7) | (snes->mem.open_bus & 0x70) | 0x02;
+    snes->mem.RDNMI = false;
+    return value;
+}
+
+static uint8_t io_read_TIMEUP(struct SNES_Core* snes)
+{
+    const uint8_t value = (snes->mem.TIMEUP << 7) | (snes->mem.open_bus & 0x7F);
+    snes->mem.TIMEUP = false;
+    snes_cpu_irq(snes, false);
+    return value;
+}
+
+static uint8_t io_read_HVBJOY(const struct SNES_Core* snes)
+{
+    const uint64_t h = snes->scheduler.cycles - snes->ppu.line_start;
+    const bool hblank = h >= SNES_HBLANK_START_CYCLE;
+    // todo: bit 0 is auto joypad read busy
+    return (snes->ppu.vblank << 7) | (hblank << 6) | (snes->mem.open_bus & 0x3E);
 }
 
 static void io_write_MDMAEN(struct SNES_Core* snes, uint8_t value)
 {
     snes->mem.MDMAEN = value;
 
+    // the transfer starts once the write is done, see snes_dma_run()
     if (value)
     {
-        snes_log("[IO-MDMAEN] channel enabled! DMA needs to start: 0x%02X\n", value);
+        snes_scheduler_add(snes, SNES_Event_DMA, snes->scheduler.cycles);
+    }
+}
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesdmaandhdmachannel07registers
+static uint8_t io_read_dma_channel(struct SNES_Core* snes, uint16_t addr)
+{
+    const struct SNES_DmaChannel* ch = &snes->mem.dma[(addr >> 4) & 0x7];
+
+    switch (addr & 0xF)
+    {
+        case 0x0: return ch->DMAP;
+        case 0x1: return ch->BBAD;
+        case 0x2: return ch->A1T >> 0;
+        case 0x3: return ch->A1T >> 8;
+        case 0x4: return ch->A1B;
+        case 0x5: return ch->DAS >> 0;
+        case 0x6: return ch->DAS >> 8;
+        case 0x7: return ch->DASB;
+        case 0x8: return ch->A2A >> 0;
+        case 0x9: return ch->A2A >> 8;
+        case 0xA: return ch->NTRL;
+        case 0xB: case 0xF: return ch->UNUSED;
+    }
+
+    return snes->mem.open_bus;
+}
+
+static void io_write_dma_channel(struct SNES_Core* snes, uint16_t addr, uint8_t value)
+{
+    const uint8_t channel = (addr >> 4) & 0x7;
+    struct SNES_DmaChannel* ch = &snes->mem.dma[channel];
+
+    snes_hdma_on_channel_write(snes, channel);
+
+    switch (addr & 0xF)
+    {
+        case 0x0: ch->DMAP = value; break;
+        case 0x1: ch->BBAD = value; break;
+        case 0x2: ch->A1T = (ch->A1T & 0xFF00) | value; break;
+        case 0x3: ch->A1T = (ch->A1T & 0x00FF) | (value << 8); break;
+        case 0x4: ch->A1B = value; break;
+        case 0x5: ch->DAS = (ch->DAS & 0xFF00) | value; break;
+        case 0x6: ch->DAS = (ch->DAS & 0x00FF) | (value << 8); break;
+        case 0x7: ch->DASB = value; break;
+        case 0x8: ch->A2A = (ch->A2A & 0xFF00) | value; break;
+        case 0x9: ch->A2A = (ch->A2A & 0x00FF) | (value << 8); break;
+        case 0xA: ch->NTRL = value; break;
+        case 0xB: case 0xF: ch->UNUSED = value; break;
+
+        case 0xC ... 0xE: // open bus
+            snes_log_fatal("openbus write - addr: 0x%04X value: 0x%02X\n", addr, value);
+            break;
     }
 }
 
 static void io_write_HDMAEN(struct SNES_Core* snes, uint8_t value)
 {
+    const uint8_t enabled = value & ~snes->mem.HDMAEN;
     snes->mem.HDMAEN = value;
-    // todo: check if anything happens should a hdma channel
-    // be enabled via this write!
+
+    // channels enabled mid frame carry on from their registers
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        if (enabled & (1 << i))
+        {
+            snes_hdma_on_channel_write(snes, i);
+        }
+    }
 }
 
+static void map_cycles(struct SNES_Core* snes);
+
 static void io_write_MEMSEL(struct SNES_Core* snes, uint8_t value)
 {
+    if (snes->mem.MEMSEL == (value & 0x1))
+    {
+        return;
+    }
+
     snes->mem.MEMSEL = value & 0x1;
+    map_cycles(snes);
+
+    // cached blocks have the fetch cost baked in
+    snes_cpu_cache_reset(snes);
+    snes_scheduler_break(snes);
 }
 
 static uint8_t snes_io_read(struct SNES_Core* snes, uint16_t addr)
 {
     uint8_t value = 0xFF;
 
+    // ppu reads see the state of the line the beam is on
+    if (addr >= 0x2134 && addr <= 0x213F)
+    {
+        snes_ppu_catch_up(snes);
+    }
+    else if (addr >= 0x2140 && addr <= 0x2143)
+    {
+        snes_apu_catch_up(snes);
+    }
+
     switch (addr)
     {
+        case 0x2134: // MPYL
+            value = io_read_MPY(snes, 0);
+            break;
+
+        case 0x2135: // MPYM
+            value = io_read_MPY(snes, 8);
+            break;
+
+        case 0x2136: // MPYH
+            value = io_read_MPY(snes, 16);
+            break;
+
         case 0x2139: // VMDATALREAD
             value = snes->ppu.vram[snes->ppu.vram_addr] >> 0;
             break;
@@ -139,14 +611,41 @@ static uint8_t snes_io_read(struct SNES_Core* snes, uint16_t addr)
             value = snes->ppu.vram[snes->ppu.vram_addr] >> 8;
             break;
 
+        case 0x2180: // WMDATA
+            value = io_read_WMDATA(snes);
+            break;
+
         case 0x2140: // APUIO0
             // snes_log("[APUIO0] WARNING - ignoring read\n");
-            value = fast_rand();
+            value = fast_rand(snes);
             break;
 
         case 0x2141: // APUIO1
             // snes_log("[APUIO1] WARNING - ignoring read\n");
-            value = rand();
+            value = slow_rand(snes);
+            break;
+
+        case 0x4210: // RDNMI
+            value = io_read_RDNMI(snes);
+            break;
+
+        case 0x4211: // TIMEUP
+            value = io_read_TIMEUP(snes);
+            break;
+
+        case 0x4212: // HVBJOY
+            value = io_read_HVBJOY(snes);
+            break;
+
+        case 0x4214: // RDDIVL
+        case 0x4215: // RDDIVH
+        case 0x4216: // RDMPYL
+        case 0x4217: // RDMPYH
+            value = io_read_alu(snes, addr);
+            break;
+
+        case 0x4300 ... 0x437F:
+            value = io_read_dma_channel(snes, addr);
             break;
 
         default:
@@ -159,6 +658,21 @@ static uint8_t snes_io_read(struct SNES_Core* snes, uint16_t addr)
 
 static void snes_io_write(struct SNES_Core* snes, uint16_t addr, uint8_t value)
 {
+    // the lines before the write are rendered with the old state.
+    // OBSEL moves every sprite between lines, like an oam write.
+    if (addr == 0x2101 || addr == 0x2104 || addr == 0x2118 || addr == 0x2119 || addr == 0x2122)
+    {
+        snes_ppu_flush(snes);
+    }
+    else if (addr >= 0x2100 && addr <= 0x2133)
+    {
+        snes_ppu_catch_up(snes);
+    }
+    else if (addr >= 0x2140 && addr <= 0x2143)
+    {
+        snes_apu_catch_up(snes);
+    }
+
     switch (addr)
     {
         case 0x2100: // INIDISP
@@ -166,7 +680,7 @@ static void snes_io_write(struct SNES_Core* snes, uint16_t addr, uint8_t value)
             break;
 
         case 0x2101: // OBSEL
-            snes_log("[OBSEL] WARNING - ignoring write: 0x%02X\n", value);
+            io_write_OBSEL(snes, value);
             break;
 
         case 0x2102: // OAMADDL
@@ -178,7 +692,11 @@ static void snes_io_write(struct SNES_Core* snes, uint16_t addr, uint8_t value)
             break;
 
         case 0x2104: // OAMDATA
-            snes_log_fatal("[OAMDATA] WARNING - ignoring write: 0x%02X\n", value);
+            io_write_OAMDATA(snes, value);
+            break;
+
+        case 0x2105: // BGMODE
+            io_write_BGMODE(snes, value);
             break;
 
         case 0x2106: // MOSAIC
@@ -186,27 +704,59 @@ static void snes_io_write(struct SNES_Core* snes, uint16_t addr, uint8_t value)
             break;
 
         case 0x2107: // BG1SC (BG tilemap addr reg BG1)
-            snes_log("[BG1SC] WARNING - ignoring write: 0x%02X\n", value);
+            io_write_BGSC(snes, 0, value);
             break;
 
         case 0x2108: // BG2SC (BG tilemap addr reg BG2)
-            snes_log("[BG2SC] WARNING - ignoring write: 0x%02X\n", value);
+            io_write_BGSC(snes, 1, value);
             break;
 
         case 0x2109: // BG3SC (BG tilemap addr reg BG3)
-            snes_log("[BG3SC] WARNING - ignoring write: 0x%02X\n", value);
+            io_write_BGSC(snes, 2, value);
             break;
 
         case 0x210A: // BG4SC (BG tilemap addr reg BG4)
-            snes_log("[BG4SC] WARNING - ignoring write: 0x%02X\n", value);
+            io_write_BGSC(snes, 3, value);
             break;
 
         case 0x210B: // BG12NBA (BG character addr reg BG1&2)
-            snes_log("[BG12NBA] WARNING - ignoring write: 0x%02X\n", value);
+            io_write_BGNBA(snes, 0, value);
             break;
 
         case 0x210C: // BG34NBA (BG character addr reg BG3&4)
-            snes_log("[BG34NBA] WARNING - ignoring write: 0x%02X\n", value);
+            io_write_BGNBA(snes, 2, value);
+            break;
+
+        case 0x210D: // BG1HOFS
+            io_write_BGHOFS(snes, 0, value);
+            break;
+
+        case 0x210E: // BG1VOFS
+            io_write_BGVOFS(snes, 0, value);
+            break;
+
+        case 0x210F: // BG2HOFS
+            io_write_BGHOFS(snes, 1, value);
+            break;
+
+        case 0x2110: // BG2VOFS
+            io_write_BGVOFS(snes, 1, value);
+            break;
+
+        case 0x2111: // BG3HOFS
+            io_write_BGHOFS(snes, 2, value);
+            break;
+
+        case 0x2112: // BG3VOFS
+            io_write_BGVOFS(snes, 2, value);
+            break;
+
+        case 0x2113: // BG4HOFS
+            io_write_BGHOFS(snes, 3, value);
+            break;
+
+        case 0x2114: // BG4VOFS
+            io_write_BGVOFS(snes, 3, value);
             break;
 
         case 0x2115: // VMAIN
@@ -230,7 +780,31 @@ static void snes_io_write(struct SNES_Core* snes, uint16_t addr, uint8_t value)
             break;
 
         case 0x211A: // M7SEL (mode 7 settings reg)
-            snes_log("[M7SEL] WARNING - ignoring write: 0x%02X\n", value);
+            io_write_M7SEL(snes, value);
+            break;
+
+        case 0x211B: // M7A (mode 7 matrix)
+            snes->ppu.regs.m7.a = (int16_t)m7_write(snes, value);
+            break;
+
+        case 0x211C: // M7B
+            snes->ppu.regs.m7.b = (int16_t)m7_write(snes, value);
+            break;
+
+        case 0x211D: // M7C
+            snes->ppu.regs.m7.c = (int16_t)m7_write(snes, value);
+            break;
+
+        case 0x211E: // M7D
+            snes->ppu.regs.m7.d = (int16_t)m7_write(snes, value);
+            break;
+
+        case 0x211F: // M7X (mode 7 centre)
+            snes->ppu.regs.m7.x = sign_extend_13(m7_write(snes, value));
+            break;
+
+        case 0x2120: // M7Y
+            snes->ppu.regs.m7.y = sign_extend_13(m7_write(snes, value));
             break;
 
         case 0x2121: // CGADD (CGRAM addr)
@@ -241,62 +815,134 @@ static void snes_io_write(struct SNES_Core* snes, uint16_t addr, uint8_t value)
             io_write_CGDATA(snes, value);
             break;
 
+        case 0x2123: // W12SEL (window mask settings reg BG1&2)
+            io_write_WSEL(snes, SNES_PpuLayer_BG1, value);
+            break;
+
+        case 0x2124: // W34SEL (window mask settings reg BG3&4)
+            io_write_WSEL(snes, SNES_PpuLayer_BG3, value);
+            break;
+
+        case 0x2125: // WOBJSEL (window mask settings reg OBJ&colour)
+            io_write_WSEL(snes, SNES_PpuLayer_OBJ, value);
+            break;
+
+        case 0x2126: // WH0 (window 1 left)
+            snes->ppu.regs.windows.left[0] = value;
+            break;
+
+        case 0x2127: // WH1 (window 1 right)
+            snes->ppu.regs.windows.right[0] = value;
+            break;
+
+        case 0x2128: // WH2 (window 2 left)
+            snes->ppu.regs.windows.left[1] = value;
+            break;
+
+        case 0x2129: // WH3 (window 2 right)
+            snes->ppu.regs.windows.right[1] = value;
+            break;
+
         case 0x212A: // WBGLOG (window mask logic reg BG)
-            snes_log("[WBGLOG] WARNING - ignoring write: 0x%02X\n", value);
+            io_write_WBGLOG(snes, value);
             break;
 
         case 0x212B: // WOBJLOG (window mask logic reg OBJ)
-            snes_log("[WOBJLOG] WARNING - ignoring write: 0x%02X\n", value);
+            io_write_WOBJLOG(snes, value);
             break;
 
         case 0x212C: // TM (screen destination reg)
-            snes_log("[TM] WARNING - ignoring write: 0x%02X\n", value);
+            snes->ppu.regs.main_screen = value & 0x1F;
             break;
 
         case 0x212D: // TD (screen destination reg)
-            snes_log("[TD] WARNING - ignoring write: 0x%02X\n", value);
+            snes->ppu.regs.sub_screen = value & 0x1F;
             break;
 
         case 0x212E: // TMW (window destination reg)
-            snes_log("[TMW] WARNING - ignoring write: 0x%02X\n", value);
+            snes->ppu.regs.main_window = value & 0x1F;
             break;
 
         case 0x212F: // TSW (window destination reg)
-            snes_log("[TSW] WARNING - ignoring write: 0x%02X\n", value);
+            snes->ppu.regs.sub_window = value & 0x1F;
+            break;
+
+        case 0x2130: // CGWSEL (colour math control)
+            io_write_CGWSEL(snes, value);
             break;
 
         case 0x2131: // CGADSUB (colour math)
-            snes_log("[CGADSUB] WARNING - ignoring write: 0x%02X\n", value);
+            io_write_CGADSUB(snes, value);
             break;
 
         case 0x2132: // COLDATA (colour math)
-            snes_log("[COLDATA] WARNING - ignoring write: 0x%02X\n", value);
+            io_write_COLDATA(snes, value);
             break;
 
         case 0x2133: // SETINI (screen mode select register)
-            snes_log("[SETINI] WARNING - ignoring write: 0x%02X\n", value);
+            io_write_SETINI(snes, value);
             break;
 
-        case 0x2140: // APUIO0
-            // snes_log("[APUIO0] WARNING - ignoring write: 0x%02X\n", value);
+        case 0x2140 ... 0x2143: // APUIO0-3, read by the spc700 from $F4-$F7
+            snes->apu.port_in[addr & 3] = value;
             break;
 
-        case 0x2141: // APUIO1
-            // snes_log("[APUIO1] WARNING - ignoring write: 0x%02X\n", value);
+        case 0x2180: // WMDATA
+            io_write_WMDATA(snes, value);
             break;
 
-        case 0x2142: // APUIO2
-            // snes_log("[APUIO2] WARNING - ignoring write: 0x%02X\n", value);
+        case 0x2181: // WMADDL
+            snes->mem.WMADD = (snes->mem.WMADD & 0x1FF00) | value;
             break;
 
-        case 0x2143: // APUIO3
-            // snes_log("[APUIO3] WARNING - ignoring write: 0x%02X\n", value);
+        case 0x2182: // WMADDM
+            snes->mem.WMADD = (snes->mem.WMADD & 0x100FF) | (value << 8);
+            break;
+
+        case 0x2183: // WMADDH
+            snes->mem.WMADD = (snes->mem.WMADD & 0x0FFFF) | ((value & 0x1) << 16);
             break;
 
         case 0x4200: // NMITIMEN
             io_write_NMITIMEN(snes, value);
             break;
 
+        case 0x4202: // WRMPYA
+            snes->mem.WRMPYA = value;
+            break;
+
+        case 0x4203: // WRMPYB
+            io_write_WRMPYB(snes, value);
+            break;
+
+        case 0x4204: // WRDIVL
+            snes->mem.WRDIVA = (snes->mem.WRDIVA & 0xFF00) | value;
+            break;
+
+        case 0x4205: // WRDIVH
+            snes->mem.WRDIVA = (snes->mem.WRDIVA & 0x00FF) | (value << 8);
+            break;
+
+        case 0x4206: // WRDIVB
+            io_write_WRDIVB(snes, value);
+            break;
+
+        case 0x4207: // HTIMEL
+            io_write_HTIME(snes, (snes->mem.HTIME & 0xFF00) | value);
+            break;
+
+        case 0x4208: // HTIMEH
+            io_write_HTIME(snes, (snes->mem.HTIME & 0xFF) | (value << 8));
+            break;
+
+        case 0x4209: // VTIMEL
+            io_write_VTIME(snes, (snes->mem.VTIME & 0xFF00) | value);
+            break;
+
+        case 0x420A: // VTIMEH
+            io_write_VTIME(snes, (snes->mem.VTIME & 0xFF) | (value << 8));
+            break;
+
         case 0x420B: // MDMAEN
             io_write_MDMAEN(snes, value);
             break;
@@ -310,112 +956,394 @@ static void snes_io_write(struct SNES_Core* snes, uint16_t addr, uint8_t value)
             break;
 
         case 0x4300 ... 0x437F:
-            switch (addr & 0xF)
-            {
-                case 0x0: // DMAPx
-                    snes_log("[DMAPx] WARNING - ignoring write: 0x%02X channel: %u\n", value, (addr >> 4) & 0xF);
-                    break;
+            io_write_dma_channel(snes, addr, value);
+            break;
+
+        default:
+            snes_log_fatal("[IO] unhandled write! addr: 0x%04X value: 0x%02X\n", addr, value);
+            break;
+    }
+}
 
-                case 0x1: // BBADx
-                    snes_log("[BBADx] WARNING - ignoring write: 0x%02X channel: %u\n", value, (addr >> 4) & 0xF);
-                    break;
+static const uint8_t* rom_page(const struct SNES_Core* snes, size_t offset)
+{
+    if (snes->rom_size == 0)
+    {
+        return NULL;
+    }
 
-                case 0x2: // A1TxL
-                    snes_log("[A1TxL] WARNING - ignoring write: 0x%02X channel: %u\n", value, (addr >> 4) & 0xF);
-                    break;
+    // mirror roms that are smaller than the mapped area
+    offset %= snes->rom_size;
 
-                case 0x3: // A1TxH
-                    snes_log("[A1TxH] WARNING - ignoring write: 0x%02X channel: %u\n", value, (addr >> 4) & 0xF);
-                    break;
+    if (offset + SNES_MEM_PAGE_SIZE > snes->rom_size)
+    {
+        return NULL;
+    }
 
-                case 0x4: // A1Bx
-                    snes_log("[A1Bx] WARNING - ignoring write: 0x%02X channel: %u\n", value, (addr >> 4) & 0xF);
-                    break;
+    return snes->rom + offset;
+}
 
-                case 0x5: // DASxL
-                    snes_log("[DASxL] WARNING - ignoring write: 0x%02X channel: %u\n", value, (addr >> 4) & 0xF);
-                    break;
+static uint8_t* sram_page(struct SNES_Core* snes, size_t offset)
+{
+    if (snes->cart.sram_size == 0)
+    {
+        return NULL;
+    }
 
-                case 0x6: // DASxH
-                    snes_log("[DASxH] WARNING - ignoring write: 0x%02X channel: %u\n", value, (addr >> 4) & 0xF);
-                    break;
+    // sram smaller than a page is mirrored within the page by the slow path
+    if (snes->cart.sram_size < SNES_MEM_PAGE_SIZE)
+    {
+        return NULL;
+    }
 
-                case 0x7: // DASBx
-                    snes_log("[DASBx] WARNING - ignoring write: 0x%02X channel: %u\n", value, (addr >> 4) & 0xF);
-                    break;
+    return snes->mem.sram + (offset % snes->cart.sram_size);
+}
+
+void snes_mem_remap_page(struct SNES_Core* snes, uint16_t page)
+{
+    const uint8_t flags = snes->debug.page_flags[page];
+
+    // watched pages are left unmapped so that accesses take the slow path
+    snes->mem.rmap[page] = (flags & SNES_Breakpoint_READ) ? NULL : snes->debug.rmap[page];
+    snes->mem.wmap[page] = (flags & SNES_Breakpoint_WRITE) ? NULL : snes->debug.wmap[page];
+}
+
+static void map_page(struct SNES_Core* snes, uint8_t bank, uint16_t addr, const uint8_t* r, uint8_t* w)
+{
+    const uint16_t page = (bank << 16 | addr) >> SNES_MEM_PAGE_SHIFT;
 
-                case 0x8: // A2AxL
-                    snes_log("[A2AxL] WARNING - ignoring write: 0x%02X channel: %u\n", value, (addr >> 4) & 0xF);
-                    break;
+    snes->debug.rmap[page] = r;
+    snes->debug.wmap[page] = w;
+    snes_mem_remap_page(snes, page);
+}
 
-                case 0x9: // A2AxH
-                    snes_log("[A2AxH] WARNING - ignoring write: 0x%02X channel: %u\n", value, (addr >> 4) & 0xF);
-                    break;
+static void map_lorom(struct SNES_Core* snes)
+{
+    for (unsigned bank = 0x00; bank <= 0xFF; bank++)
+    {
+        const uint8_t b = bank & 0x7F;
+
+        for (unsigned addr = 0x0000; addr <= 0xFFFF; addr += SNES_MEM_PAGE_SIZE)
+        {
+            const size_t rom_offset = (0x8000 * b) + (addr & 0x7FFF);
+
+            if (b == 0x7E || b == 0x7F)
+            {
+                // banks FE-FF are rom, only 7E-7F are wram
+                if (bank == b)
+                {
+                    uint8_t* wram = snes->mem.wram + ((b & 0x1) << 16) + addr;
+                    map_page(snes, bank, addr, wram, wram);
+                }
+                else
+                {
+                    map_page(snes, bank, addr, rom_page(snes, rom_offset), NULL);
+                }
+            }
+            else if (addr >= 0x8000 || b >= 0x40)
+            {
+                if (addr < 0x8000 && b >= 0x70)
+                {
+                    uint8_t* sram = sram_page(snes, (0x8000 * (b - 0x70)) + addr);
+
+                    if (sram)
+                    {
+                        map_page(snes, bank, addr, sram, sram);
+                        continue;
+                    }
+                    else if (snes->cart.sram_size)
+                    {
+                        continue; // handled by the slow path
+                    }
+                }
+
+                map_page(snes, bank, addr, rom_page(snes, rom_offset), NULL);
+            }
+            else if (addr < 0x2000) // shadow ram
+            {
+                map_page(snes, bank, addr, snes->mem.wram + addr, snes->mem.wram + addr);
+            }
+            // 0x2000-0x7FFF is io / expansion, left NULL for the slow path
+        }
+    }
+}
 
-                case 0xA: // NTRLx
-                    snes_log("[NTRLx] WARNING - ignoring write: 0x%02X channel: %u\n", value, (addr >> 4) & 0xF);
-                    break;
+static void map_hirom(struct SNES_Core* snes)
+{
+    for (unsigned bank = 0x00; bank <= 0xFF; bank++)
+    {
+        const uint8_t b = bank & 0x7F;
 
-                case 0xB: // UNUSED (unused byte r/w)
-                    snes_log_fatal("unused byte write - addr: 0x%04X value: 0x%02X\n", addr, value);
-                    break;
+        for (unsigned addr = 0x0000; addr <= 0xFFFF; addr += SNES_MEM_PAGE_SIZE)
+        {
+            const size_t rom_offset = ((b & 0x3F) << 16) | addr;
 
-                case 0xC ... 0xF: // open bus
-                    snes_log_fatal("openbus write - addr: 0x%04X value: 0x%02X\n", addr, value);
-                    break;
+            if (bank == 0x7E || bank == 0x7F)
+            {
+                uint8_t* wram = snes->mem.wram + ((b & 0x1) << 16) + addr;
+                map_page(snes, bank, addr, wram, wram);
             }
+            else if (addr >= 0x8000 || b >= 0x40)
+            {
+                map_page(snes, bank, addr, rom_page(snes, rom_offset), NULL);
+            }
+            else if (addr < 0x2000) // shadow ram
+            {
+                map_page(snes, bank, addr, snes->mem.wram + addr, snes->mem.wram + addr);
+            }
+            else if (addr >= 0x6000 && b >= 0x20)
+            {
+                uint8_t* sram = sram_page(snes, SNES_MEM_PAGE_SIZE * (b - 0x20));
+                map_page(snes, bank, addr, sram, sram);
+            }
+        }
+    }
+}
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesmemorymap
+static uint8_t page_cycles(const struct SNES_Core* snes, uint8_t bank, uint16_t addr)
+{
+    // banks 80-BF (8000-FFFF) and C0-FF can be switched to fastrom
+    if (bank >= 0xC0 || (bank >= 0x80 && addr >= 0x8000))
+    {
+        return snes->mem.MEMSEL ? SNES_CYCLES_FAST : SNES_CYCLES_SLOW;
+    }
+
+    if ((bank & 0x7F) >= 0x40 || addr >= 0x6000 || addr < 0x2000)
+    {
+        return SNES_CYCLES_SLOW;
+    }
+
+    // io, 4000-41FF is XSLOW which is added by the slow path
+    return SNES_CYCLES_FAST;
+}
+
+static void map_cycles(struct SNES_Core* snes)
+{
+    for (unsigned page = 0; page < SNES_MEM_PAGE_COUNT; page++)
+    {
+        const uint32_t addr = page << SNES_MEM_PAGE_SHIFT;
+        snes->mem.access_cycles[page] = page_cycles(snes, addr >> 16, addr & 0xFFFF);
+    }
+}
+
+bool snes_mem_init(struct SNES_Core* snes)
+{
+    memset(snes->mem.rmap, 0, sizeof(snes->mem.rmap));
+    memset(snes->mem.wmap, 0, sizeof(snes->mem.wmap));
+    memset(snes->debug.rmap, 0, sizeof(snes->debug.rmap));
+    memset(snes->debug.wmap, 0, sizeof(snes->debug.wmap));
+    map_cycles(snes);
+
+    switch (snes->cart.map_mode)
+    {
+        case SNES_MapMode_LoROM:
+            map_lorom(snes);
             break;
 
-        default:
-            snes_log_fatal("[IO] unhandled write! addr: 0x%04X value: 0x%02X\n", addr, value);
+        case SNES_MapMode_HiROM:
+            map_hirom(snes);
             break;
+
+        default:
+            snes_log_fatal("[MEM] unsupported map mode: 0x%02X\n", snes->cart.map_mode);
+            return false;
     }
+
+    return true;
 }
 
-uint8_t snes_cpu_read8(struct SNES_Core* snes, uint32_t addr)
+// returns true if addr is a sram addr that is not directly mapped
+// (i.e. sram smaller than a page). offset is set to the sram offset.
+static bool sram_slow_offset(const struct SNES_Core* snes, uint8_t bank, uint16_t addr, size_t* offset)
+{
+    if (snes->cart.sram_size == 0)
+    {
+        return false;
+    }
+
+    bank &= 0x7F;
+
+    if (snes->cart.map_mode == SNES_MapMode_HiROM)
+    {
+        if (bank < 0x20 || bank >= 0x40 || addr < 0x6000 || addr >= 0x8000)
+        {
+            return false;
+        }
+    }
+    else if (bank < 0x70 || bank >= 0x7E || addr >= 0x8000)
+    {
+        return false;
+    }
+
+    *offset = addr % snes->cart.sram_size;
+    return true;
+}
+
+bool snes_mem_wram_offset(uint32_t addr, uint32_t* offset)
 {
     const uint8_t bank = (addr >> 16) & 0xFF;
     addr &= 0xFFFF;
-    uint8_t data = snes->mem.open_bus;
 
-    switch (bank & 0x7F)
+    if (bank == 0x7E || bank == 0x7F)
     {
-        case 0x00 ... 0x3F:
-            switch (addr)
-            {
-                case 0x0000 ... 0x1FFF: // shadow ram
-                    data = snes->mem.wram[addr];
-                    break;
+        *offset = ((bank & 0x1) << 16) | addr;
+        return true;
+    }
 
-                case 0x2000 ... 0x5FFF: // hardware registers
-                    data = snes_io_read(snes, addr);
-                    break;
+    // shadow ram, mirrored in both lorom and hirom
+    if ((bank & 0x7F) < 0x40 && addr < 0x2000)
+    {
+        *offset = addr;
+        return true;
+    }
 
-                case 0x6000 ... 0x7FFF: // Expansion ram
-                    snes_log_fatal("reading from expansion ram! bank: 0x%02X addr: 0x%04X\n", bank, addr);
-                    break;
+    return false;
+}
 
-                case 0x8000 ... 0xFFFF: // 32k rom
-                    data = snes->rom[(addr & 0x7FFF) + (0x8000 * (bank & 0x7F))];
-                    break;
-            }
-            break;
+void snes_mem_trap_wram_writes(struct SNES_Core* snes, uint8_t page, uint8_t reason, bool trap)
+{
+    const uint8_t old = snes->mem.wram_trap[page];
+    snes->mem.wram_trap[page] = trap ? old | reason : old & ~reason;
 
-        case 0x40 ... 0x7C: // rom
-            data = snes->rom[(addr & 0x7FFF) + (0x8000 * (bank & 0x7F))];
-            break;
+    if (!old == !snes->mem.wram_trap[page])
+    {
+        return;
+    }
 
-        case 0x7D: // sram
-            snes_log_fatal("reading from sram! bank: 0x%02X addr: 0x%04X\n", bank, addr);
-            break;
+    const uint32_t offset = page << SNES_MEM_PAGE_SHIFT;
+    uint8_t* ptr = snes->mem.wram_trap[page] ? NULL : snes->mem.wram + offset;
 
-        case 0x7E: // wram (1st 64K)
-            data = snes->mem.wram[addr];
-            break;
+    map_page(snes, 0x7E + (offset >> 16), offset & 0xFFFF, snes->mem.wram + offset, ptr);
 
-        case 0x7F: // wram (2nd 64K)
-            data = snes->mem.wram[addr | 0x10000];
-            break;
+    // the 1st page is also mirrored in banks 00-3F and 80-BF
+    if (page == 0)
+    {
+        for (unsigned bank = 0x00; bank < 0x40; bank++)
+        {
+            map_page(snes, bank, 0x0000, snes->mem.wram, ptr);
+            map_page(snes, bank | 0x80, 0x0000, snes->mem.wram, ptr);
+        }
+    }
+}
+
+static uint8_t snes_cpu_read8_unmapped(struct SNES_Core* snes, uint32_t addr)
+{
+    const uint8_t bank = (addr >> 16) & 0xFF;
+    addr &= 0xFFFF;
+    size_t offset = 0;
+
+    if ((bank & 0x7F) < 0x40 && addr >= 0x2000 && addr < 0x6000)
+    {
+        if (addr >= 0x4000 && addr < 0x4200)
+        {
+            snes->scheduler.cycles += SNES_CYCLES_XSLOW - SNES_CYCLES_FAST;
+        }
+
+        return snes_io_read(snes, addr);
+    }
+
+    if (sram_slow_offset(snes, bank, addr, &offset))
+    {
+        return snes->mem.sram[offset];
+    }
+
+    snes_log_fatal("reading from unmapped addr! bank: 0x%02X addr: 0x%04X\n", bank, addr);
+    return snes->mem.open_bus;
+}
+
+static void snes_cpu_write8_unmapped(struct SNES_Core* snes, uint32_t addr, uint8_t value)
+{
+    const uint8_t bank = (addr >> 16) & 0xFF;
+    uint32_t wram_offset = 0;
+    size_t offset = 0;
+
+    // wram pages with cached code / hdma tables are trapped, see snes_mem_trap_wram_writes()
+    if (snes_mem_wram_offset(addr, &wram_offset))
+    {
+        wram_written(snes, wram_offset);
+        snes->mem.wram[wram_offset] = value;
+        return;
+    }
+
+    addr &= 0xFFFF;
+
+    if ((bank & 0x7F) < 0x40 && addr >= 0x2000 && addr < 0x6000)
+    {
+        if (addr >= 0x4000 && addr < 0x4200)
+        {
+            snes->scheduler.cycles += SNES_CYCLES_XSLOW - SNES_CYCLES_FAST;
+        }
+
+        snes_io_write(snes, addr, value);
+    }
+    else if (sram_slow_offset(snes, bank, addr, &offset))
+    {
+        snes->mem.sram[offset] = value;
+    }
+    else
+    {
+        snes_log_fatal("writing to unmapped / rom addr! bank: 0x%02X addr: 0x%04X value: 0x%02X\n", bank, addr, value);
+    }
+}
+
+static uint8_t snes_cpu_read8_slow(struct SNES_Core* snes, uint32_t addr)
+{
+    const uint16_t page = addr >> SNES_MEM_PAGE_SHIFT;
+
+    if (!(snes->debug.page_flags[page] & SNES_Breakpoint_READ))
+    {
+        return snes_cpu_read8_unmapped(snes, addr);
+    }
+
+    // the page is watched, see snes_mem_remap_page()
+    const uint8_t* ptr = snes->debug.rmap[page];
+    const uint8_t data = ptr ? ptr[addr & SNES_MEM_PAGE_MASK] : snes_cpu_read8_unmapped(snes, addr);
+
+    snes_debug_watch(snes, addr, data, SNES_Breakpoint_READ);
+    return data;
+}
+
+static void snes_cpu_write8_slow(struct SNES_Core* snes, uint32_t addr, uint8_t value)
+{
+    const uint16_t page = addr >> SNES_MEM_PAGE_SHIFT;
+
+    if (!(snes->debug.page_flags[page] & SNES_Breakpoint_WRITE))
+    {
+        snes_cpu_write8_unmapped(snes, addr, value);
+        return;
+    }
+
+    // the page is watched, see snes_mem_remap_page()
+    uint8_t* ptr = snes->debug.wmap[page];
+
+    if (ptr)
+    {
+        ptr[addr & SNES_MEM_PAGE_MASK] = value;
+    }
+    else
+    {
+        snes_cpu_write8_unmapped(snes, addr, value);
+    }
+
+    snes_debug_watch(snes, addr, value, SNES_Breakpoint_WRITE);
+}
+
+uint8_t snes_cpu_read8(struct SNES_Core* snes, uint32_t addr)
+{
+    addr &= 0x00FFFFFF;
+    const uint8_t* page = snes->mem.rmap[addr >> SNES_MEM_PAGE_SHIFT];
+    uint8_t data;
+
+    snes->scheduler.cycles += snes->mem.access_cycles[addr >> SNES_MEM_PAGE_SHIFT];
+
+    if (page)
+    {
+        data = page[addr & SNES_MEM_PAGE_MASK];
+    }
+    else
+    {
+        data = snes_cpu_read8_slow(snes, addr);
     }
 
     snes->mem.open_bus = data;
@@ -424,55 +1352,107 @@ uint8_t snes_cpu_read8(struct SNES_Core* snes, uint32_t addr)
 
 void snes_cpu_write8(struct SNES_Core* snes, uint32_t addr, uint8_t value)
 {
-    const uint8_t bank = (addr >> 16) & 0xFF;
-    addr &= 0xFFFF;
+    addr &= 0x00FFFFFF;
+    uint8_t* page = snes->mem.wmap[addr >> SNES_MEM_PAGE_SHIFT];
     snes->mem.open_bus = value;
+    snes->scheduler.cycles += snes->mem.access_cycles[addr >> SNES_MEM_PAGE_SHIFT];
 
-    switch (bank & 0x7F)
+    if (page)
     {
-        case 0x00 ... 0x3F:
-            switch (addr)
-            {
-                case 0x0000 ... 0x1FFF: // shadow ram
-                    snes->mem.wram[addr] = value;
-                    break;
+        page[addr & SNES_MEM_PAGE_MASK] = value;
+    }
+    else
+    {
+        snes_cpu_write8_slow(snes, addr, value);
+    }
+}
 
-                case 0x2000 ... 0x5FFF: // hardware registers
-                    snes_io_write(snes, addr, value);
-                    break;
+// dma accesses don't cost cpu cycles or trigger watchpoints, and the
+// a-bus can't reach io, so those read open bus and writes are dropped.
+uint8_t snes_mem_abus_read(struct SNES_Core* snes, uint32_t addr)
+{
+    const uint8_t* page = snes->debug.rmap[addr >> SNES_MEM_PAGE_SHIFT];
+    size_t offset = 0;
 
-                case 0x6000 ... 0x7FFF: // Expansion ram
-                    snes_log_fatal("writing to expansion ram! bank: 0x%02X addr: 0x%04X value: 0x%02X\n", bank, addr, value);
-                    break;
+    if (page)
+    {
+        return page[addr & SNES_MEM_PAGE_MASK];
+    }
 
-                case 0x8000 ... 0xFFFF: // 32k rom
-                    snes_log_fatal("writing to rom! bank: 0x%02X addr: 0x%04X value: 0x%02X\n", bank, addr, value);
-                    break;
-            }
-            break;
+    if (sram_slow_offset(snes, addr >> 16, addr & 0xFFFF, &offset))
+    {
+        return snes->mem.sram[offset];
+    }
 
-        case 0x40 ... 0x7C: // rom
-            snes_log_fatal("writing to rom! bank: 0x%02X addr: 0x%04X value: 0x%02X\n", bank, addr, value);
-            break;
+    return snes->mem.open_bus;
+}
 
-        case 0x7D: // sram
-            snes_log_fatal("writing to sram! bank: 0x%02X addr: 0x%04X value: 0x%02X\n", bank, addr, value);
-            break;
+void snes_mem_abus_write(struct SNES_Core* snes, uint32_t addr, uint8_t value)
+{
+    uint8_t* page = snes->debug.wmap[addr >> SNES_MEM_PAGE_SHIFT];
+    uint32_t wram_offset = 0;
+    size_t offset = 0;
 
-        case 0x7E: // wram (1st 64K)
-            snes->mem.wram[addr] = value;
-            break;
+    if (snes_mem_wram_offset(addr, &wram_offset))
+    {
+        wram_written(snes, wram_offset);
+        snes->mem.wram[wram_offset] = value;
+    }
+    else if (page)
+    {
+        page[addr & SNES_MEM_PAGE_MASK] = value;
+    }
+    else if (sram_slow_offset(snes, addr >> 16, addr & 0xFFFF, &offset))
+    {
+        snes->mem.sram[offset] = value;
+    }
+}
 
-        case 0x7F: // wram (2nd 64K)
-            snes->mem.wram[addr | 0x10000] = value;
-            break;
+uint8_t snes_mem_bbus_read(struct SNES_Core* snes, uint8_t addr)
+{
+    return snes_io_read(snes, 0x2100 | addr);
+}
+
+void snes_mem_bbus_write(struct SNES_Core* snes, uint8_t addr, uint8_t value)
+{
+    snes_io_write(snes, 0x2100 | addr, value);
+}
+
+// the wide accesses below are a single page lookup and load when every
+// byte is in the same mapped page. otherwise (page edge, io, watched
+// pages) they're split into byte accesses in order, so side effects,
+// open bus and cycles are the same either way.
+
+// returns the host pointer to addr if len bytes from it are mapped
+static const uint8_t* read_span(const struct SNES_Core* snes, uint32_t addr, uint8_t len)
+{
+    const uint8_t* page = snes->mem.rmap[addr >> SNES_MEM_PAGE_SHIFT];
+
+    if (!page || (addr & SNES_MEM_PAGE_MASK) + len > SNES_MEM_PAGE_SIZE)
+    {
+        return NULL;
     }
+
+    return page + (addr & SNES_MEM_PAGE_MASK);
 }
 
 // todo: check if not 16-bit aligned addr.
 // will 00:FFFF wrap around to 01:0000 or 00:0000?
 uint16_t snes_cpu_read16(struct SNES_Core* snes, uint32_t addr)
 {
+    addr &= 0x00FFFFFF;
+    const uint8_t* ptr = read_span(snes, addr, 2);
+
+    if (ptr)
+    {
+        // compilers merge this into a single (unaligned) load
+        const uint16_t value = ptr[0] | (ptr[1] << 8);
+
+        snes->scheduler.cycles += snes->mem.access_cycles[addr >> SNES_MEM_PAGE_SHIFT] * 2;
+        snes->mem.open_bus = ptr[1];
+        return value;
+    }
+
     const uint16_t lo = snes_cpu_read8(snes, addr + 0);
     const uint16_t hi = snes_cpu_read8(snes, addr + 1);
 
@@ -481,14 +1461,42 @@ uint16_t snes_cpu_read16(struct SNES_Core* snes, uint32_t addr)
 
 uint32_t snes_cpu_read24(struct SNES_Core* snes, uint32_t addr)
 {
-    const uint32_t lo = snes_cpu_read16(snes, addr + 0);
-    const uint32_t hi = snes_cpu_read16(snes, addr + 2);
+    addr &= 0x00FFFFFF;
+    const uint8_t* ptr = read_span(snes, addr, 3);
+
+    if (ptr)
+    {
+        const uint32_t value = ptr[0] | (ptr[1] << 8) | (ptr[2] << 16);
 
-    return ((hi << 16) | lo) & 0x00FFFFFF;
+        snes->scheduler.cycles += snes->mem.access_cycles[addr >> SNES_MEM_PAGE_SHIFT] * 3;
+        snes->mem.open_bus = ptr[2];
+        return value;
+    }
+
+    // exactly 3 reads, the 4th byte is never touched
+    const uint32_t lo = snes_cpu_read8(snes, addr + 0);
+    const uint32_t mid = snes_cpu_read8(snes, addr + 1);
+    const uint32_t hi = snes_cpu_read8(snes, addr + 2);
+
+    return (hi << 16) | (mid << 8) | lo;
 }
 
 void snes_cpu_write16(struct SNES_Core* snes, uint32_t addr, uint16_t value)
 {
+    addr &= 0x00FFFFFF;
+    uint8_t* page = snes->mem.wmap[addr >> SNES_MEM_PAGE_SHIFT];
+
+    if (page && (addr & SNES_MEM_PAGE_MASK) != SNES_MEM_PAGE_MASK)
+    {
+        uint8_t* ptr = page + (addr & SNES_MEM_PAGE_MASK);
+
+        ptr[0] = (value >> 0) & 0xFF;
+        ptr[1] = (value >> 8) & 0xFF;
+        snes->scheduler.cycles += snes->mem.access_cycles[addr >> SNES_MEM_PAGE_SHIFT] * 2;
+        snes->mem.open_bus = ptr[1];
+        return;
+    }
+
     snes_cpu_write8(snes, addr + 0, (value >> 0) & 0xFF);
     snes_cpu_write8(snes, addr + 1, (value >> 8) & 0xFF);
 }
@@ -1,8 +1,1556 @@
 #include "internal.h"
+#include "types.h"
+#include <stdint.h>
+#include <string.h>
 
 
+// NOTE: the ppu only runs when something can observe it. a line is
+// rendered once the beam has reached its hblank, but not until a ppu
+// register is written / read (or dma writes ppu memory) or the frame
+// ends. so a frame without any mid frame writes is rendered in one go at
+// the start of vblank, while a write mid frame first renders the lines
+// before it with the old state.
+
+// NOTE: tiles are decoded from planar to a byte per pixel once, into
+// ppu.tile_cache, and again only after vram writes to them (a dirty bit per
+// tile at each bit depth). so a bg line is a copy of the cached row under
+// each 8 pixel chunk (byte swapped for hflip), then the palette is added to
+// the opaque pixels. the decode and the palette pass are done 2 / 4 chunks
+// at a time with sse2 / avx2 (see SNES_PPU_SIMD).
+
+// bytes per simd step, 0 for the scalar paths
+#if SNES_PPU_SIMD && defined(__AVX2__)
+    #include <immintrin.h>
+    #define PPU_SIMD_WIDTH 32
+#elif SNES_PPU_SIMD && defined(__SSE2__)
+    #include <emmintrin.h>
+    #define PPU_SIMD_WIDTH 16
+#else
+    #define PPU_SIMD_WIDTH 0
+#endif
+
+enum
+{
+    // one more chunk than fits in a line, for the fine scroll.
+    // hi-res lines are twice as wide.
+    BG_CHUNKS = SNES_PPU_WIDTH / 8 + 1,
+    BG_CHUNKS_HIRES = SNES_PPU_WIDTH * 2 / 8 + 1,
+    // rounded up to what a simd step handles
+    BG_CHUNKS_MAX = (BG_CHUNKS_HIRES + 3) & ~3,
+};
+
+// the tile rows under each chunk of a bg line
+struct BgChunks
+{
+    uint64_t pixels[BG_CHUNKS_MAX]; // without the palette, 0 is transparent
+    uint8_t palette[BG_CHUNKS_MAX]; // cgram index of the tile's palette
+    uint8_t priority[BG_CHUNKS_MAX];
+    uint8_t direct[BG_CHUNKS_MAX]; // the tile's palette bits, see pixel_colour()
+};
+
+// a rendered bg line, index 0 is transparent
+struct BgLine
+{
+    uint8_t index[SNES_PPU_WIDTH];
+    uint8_t priority[SNES_PPU_WIDTH];
+    uint8_t direct[SNES_PPU_WIDTH]; // 8bpp bg1 with direct colour only
+};
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppuvideomodes
+static const uint8_t BG_BPP[8][4] =
+{
+    [0] = { 2, 2, 2, 2 },
+    [1] = { 4, 4, 2, 0 },
+    [2] = { 4, 4, 0, 0 },
+    [3] = { 8, 4, 0, 0 },
+    [4] = { 8, 2, 0, 0 },
+    [5] = { 4, 2, 0, 0 },
+    [6] = { 4, 0, 0, 0 },
+    [7] = { 0, 0, 0, 0 }, // 8bpp, but not tiles like the rest, see render_mode7()
+};
+
+// OBJ with priority p is layer LAYER_OBJ + p, a bg is (bg << 1) | priority
+enum
+{
+    LAYER_OBJ = 8,
+};
+
+// the layers from front to back. [8] is mode 1 with bg3 priority set,
+// [9] mode 7 with EXTBG.
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppubgprioritylayers
+static const uint8_t LAYERS[10][12] =
+{
+    [0] = { 11, 1, 3, 10, 0, 2, 9, 5, 7, 8, 4, 6 },
+    [1] = { 11, 1, 3, 10, 0, 2, 9, 5, 8, 4 },
+    [2] = { 11, 1, 10, 3, 9, 0, 8, 2 },
+    [3] = { 11, 1, 10, 3, 9, 0, 8, 2 },
+    [4] = { 11, 1, 10, 3, 9, 0, 8, 2 },
+    [5] = { 11, 1, 10, 3, 9, 0, 8, 2 },
+    [6] = { 11, 1, 10, 9, 0, 8 },
+    [7] = { 11, 10, 9, 0, 8 },
+    [8] = { 5, 11, 1, 3, 10, 0, 2, 9, 8, 4 },
+    [9] = { 11, 10, 3, 9, 0, 8, 2 },
+};
+
+static const uint8_t LAYER_COUNT[10] = { 12, 10, 8, 8, 8, 8, 6, 5, 10, 7 };
+
+// byte i of the result is bit 7 - i of b, so each pixel of a plane gets its
+// own byte. the 8 shifted copies don't overlap, so nothing carries.
+static inline uint64_t spread_bits(uint8_t b)
+{
+    return ((b * 0x8040201008040201ULL) >> 7) & 0x0101010101010101ULL;
+}
+
+// the byte in each of the 8 bytes, one chunk per simd lane
+static inline uint64_t splat(uint8_t b)
+{
+    return b * 0x0101010101010101ULL;
+}
+
+// reverses the pixels of a row, same as a byte swap
+static uint64_t flip_row(uint64_t row)
+{
+    row = ((row & 0xFFFFFFFF00000000ULL) >> 32) | ((row & 0x00000000FFFFFFFFULL) << 32);
+    row = ((row & 0xFFFF0000FFFF0000ULL) >> 16) | ((row & 0x0000FFFF0000FFFFULL) << 16);
+    row = ((row & 0xFF00FF00FF00FF00ULL) >> 8) | ((row & 0x00FF00FF00FF00FFULL) << 8);
+    return row;
+}
+
+// planar to a byte per pixel, the 8 rows of a tile
+static void decode_tile(const uint8_t planes[8][8], uint8_t bpp, uint64_t rows[8])
+{
+#if PPU_SIMD_WIDTH == 32
+    const __m256i bits = _mm256_set1_epi64x(0x0102040810204080LL);
+
+    for (uint8_t r = 0; r < 8; r += 4)
+    {
+        __m256i pixels = _mm256_setzero_si256();
+
+        for (uint8_t p = 0; p < bpp; p++)
+        {
+            const uint8_t* plane = planes[p] + r;
+            // each byte of a plane covers a row
+            const __m256i v = _mm256_set_epi64x(
+                (long long)splat(plane[3]), (long long)splat(plane[2]),
+                (long long)splat(plane[1]), (long long)splat(plane[0]));
+            const __m256i set = _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits);
+
+            pixels = _mm256_or_si256(pixels, _mm256_and_si256(set, _mm256_set1_epi8(1 << p)));
+        }
+
+        _mm256_storeu_si256((void*)(rows + r), pixels);
+    }
+#elif PPU_SIMD_WIDTH == 16
+    const __m128i bits = _mm_set1_epi64x(0x0102040810204080LL);
+
+    for (uint8_t r = 0; r < 8; r += 2)
+    {
+        __m128i pixels = _mm_setzero_si128();
+
+        for (uint8_t p = 0; p < bpp; p++)
+        {
+            const uint8_t* plane = planes[p] + r;
+            // each byte of a plane covers a row
+            const __m128i v = _mm_set_epi64x((long long)splat(plane[1]), (long long)splat(plane[0]));
+            const __m128i set = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+
+            pixels = _mm_or_si128(pixels, _mm_and_si128(set, _mm_set1_epi8(1 << p)));
+        }
+
+        _mm_storeu_si128((void*)(rows + r), pixels);
+    }
+#else
+    for (uint8_t r = 0; r < 8; r++)
+    {
+        uint64_t pixels = 0;
+
+        for (uint8_t p = 0; p < bpp; p++)
+        {
+            pixels |= spread_bits(planes[p][r]) << p;
+        }
+
+        // byte i is pixel i on any host
+        uint8_t bytes[8];
+
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            bytes[i] = pixels >> (i * 8);
+        }
+
+        memcpy(&rows[r], bytes, sizeof(bytes));
+    }
+#endif
+}
+
+static void mark_dirty(uint64_t* dirty, uint16_t first, uint16_t last)
+{
+    for (uint16_t tile = first; tile <= last; tile++)
+    {
+        dirty[tile >> 6] |= 1ULL << (tile & 63);
+    }
+}
+
+void snes_ppu_on_vram_write(struct SNES_Ppu* ppu, uint16_t addr, uint32_t words)
+{
+    struct SNES_PpuTileCache* cache = &ppu->tile_cache;
+    const uint16_t first = addr & 0x7FFF;
+    const uint16_t last = first + words - 1;
+
+    if (!words)
+    {
+        return;
+    }
+
+    mark_dirty(cache->dirty_2bpp, first >> 3, last >> 3);
+    mark_dirty(cache->dirty_4bpp, first >> 4, last >> 4);
+    mark_dirty(cache->dirty_8bpp, first >> 5, last >> 5);
+
+#if SNES_PPU_THREAD
+    if (ppu->thread)
+    {
+        snes_ppu_thread_push_vram(ppu, first, words);
+    }
+#endif
+}
+
+// decodes tile (a tile number at bpp) into the cache and clears its dirty bit
+static void decode_cached_tile(struct SNES_Ppu* ppu, uint8_t bpp, uint16_t tile)
+{
+    struct SNES_PpuTileCache* cache = &ppu->tile_cache;
+    const uint16_t addr = tile * bpp * 4;
+    uint8_t planes[8][8];
+
+    for (uint8_t r = 0; r < 8; r++)
+    {
+        for (uint8_t p = 0; p < bpp; p += 2)
+        {
+            const uint16_t word = ppu->vram[addr + p * 4 + r];
+
+            planes[p + 0][r] = word & 0xFF;
+            planes[p + 1][r] = word >> 8;
+        }
+    }
+
+    switch (bpp)
+    {
+        case 2:
+            decode_tile(planes, bpp, cache->tiles_2bpp[tile]);
+            cache->dirty_2bpp[tile >> 6] &= ~(1ULL << (tile & 63));
+            break;
+
+        case 4:
+            decode_tile(planes, bpp, cache->tiles_4bpp[tile]);
+            cache->dirty_4bpp[tile >> 6] &= ~(1ULL << (tile & 63));
+            break;
+
+        default:
+            decode_tile(planes, bpp, cache->tiles_8bpp[tile]);
+            cache->dirty_8bpp[tile >> 6] &= ~(1ULL << (tile & 63));
+            break;
+    }
+}
+
+// decodes every dirty tile at bpp
+static void refresh_tiles(struct SNES_Ppu* ppu, uint8_t bpp)
+{
+    struct SNES_PpuTileCache* cache = &ppu->tile_cache;
+    const uint64_t* dirty = bpp == 2 ? cache->dirty_2bpp : bpp == 4 ? cache->dirty_4bpp : cache->dirty_8bpp;
+    const uint16_t words = bpp == 2 ? ARRAY_SIZE(cache->dirty_2bpp) : bpp == 4 ? ARRAY_SIZE(cache->dirty_4bpp) : ARRAY_SIZE(cache->dirty_8bpp);
+
+    for (uint16_t i = 0; i < words; i++)
+    {
+        while (dirty[i])
+        {
+            decode_cached_tile(ppu, bpp, i * 64 + __builtin_ctzll(dirty[i]));
+        }
+    }
+}
+
+// the decoded rows of the tile at addr (word addr, aligned to the tile size)
+static const uint64_t* cached_tile(struct SNES_Ppu* ppu, uint8_t bpp, uint16_t addr)
+{
+    struct SNES_PpuTileCache* cache = &ppu->tile_cache;
+    uint64_t* rows;
+    uint64_t dirty;
+    uint16_t tile;
+
+    switch (bpp)
+    {
+        case 2:
+            tile = addr >> 3;
+            rows = cache->tiles_2bpp[tile];
+            dirty = cache->dirty_2bpp[tile >> 6];
+            break;
+
+        case 4:
+            tile = addr >> 4;
+            rows = cache->tiles_4bpp[tile];
+            dirty = cache->dirty_4bpp[tile >> 6];
+            break;
+
+        default:
+            tile = addr >> 5;
+            rows = cache->tiles_8bpp[tile];
+            dirty = cache->dirty_8bpp[tile >> 6];
+            break;
+    }
+
+    if (dirty & (1ULL << (tile & 63)))
+    {
+        decode_cached_tile(ppu, bpp, tile);
+    }
+
+    return rows;
+}
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppubgcontrol
+static uint16_t map_entry_addr(const struct SNES_PpuBg* bg, uint16_t tx, uint16_t ty)
+{
+    uint16_t addr = bg->map_addr + ((ty & 31) << 5) + (tx & 31);
+
+    if ((bg->map_size & 1) && (tx & 32))
+    {
+        addr += 0x400;
+    }
+
+    if ((bg->map_size & 2) && (ty & 32))
+    {
+        addr += (bg->map_size & 1) ? 0x800 : 0x400;
+    }
+
+    return addr & 0x7FFF;
+}
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppuoffsetpertilemode
+// in modes 2, 4 and 6 every column of bg1 / bg2 after the first can take
+// its scroll from the bg3 map. the row at BG3VOFS has the horizontal
+// scroll of each column and the row below it the vertical, bit 13 / 14
+// enables an entry for bg1 / bg2. mode 4 only has the first row, with
+// bit 15 picking which scroll an entry is for. only the coarse part of
+// the horizontal scroll is replaced, the fine scroll stays.
+static void offset_per_tile(const struct SNES_Ppu* ppu, const struct SNES_PpuRegs* regs, uint8_t index, uint16_t column, uint16_t* hofs, uint16_t* vofs)
+{
+    const struct SNES_PpuBg* bg3 = &regs->bg[2];
+    const uint8_t shift = (regs->bg_big_tiles & 4) ? 4 : 3;
+    const uint16_t x = (column - 1) * 8 + (bg3->hofs & ~7);
+    const uint16_t valid = 0x2000 << index;
+    const uint16_t h = ppu->vram[map_entry_addr(bg3, x >> shift, bg3->vofs >> shift)];
+
+    if (regs->bg_mode == 4)
+    {
+        if (h & valid)
+        {
+            if (h & 0x8000)
+            {
+                *vofs = h & 0x3FF;
+            }
+            else
+            {
+                *hofs = (h & 0x3F8) | (*hofs & 7);
+            }
+        }
+
+        return;
+    }
+
+    const uint16_t v = ppu->vram[map_entry_addr(bg3, x >> shift, (bg3->vofs + 8) >> shift)];
+
+    if (h & valid)
+    {
+        *hofs = (h & 0x3F8) | (*hofs & 7);
+    }
+
+    if (v & valid)
+    {
+        *vofs = v & 0x3FF;
+    }
+}
+
+static void fetch_chunks(struct SNES_Ppu* ppu, const struct SNES_PpuRegs* regs, uint8_t index, uint8_t bpp, uint8_t palette_base, uint16_t line, bool hires, uint8_t count, struct BgChunks* chunks)
+{
+    const struct SNES_PpuBg* bg = &regs->bg[index];
+    const bool big = regs->bg_big_tiles & (1 << index);
+    const bool opt = (regs->bg_mode == 2 || regs->bg_mode == 4 || regs->bg_mode == 6) && index < 2;
+    // hi-res tiles are always 16 pixels wide
+    const uint8_t w_shift = (big || hires) ? 4 : 3;
+    const uint8_t h_shift = big ? 4 : 3;
+    const uint8_t scale = hires ? 2 : 1;
+    const uint16_t x_start = (bg->hofs * scale) & ~7;
+    // a column of offset per tile is 8 pixels of the 256 wide line
+    const uint8_t column_width = 8 * scale;
+
+    for (uint8_t c = 0; c < count; c++)
+    {
+        const uint16_t screen_column = ((x_start % column_width) + c * 8) / column_width;
+        uint16_t hofs = bg->hofs;
+        uint16_t vofs = bg->vofs;
+
+        if (opt && screen_column)
+        {
+            offset_per_tile(ppu, regs, index, screen_column, &hofs, &vofs);
+        }
+
+        // the chunk keeps its place in the column, only the scroll changes
+        const uint16_t x = ((hofs * scale) & ~(column_width - 1)) + screen_column * column_width + ((x_start + c * 8) % column_width);
+        const uint16_t y = line + vofs;
+        const uint16_t entry = ppu->vram[map_entry_addr(bg, x >> w_shift, y >> h_shift)];
+        const bool hflip = entry & 0x4000;
+        const bool vflip = entry & 0x8000;
+        uint16_t row = y & ((1 << h_shift) - 1);
+        uint16_t column = (x >> 3) & ((1 << (w_shift - 3)) - 1);
+
+        if (vflip)
+        {
+            row = ((1 << h_shift) - 1) - row;
+        }
+
+        if (hflip)
+        {
+            column = ((1 << (w_shift - 3)) - 1) - column;
+        }
+
+        // the 8x8 tiles of a 16x16 tile are next to each other, 16 per row
+        const uint16_t tile = ((entry & 0x3FF) + (row >> 3) * 16 + column) & 0x3FF;
+        const uint64_t pixels = cached_tile(ppu, bpp, (bg->tile_addr + tile * bpp * 4) & 0x7FFF)[row & 7];
+
+        chunks->pixels[c] = hflip ? flip_row(pixels) : pixels;
+        chunks->palette[c] = palette_base + (bpp == 8 ? 0 : ((entry >> 10) & 7) << bpp);
+        chunks->priority[c] = (entry >> 13) & 1;
+        chunks->direct[c] = (entry >> 10) & 7;
+    }
+}
+
+// adds the palette to the opaque pixels. count is rounded up to the
+// simd step, so chunks must have that many fetched and out must be
+// large enough.
+static void apply_palette(const struct BgChunks* chunks, uint8_t count, uint8_t* out)
+{
+#if PPU_SIMD_WIDTH == 32
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (uint8_t c = 0; c < count; c += 4, out += 32)
+    {
+        const uint8_t* pal = chunks->palette + c;
+        const __m256i pixels = _mm256_loadu_si256((const void*)(chunks->pixels + c));
+        const __m256i base = _mm256_set_epi64x(
+            (long long)splat(pal[3]), (long long)splat(pal[2]),
+            (long long)splat(pal[1]), (long long)splat(pal[0]));
+        const __m256i transparent = _mm256_cmpeq_epi8(pixels, zero);
+
+        _mm256_storeu_si256((void*)out, _mm256_andnot_si256(transparent, _mm256_add_epi8(pixels, base)));
+    }
+#elif PPU_SIMD_WIDTH == 16
+    const __m128i zero = _mm_setzero_si128();
+
+    for (uint8_t c = 0; c < count; c += 2, out += 16)
+    {
+        const uint8_t* pal = chunks->palette + c;
+        const __m128i pixels = _mm_loadu_si128((const void*)(chunks->pixels + c));
+        const __m128i base = _mm_set_epi64x((long long)splat(pal[1]), (long long)splat(pal[0]));
+        const __m128i transparent = _mm_cmpeq_epi8(pixels, zero);
+
+        _mm_storeu_si128((void*)out, _mm_andnot_si128(transparent, _mm_add_epi8(pixels, base)));
+    }
+#else
+    for (uint8_t c = 0; c < count; c++, out += 8)
+    {
+        memcpy(out, &chunks->pixels[c], 8);
+
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            out[i] = out[i] ? out[i] + chunks->palette[c] : 0;
+        }
+    }
+#endif
+}
+
+// hi-res lines are twice as wide, the odd pixels are shown on the main
+// screen (out) and the even ones on the sub screen (even).
+static void render_bg(struct SNES_Ppu* ppu, const struct SNES_PpuRegs* regs, uint8_t index, uint8_t bpp, uint8_t palette_base, uint16_t line, struct BgLine* out, struct BgLine* even)
+{
+    const bool hires = regs->bg_mode == 5 || regs->bg_mode == 6;
+    const uint8_t count = hires ? BG_CHUNKS_HIRES : BG_CHUNKS;
+    const uint16_t fine = (hires ? regs->bg[index].hofs << 1 : regs->bg[index].hofs) & 7;
+    struct BgChunks chunks;
+    uint8_t pixels[BG_CHUNKS_MAX * 8];
+
+    // the padding is fetched as well, so the simd steps don't read garbage
+    fetch_chunks(ppu, regs, index, bpp, palette_base, line, hires, (count + 3) & ~3, &chunks);
+    apply_palette(&chunks, count, pixels);
+
+    if (!hires)
+    {
+        for (uint16_t x = 0; x < SNES_PPU_WIDTH; x++)
+        {
+            out->index[x] = pixels[fine + x];
+            out->priority[x] = chunks.priority[(fine + x) >> 3];
+        }
+
+        if (bpp == 8 && regs->math.direct_colour)
+        {
+            for (uint16_t x = 0; x < SNES_PPU_WIDTH; x++)
+            {
+                out->direct[x] = chunks.direct[(fine + x) >> 3];
+            }
+        }
+
+        return;
+    }
+
+    for (uint16_t x = 0; x < SNES_PPU_WIDTH; x++)
+    {
+        const uint16_t sx = fine + x * 2;
+
+        even->index[x] = pixels[sx];
+        even->priority[x] = chunks.priority[sx >> 3];
+        out->index[x] = pixels[sx + 1];
+        out->priority[x] = chunks.priority[(sx + 1) >> 3];
+    }
+}
+
+// NOTE: the sprites on a line are found through ppu.obj_lines, a bit per
+// sprite for each of the 256 lines a sprite can be on. an oam write only
+// moves the sprites whose y or height it changed, so a line just walks the
+// set bits, in priority order from the first sprite (rotation). like the
+// real thing, only the first 32 sprites on a line are taken and only 34
+// of their 8 pixel slivers are drawn, starting from the last sprite.
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppuspritesobjs
+enum
+{
+    OBJ_LINE_MAX = 32, // sprites per line
+    OBJ_SLIVER_MAX = 34, // 8 pixel slivers per line
+};
+
+// the width / height of the small and large sprites of each OBSEL size
+static const uint8_t OBJ_SIZES[8][2][2] =
+{
+    [0] = { { 8, 8 }, { 16, 16 } },
+    [1] = { { 8, 8 }, { 32, 32 } },
+    [2] = { { 8, 8 }, { 64, 64 } },
+    [3] = { { 16, 16 }, { 32, 32 } },
+    [4] = { { 16, 16 }, { 64, 64 } },
+    [5] = { { 32, 32 }, { 64, 64 } },
+    [6] = { { 16, 32 }, { 32, 64 } },
+    [7] = { { 16, 32 }, { 32, 32 } },
+};
+
+// an oam entry, unpacked
+struct Obj
+{
+    uint16_t x; // 9-bit, 256-511 are left of the screen
+    uint8_t y;
+    uint16_t tile; // 9-bit
+    uint8_t attr; // vflip, hflip, priority (2 bits), palette (3 bits), tile bit 8
+    bool large;
+};
+
+static struct Obj get_obj(const struct SNES_Ppu* ppu, uint8_t index)
+{
+    const uint8_t* entry = ppu->oam + index * 4;
+    const uint8_t high = ppu->oam[0x200 + (index >> 2)] >> ((index & 3) * 2);
+
+    return (struct Obj)
+    {
+        .x = entry[0] | ((high & 1) << 8),
+        .y = entry[1],
+        .tile = entry[2] | ((entry[3] & 1) << 8),
+        .attr = entry[3],
+        .large = high & 2,
+    };
+}
+
+// moves the sprite to the lines it's now on, if they changed
+static void update_obj_lines(struct SNES_Ppu* ppu, uint8_t index)
+{
+    struct SNES_PpuObjLines* lines = &ppu->obj_lines;
+    const struct Obj obj = get_obj(ppu, index);
+    const uint8_t height = OBJ_SIZES[lines->size][obj.large][1];
+    const uint64_t bit = 1ULL << (index & 63);
+
+    if (lines->y[index] == obj.y && lines->height[index] == height)
+    {
+        return;
+    }
+
+    for (uint8_t row = 0; row < lines->height[index]; row++)
+    {
+        lines->sprites[(uint8_t)(lines->y[index] + row)][index >> 6] &= ~bit;
+    }
+
+    for (uint8_t row = 0; row < height; row++)
+    {
+        lines->sprites[(uint8_t)(obj.y + row)][index >> 6] |= bit;
+    }
+
+    lines->y[index] = obj.y;
+    lines->height[index] = height;
+}
+
+// the heights come from OBSEL, so a new size moves every sprite
+static void set_obj_size(struct SNES_Ppu* ppu, uint8_t size)
+{
+    ppu->obj_lines.size = size;
+
+    for (uint8_t i = 0; i < SNES_PPU_OBJS; i++)
+    {
+        update_obj_lines(ppu, i);
+    }
+}
+
+void snes_ppu_on_oam_write(struct SNES_Ppu* ppu, uint16_t addr, uint16_t bytes)
+{
+    const uint16_t last = addr + bytes - 1;
+
+    if (!bytes)
+    {
+        return;
+    }
+
+    // 4 bytes of the low table per sprite
+    for (uint16_t i = addr >> 2; i < SNES_PPU_OBJS && i <= last >> 2; i++)
+    {
+        update_obj_lines(ppu, i);
+    }
+
+    // and 2 bits of a high table byte
+    for (uint16_t b = addr > 0x200 ? addr : 0x200; b <= last; b++)
+    {
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            update_obj_lines(ppu, ((b & 0x1F) << 2) | i);
+        }
+    }
+
+#if SNES_PPU_THREAD
+    if (ppu->thread)
+    {
+        snes_ppu_thread_push_oam(ppu, addr, bytes);
+    }
+#endif
+}
+
+// the bits of sprites first-127 in word w of a line's sprites
+static uint64_t obj_bits_from(uint8_t first, uint8_t w)
+{
+    const int16_t shift = first - w * 64;
+
+    return shift <= 0 ? ~0ULL : shift >= 64 ? 0 : ~0ULL << shift;
+}
+
+// the sprites on row (at most OBJ_LINE_MAX), in priority order
+static uint8_t obj_line_list(const struct SNES_Ppu* ppu, const struct SNES_PpuObj* regs, uint8_t row, uint8_t list[OBJ_LINE_MAX])
+{
+    const uint64_t* sprites = ppu->obj_lines.sprites[row];
+    uint8_t count = 0;
+
+    // first to 127, then 0 to first
+    for (uint8_t pass = 0; pass < 2; pass++)
+    {
+        for (uint8_t w = 0; w < SNES_PPU_OBJS / 64; w++)
+        {
+            const uint64_t from = obj_bits_from(regs->first, w);
+            uint64_t bits = sprites[w] & (pass ? ~from : from);
+
+            while (bits)
+            {
+                const uint8_t index = w * 64 + __builtin_ctzll(bits);
+                const struct Obj obj = get_obj(ppu, index);
+                const uint8_t width = OBJ_SIZES[regs->size][obj.large][0];
+
+                bits &= bits - 1;
+
+                // entirely left of the screen, though 256 still counts
+                if (obj.x > 256 && obj.x + width <= 512)
+                {
+                    continue;
+                }
+
+                list[count++] = index;
+
+                if (count == OBJ_LINE_MAX)
+                {
+                    return count;
+                }
+            }
+        }
+    }
+
+    return count;
+}
+
+static void render_objs(struct SNES_Ppu* ppu, const struct SNES_PpuObj* regs, uint16_t line, struct BgLine* out)
+{
+    const uint8_t row = line - SNES_PPU_FIRST_LINE;
+    uint8_t list[OBJ_LINE_MAX];
+    const uint8_t count = obj_line_list(ppu, regs, row, list);
+    uint8_t slivers = 0;
+
+    memset(out, 0, sizeof(*out));
+
+    // the last sprite first, so the ones before it are drawn over it
+    for (uint8_t n = count; n--;)
+    {
+        const struct Obj obj = get_obj(ppu, list[n]);
+        const uint8_t width = OBJ_SIZES[regs->size][obj.large][0];
+        const uint8_t height = OBJ_SIZES[regs->size][obj.large][1];
+        const bool hflip = obj.attr & 0x40;
+        const uint8_t palette = 128 + ((obj.attr >> 1) & 7) * 16;
+        const uint8_t priority = (obj.attr >> 4) & 3;
+        uint8_t y = row - obj.y;
+
+        if (obj.attr & 0x80)
+        {
+            y = height - 1 - y;
+        }
+
+        for (uint8_t t = 0; t < width / 8; t++)
+        {
+            const uint16_t sx = (obj.x + t * 8) & 511;
+
+            // slivers off the screen aren't fetched
+            if (obj.x != 256 && sx >= 256 && sx < 512 - 7)
+            {
+                continue;
+            }
+
+            if (slivers++ == OBJ_SLIVER_MAX)
+            {
+                return;
+            }
+
+            // the 8x8 tiles of a sprite are next to each other, 16 per row
+            const uint8_t column = hflip ? width / 8 - 1 - t : t;
+            const uint16_t tile = (obj.tile & 0x100) | ((((obj.tile >> 4) + (y >> 3)) & 0xF) << 4) | ((obj.tile + column) & 0xF);
+            const uint16_t addr = (regs->tile_addr[tile >> 8] + (tile & 0xFF) * 16) & 0x7FFF;
+            const uint64_t pixels = cached_tile(ppu, 4, addr)[y & 7];
+            const uint64_t flipped = hflip ? flip_row(pixels) : pixels;
+            uint8_t bytes[8];
+
+            memcpy(bytes, &flipped, sizeof(bytes));
+
+            for (uint8_t p = 0; p < 8; p++)
+            {
+                const uint16_t x = (sx + p) & 511;
+
+                if (x < SNES_PPU_WIDTH && bytes[p])
+                {
+                    out->index[x] = palette + bytes[p];
+                    out->priority[x] = priority;
+                }
+            }
+        }
+    }
+}
+
+// NOTE: mode 7 is a single 1024x1024 bg, a 128x128 map of 8x8 tiles in
+// the low bytes of vram and 256 8bpp tiles with a byte per pixel in the
+// high bytes. the screen is mapped onto it by the matrix (a b / c d) around
+// the centre (x, y). the start of the line is set up from the registers
+// once per line (hdma may have changed them), after which each pixel is
+// just a step of (a, c) across the bg. with avx2, 8 pixels are stepped at
+// a time and their map / tile bytes are fetched with gathers.
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppurotationscalingmode7
+static int32_t mode7_clip(int32_t n)
+{
+    return (n & 0x2000) ? (n | ~1023) : (n & 1023);
+}
+
+static void render_mode7(const struct SNES_Ppu* ppu, const struct SNES_PpuMode7* m7, uint16_t line, struct BgLine* out)
+{
+    const int32_t y = m7->vflip ? 255 - line : line;
+    const int32_t ox = mode7_clip(m7->hofs - m7->x);
+    const int32_t oy = mode7_clip(m7->vofs - m7->y);
+    // the bg position of the first pixel and the step per pixel, 8-bit fraction
+    int32_t px = ((m7->a * ox) & ~63) + ((m7->b * oy) & ~63) + ((m7->b * y) & ~63) + m7->x * 256;
+    int32_t py = ((m7->c * ox) & ~63) + ((m7->d * oy) & ~63) + ((m7->d * y) & ~63) + m7->y * 256;
+    int32_t dx = m7->a;
+    int32_t dy = m7->c;
+
+    if (m7->hflip)
+    {
+        px += dx * 255;
+        py += dy * 255;
+        dx = -dx;
+        dy = -dy;
+    }
+
+    // bg1 has a single priority in mode 7, and no palette for direct colour
+    memset(out->priority, 0, sizeof(out->priority));
+    memset(out->direct, 0, sizeof(out->direct));
+
+#if PPU_SIMD_WIDTH == 32
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i step_x = _mm256_set1_epi32(dx * 8);
+    const __m256i step_y = _mm256_set1_epi32(dy * 8);
+    const __m256i wrap = _mm256_set1_epi32(1023);
+    const __m256i fine = _mm256_set1_epi32(7);
+    const __m256i low_byte = _mm256_set1_epi32(0xFF);
+    const __m256i zero = _mm256_setzero_si256();
+    // all set where outside the map is tile 0 / transparent
+    const __m256i fill = _mm256_set1_epi32(m7->screen_over == 3 ? -1 : 0);
+    const __m256i clear = _mm256_set1_epi32(m7->screen_over == 2 ? -1 : 0);
+    // the low byte of each 32-bit lane, to the start of each 128-bit half
+    const __m256i pack = _mm256_setr_epi8(
+        0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    // words are gathered as the low half of 32-bit reads, which never go
+    // past vram as neither the map nor the tiles use its top half
+    const void* vram = ppu->vram;
+    __m256i vx = _mm256_add_epi32(_mm256_set1_epi32(px), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dx)));
+    __m256i vy = _mm256_add_epi32(_mm256_set1_epi32(py), _mm256_mullo_epi32(lane, _mm256_set1_epi32(dy)));
+
+    for (uint16_t x = 0; x < SNES_PPU_WIDTH; x += 8)
+    {
+        const __m256i tx = _mm256_srai_epi32(vx, 8);
+        const __m256i ty = _mm256_srai_epi32(vy, 8);
+        const __m256i inside = _mm256_cmpeq_epi32(_mm256_andnot_si256(wrap, _mm256_or_si256(tx, ty)), zero);
+        const __m256i wx = _mm256_and_si256(tx, wrap);
+        const __m256i wy = _mm256_and_si256(ty, wrap);
+        const __m256i map = _mm256_or_si256(_mm256_slli_epi32(_mm256_srli_epi32(wy, 3), 7), _mm256_srli_epi32(wx, 3));
+        __m256i tile = _mm256_and_si256(_mm256_i32gather_epi32(vram, map, 2), low_byte);
+
+        tile = _mm256_andnot_si256(_mm256_andnot_si256(inside, fill), tile);
+
+        const __m256i chr = _mm256_or_si256(_mm256_slli_epi32(tile, 6),
+            _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(wy, fine), 3), _mm256_and_si256(wx, fine)));
+        __m256i pixels = _mm256_and_si256(_mm256_srli_epi32(_mm256_i32gather_epi32(vram, chr, 2), 8), low_byte);
+
+        pixels = _mm256_shuffle_epi8(_mm256_andnot_si256(_mm256_andnot_si256(inside, clear), pixels), pack);
+
+        const uint32_t lo = (uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(pixels));
+        const uint32_t hi = (uint32_t)_mm_cvtsi128_si32(_mm256_extracti128_si256(pixels, 1));
+
+        memcpy(out->index + x + 0, &lo, sizeof(lo));
+        memcpy(out->index + x + 4, &hi, sizeof(hi));
+        vx = _mm256_add_epi32(vx, step_x);
+        vy = _mm256_add_epi32(vy, step_y);
+    }
+#else
+    for (uint16_t x = 0; x < SNES_PPU_WIDTH; x++, px += dx, py += dy)
+    {
+        const int32_t tx = px >> 8;
+        const int32_t ty = py >> 8;
+        const bool outside = (tx | ty) & ~1023;
+        const uint16_t map = (((ty & 1023) >> 3) << 7) | ((tx & 1023) >> 3);
+        const uint8_t tile = outside && m7->screen_over == 3 ? 0 : ppu->vram[map] & 0xFF;
+        const uint8_t pixel = ppu->vram[(tile << 6) | ((ty & 7) << 3) | (tx & 7)] >> 8;
+
+        out->index[x] = outside && m7->screen_over == 2 ? 0 : pixel;
+    }
+#endif
+}
+
+// with EXTBG, bg2 is the same pixels as bg1, but bit 7 is the priority
+static void render_extbg(const struct BgLine* bg1, struct BgLine* out)
+{
+    for (uint16_t x = 0; x < SNES_PPU_WIDTH; x++)
+    {
+        out->index[x] = bg1->index[x] & 0x7F;
+        out->priority[x] = bg1->index[x] >> 7;
+    }
+}
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppucolorpalettememorycgramandgraphicsrendering
+// direct colour pixels are BBGGGRRR, the top bits of each channel. the
+// tile's palette bits (PPP, 0 in mode 7) are the next bit of each.
+static uint16_t pixel_colour(const struct SNES_Ppu* ppu, bool direct, const struct BgLine* bg1, uint16_t x, uint8_t index, uint8_t source)
+{
+    if (direct && source == SNES_PpuLayer_BG1)
+    {
+        const uint8_t ppp = bg1->direct[x];
+
+        return ((index & 0x07) << 2) | ((index & 0x38) << 4) | ((index & 0xC0) << 7)
+            | ((ppp & 1) << 1) | ((ppp & 2) << 5) | ((ppp & 4) << 10);
+    }
+
+    return ppu->cgram[index];
+}
+
+// NOTE: lines are output in the host pixel format straight from
+// ppu.palette, cgram already converted with the master brightness
+// applied. a cgram write converts its one entry, only a brightness or
+// pixel format change converts all 256. lines with colour math or direct
+// colour are BGR555 instead, and go out through ppu.colour_lut.
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppucolorpalettememorycgramandgraphicsrendering
+static uint32_t pack_colour(enum SNES_PixelFormat format, uint8_t r, uint8_t g, uint8_t b)
+{
+    switch (format)
+    {
+        case SNES_PixelFormat_RGB565:
+            return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+
+        case SNES_PixelFormat_XRGB8888:
+            break;
+    }
+
+    return (r << 16) | (g << 8) | b;
+}
+
+static void build_colour_lut(struct SNES_Ppu* ppu)
+{
+    for (uint8_t brightness = 0; brightness < 16; brightness++)
+    {
+        const uint8_t* level = ppu->brightness_levels[brightness];
+        struct SNES_PpuColourLut* lut = &ppu->colour_lut[brightness];
+
+        for (uint16_t i = 0; i < ARRAY_SIZE(lut->rg); i++)
+        {
+            lut->rg[i] = pack_colour(ppu->pixel_format, level[i & 0x1F], level[i >> 5], 0);
+        }
+
+        for (uint8_t i = 0; i < ARRAY_SIZE(lut->b); i++)
+        {
+            lut->b[i] = pack_colour(ppu->pixel_format, 0, 0, level[i]);
+        }
+    }
+}
+
+static uint32_t host_colour(const struct SNES_Ppu* ppu, uint8_t brightness, uint16_t bgr555)
+{
+    const struct SNES_PpuColourLut* lut = &ppu->colour_lut[brightness];
+
+    return lut->rg[bgr555 & 0x3FF] | lut->b[(bgr555 >> 10) & 0x1F];
+}
+
+static void convert_palette(const struct SNES_Ppu* ppu, struct SNES_PpuPalette* palette)
+{
+    for (uint16_t i = 0; i < ARRAY_SIZE(palette->colours); i++)
+    {
+        palette->colours[i] = host_colour(ppu, palette->brightness, ppu->cgram[i]);
+    }
+}
+
+void snes_ppu_on_cgram_write(struct SNES_Ppu* ppu, uint8_t index)
+{
+    ppu->palette.colours[index] = host_colour(ppu, ppu->palette.brightness, ppu->cgram[index]);
+
+#if SNES_PPU_THREAD
+    if (ppu->thread)
+    {
+        snes_ppu_thread_push_cgram(ppu, index);
+    }
+#endif
+}
+
+void snes_ppu_update_palette(struct SNES_Ppu* ppu)
+{
+    build_colour_lut(ppu);
+    convert_palette(ppu, &ppu->palette);
+}
+
+static void set_brightness(const struct SNES_Ppu* ppu, struct SNES_PpuPalette* palette, uint8_t brightness)
+{
+    if (palette->brightness != brightness)
+    {
+        palette->brightness = brightness;
+        convert_palette(ppu, palette);
+    }
+}
+
+static void output_line(struct SNES_Ppu* ppu, const struct SNES_PpuPalette* palette, uint16_t row, const uint8_t* index)
+{
+    switch (ppu->pixel_format)
+    {
+        case SNES_PixelFormat_RGB565:
+            for (uint16_t x = 0; x < SNES_PPU_WIDTH; x++)
+            {
+                ppu->pixels.rgb565[row][x] = palette->colours[index[x]];
+            }
+            break;
+
+        case SNES_PixelFormat_XRGB8888:
+            for (uint16_t x = 0; x < SNES_PPU_WIDTH; x++)
+            {
+                ppu->pixels.xrgb8888[row][x] = palette->colours[index[x]];
+            }
+            break;
+    }
+}
+
+// NOTE: the main and sub screens are composited a layer at a time over
+// the whole line. the opaque pixels of a layer with the priority being
+// drawn, where its window doesn't hide it, are selected over what's behind
+// them with simd compares and masks. the windows are 256-bit masks per
+// layer, built from the 2 spans and combined with the WBGLOG / WOBJLOG op.
+// colour math then runs on BGR555 lines, a channel at a time in 16-bit
+// lanes, but only on lines that use it. the rest go out through the
+// cached palette.
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppuwindow
+static void window_span(uint8_t left, uint8_t right, uint64_t mask[SNES_PPU_WIDTH / 64])
+{
+    for (uint16_t w = 0; w < SNES_PPU_WIDTH / 64; w++)
+    {
+        const uint16_t start = w * 64;
+        const uint16_t lo = left > start ? left : start;
+        const uint16_t hi = right < start + 63u ? right : start + 63u;
+
+        mask[w] = lo <= hi ? (~0ULL >> (63u - (hi - lo))) << (lo - start) : 0;
+    }
+}
+
+// the pixels the layer's window covers, as a byte per pixel (0xFF inside)
+static void layer_window(const struct SNES_PpuWindows* windows, const uint64_t spans[2][SNES_PPU_WIDTH / 64], uint8_t layer, uint8_t* out)
+{
+    const uint8_t select = windows->select[layer];
+    const uint64_t invert1 = (select & 1) ? ~0ULL : 0;
+    const uint64_t invert2 = (select & 4) ? ~0ULL : 0;
+
+    for (uint8_t w = 0; w < SNES_PPU_WIDTH / 64; w++)
+    {
+        const uint64_t a = spans[0][w] ^ invert1;
+        const uint64_t b = spans[1][w] ^ invert2;
+        uint64_t mask;
+
+        switch (select & 0xA)
+        {
+            case 0x0: mask = 0; break;
+            case 0x2: mask = a; break;
+            case 0x8: mask = b; break;
+            default:
+                switch (windows->logic[layer])
+                {
+                    case 0: mask = a | b; break;
+                    case 1: mask = a & b; break;
+                    case 2: mask = a ^ b; break;
+                    default: mask = ~(a ^ b); break;
+                }
+                break;
+        }
+
+        for (uint8_t i = 0; i < 64; i++)
+        {
+            out[w * 64 + i] = (mask >> i) & 1 ? 0xFF : 0;
+        }
+    }
+}
+
+// the opaque pixels of src with priority, where shown (if not NULL), are
+// taken over index / source
+static void select_layer(const struct BgLine* src, uint8_t priority, const uint8_t* shown, uint8_t layer, uint8_t* index, uint8_t* source)
+{
+#if PPU_SIMD_WIDTH == 32
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i prio = _mm256_set1_epi8((char)priority);
+    const __m256i id = _mm256_set1_epi8((char)layer);
+
+    for (uint16_t x = 0; x < SNES_PPU_WIDTH; x += 32)
+    {
+        const __m256i pixels = _mm256_loadu_si256((const void*)(src->index + x));
+        const __m256i same = _mm256_cmpeq_epi8(_mm256_loadu_si256((const void*)(src->priority + x)), prio);
+        __m256i take = _mm256_andnot_si256(_mm256_cmpeq_epi8(pixels, zero), same);
+
+        if (shown)
+        {
+            take = _mm256_and_si256(take, _mm256_loadu_si256((const void*)(shown + x)));
+        }
+
+        const __m256i old_index = _mm256_loadu_si256((const void*)(index + x));
+        const __m256i old_source = _mm256_loadu_si256((const void*)(source + x));
+
+        _mm256_storeu_si256((void*)(index + x), _mm256_or_si256(_mm256_and_si256(take, pixels), _mm256_andnot_si256(take, old_index)));
+        _mm256_storeu_si256((void*)(source + x), _mm256_or_si256(_mm256_and_si256(take, id), _mm256_andnot_si256(take, old_source)));
+    }
+#elif PPU_SIMD_WIDTH == 16
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i prio = _mm_set1_epi8((char)priority);
+    const __m128i id = _mm_set1_epi8((char)layer);
+
+    for (uint16_t x = 0; x < SNES_PPU_WIDTH; x += 16)
+    {
+        const __m128i pixels = _mm_loadu_si128((const void*)(src->index + x));
+        const __m128i same = _mm_cmpeq_epi8(_mm_loadu_si128((const void*)(src->priority + x)), prio);
+        __m128i take = _mm_andnot_si128(_mm_cmpeq_epi8(pixels, zero), same);
+
+        if (shown)
+        {
+            take = _mm_and_si128(take, _mm_loadu_si128((const void*)(shown + x)));
+        }
+
+        const __m128i old_index = _mm_loadu_si128((const void*)(index + x));
+        const __m128i old_source = _mm_loadu_si128((const void*)(source + x));
+
+        _mm_storeu_si128((void*)(index + x), _mm_or_si128(_mm_and_si128(take, pixels), _mm_andnot_si128(take, old_index)));
+        _mm_storeu_si128((void*)(source + x), _mm_or_si128(_mm_and_si128(take, id), _mm_andnot_si128(take, old_source)));
+    }
+#else
+    for (uint16_t x = 0; x < SNES_PPU_WIDTH; x++)
+    {
+        const bool take = src->index[x] && src->priority[x] == priority && (!shown || shown[x]);
+
+        index[x] = take ? src->index[x] : index[x];
+        source[x] = take ? layer : source[x];
+    }
+#endif
+}
+
+// composites the layers of a screen back to front, each opaque pixel
+// covers what's behind it. index 0 (source backdrop) is the backdrop.
+// windowed layers are only drawn where shown[layer] is set.
+static void composite(const struct BgLine* bgs, const struct BgLine* objs, uint8_t layers, uint8_t screen, uint8_t windowed,
+    const uint8_t shown[SNES_PpuLayer_OBJ + 1][SNES_PPU_WIDTH], uint8_t* index, uint8_t* source)
+{
+    memset(index, 0, SNES_PPU_WIDTH);
+    memset(source, SNES_PpuLayer_BACKDROP, SNES_PPU_WIDTH);
+
+    for (uint8_t i = LAYER_COUNT[layers]; i--;)
+    {
+        const uint8_t layer = LAYERS[layers][i];
+        const uint8_t id = layer >= LAYER_OBJ ? SNES_PpuLayer_OBJ : layer >> 1;
+        const struct BgLine* src = layer >= LAYER_OBJ ? objs : &bgs[id];
+        const uint8_t priority = layer >= LAYER_OBJ ? layer - LAYER_OBJ : layer & 1;
+
+        if (screen & (1 << id))
+        {
+            select_layer(src, priority, (windowed & (1 << id)) ? shown[id] : NULL, id, index, source);
+        }
+    }
+}
+
+// where a CGWSEL setting applies, given if the pixel is in the colour window
+static bool in_region(uint8_t setting, bool inside)
+{
+    return setting == 3 || (setting == 1 && !inside) || (setting == 2 && inside);
+}
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppucolormathematics
+// main + / - sub per channel, clamped or halved, where math is set
+static void blend_line(const uint16_t* main, const uint16_t* sub, const uint16_t* math, const uint16_t* half, bool subtract, uint16_t* out)
+{
+#if PPU_SIMD_WIDTH == 32
+    const __m256i channel = _mm256_set1_epi16(0x1F);
+
+    for (uint16_t x = 0; x < SNES_PPU_WIDTH; x += 16)
+    {
+        const __m256i m = _mm256_loadu_si256((const void*)(main + x));
+        const __m256i s = _mm256_loadu_si256((const void*)(sub + x));
+        const __m256i halve = _mm256_loadu_si256((const void*)(half + x));
+        const __m256i on = _mm256_loadu_si256((const void*)(math + x));
+        __m256i result = _mm256_setzero_si256();
+
+        for (uint8_t shift = 0; shift < 15; shift += 5)
+        {
+            const __m256i mc = _mm256_and_si256(_mm256_srli_epi16(m, shift), channel);
+            const __m256i sc = _mm256_and_si256(_mm256_srli_epi16(s, shift), channel);
+            const __m256i v = subtract ? _mm256_subs_epu16(mc, sc) : _mm256_add_epi16(mc, sc);
+            const __m256i c = _mm256_or_si256(_mm256_and_si256(halve, _mm256_srli_epi16(v, 1)), _mm256_andnot_si256(halve, _mm256_min_epi16(v, channel)));
+
+            result = _mm256_or_si256(result, _mm256_slli_epi16(c, shift));
+        }
+
+        _mm256_storeu_si256((void*)(out + x), _mm256_or_si256(_mm256_and_si256(on, result), _mm256_andnot_si256(on, m)));
+    }
+#elif PPU_SIMD_WIDTH == 16
+    const __m128i channel = _mm_set1_epi16(0x1F);
+
+    for (uint16_t x = 0; x < SNES_PPU_WIDTH; x += 8)
+    {
+        const __m128i m = _mm_loadu_si128((const void*)(main + x));
+        const __m128i s = _mm_loadu_si128((const void*)(sub + x));
+        const __m128i halve = _mm_loadu_si128((const void*)(half + x));
+        const __m128i on = _mm_loadu_si128((const void*)(math + x));
+        __m128i result = _mm_setzero_si128();
+
+        for (uint8_t shift = 0; shift < 15; shift += 5)
+        {
+            const __m128i mc = _mm_and_si128(_mm_srli_epi16(m, shift), channel);
+            const __m128i sc = _mm_and_si128(_mm_srli_epi16(s, shift), channel);
+            const __m128i v = subtract ? _mm_subs_epu16(mc, sc) : _mm_add_epi16(mc, sc);
+            const __m128i c = _mm_or_si128(_mm_and_si128(halve, _mm_srli_epi16(v, 1)), _mm_andnot_si128(halve, _mm_min_epi16(v, channel)));
+
+            result = _mm_or_si128(result, _mm_slli_epi16(c, shift));
+        }
+
+        _mm_storeu_si128((void*)(out + x), _mm_or_si128(_mm_and_si128(on, result), _mm_andnot_si128(on, m)));
+    }
+#else
+    for (uint16_t x = 0; x < SNES_PPU_WIDTH; x++)
+    {
+        uint16_t result = 0;
+
+        for (uint8_t shift = 0; shift < 15; shift += 5)
+        {
+            const int16_t mc = (main[x] >> shift) & 0x1F;
+            const int16_t sc = (sub[x] >> shift) & 0x1F;
+            int16_t v = subtract ? mc - sc : mc + sc;
+
+            v = v < 0 ? 0 : v;
+            v = half[x] ? v >> 1 : (v > 0x1F ? 0x1F : v);
+            result |= v << shift;
+        }
+
+        out[x] = math[x] ? result : main[x];
+    }
+#endif
+}
+
+static void output_colours(struct SNES_Ppu* ppu, const struct SNES_PpuPalette* palette, uint16_t row, const uint16_t* colours)
+{
+    const struct SNES_PpuColourLut* lut = &ppu->colour_lut[palette->brightness];
+
+    switch (ppu->pixel_format)
+    {
+        case SNES_PixelFormat_RGB565:
+            for (uint16_t x = 0; x < SNES_PPU_WIDTH; x++)
+            {
+                ppu->pixels.rgb565[row][x] = lut->rg[colours[x] & 0x3FF] | lut->b[(colours[x] >> 10) & 0x1F];
+            }
+            break;
+
+        case SNES_PixelFormat_XRGB8888:
+            for (uint16_t x = 0; x < SNES_PPU_WIDTH; x++)
+            {
+                ppu->pixels.xrgb8888[row][x] = lut->rg[colours[x] & 0x3FF] | lut->b[(colours[x] >> 10) & 0x1F];
+            }
+            break;
+    }
+}
+
+// hi-res lines are 512 pixels, the even ones from the sub screen and the
+// odd ones from the main screen. they're output at 256 wide, so every
+// pixel is the average of its two halves, in the host format. pseudo
+// hi-res is the same with the bgs at 256 wide.
+static void average_halves(struct SNES_Ppu* ppu, uint16_t row, const uint32_t* even)
+{
+    switch (ppu->pixel_format)
+    {
+        case SNES_PixelFormat_RGB565:
+            for (uint16_t x = 0; x < SNES_PPU_WIDTH; x++)
+            {
+                const uint16_t a = ppu->pixels.rgb565[row][x];
+                const uint16_t b = even[x];
+
+                ppu->pixels.rgb565[row][x] = (a & b) + (((a ^ b) & 0xF7DE) >> 1);
+            }
+            break;
+
+        case SNES_PixelFormat_XRGB8888:
+            for (uint16_t x = 0; x < SNES_PPU_WIDTH; x++)
+            {
+                const uint32_t a = ppu->pixels.xrgb8888[row][x];
+                const uint32_t b = even[x];
+
+                ppu->pixels.xrgb8888[row][x] = (a & b) + (((a ^ b) & 0xFEFEFE) >> 1);
+            }
+            break;
+    }
+}
+
+void snes_ppu_render_line(struct SNES_Ppu* ppu, const struct SNES_PpuRegs* regs, struct SNES_PpuPalette* palette, uint16_t line)
+{
+    const struct SNES_PpuColourMath* math = &regs->math;
+    const uint16_t row = line - SNES_PPU_FIRST_LINE;
+    const bool extbg = regs->bg_mode == 7 && regs->SETINI.extbg;
+    const uint8_t layers = regs->bg_mode == 1 && regs->bg3_priority ? 8 : extbg ? 9 : regs->bg_mode;
+    // 8bpp bg1 pixels are the colour instead of a cgram index
+    const bool direct = (regs->bg_mode == 3 || regs->bg_mode == 4 || regs->bg_mode == 7) && math->direct_colour;
+    // if colour math can apply anywhere on the line, and with the sub screen
+    const bool blend = math->prevent != 3 && (math->enable & 0x3F);
+    const bool sub = blend && math->add_sub_screen;
+    // the sub screen is also shown, on the even pixels of hi-res lines
+    const bool hires = regs->bg_mode == 5 || regs->bg_mode == 6;
+    const bool halves = hires || regs->SETINI.pseudo_hires;
+    const bool sub_shown = sub || halves;
+    const uint8_t screens = regs->main_screen | (sub_shown ? regs->sub_screen : 0);
+    const uint8_t windowed = (regs->main_screen & regs->main_window) | (sub_shown ? regs->sub_screen & regs->sub_window : 0);
+    const bool colour_window = (math->force_black == 1 || math->force_black == 2) || (blend && (math->prevent == 1 || math->prevent == 2));
+    struct BgLine bgs[4];
+    struct BgLine bgs_even[4];
+    struct BgLine objs;
+    uint8_t shown[SNES_PpuLayer_OBJ + 1][SNES_PPU_WIDTH];
+    uint8_t in_colour_window[SNES_PPU_WIDTH];
+    uint8_t main_index[SNES_PPU_WIDTH];
+    uint8_t main_source[SNES_PPU_WIDTH];
+    uint8_t sub_index[SNES_PPU_WIDTH];
+    uint8_t sub_source[SNES_PPU_WIDTH];
+    uint32_t even[SNES_PPU_WIDTH];
+
+    set_brightness(ppu, palette, regs->INIDISP.master_brightness);
+
+    // lines past 224 are only drawn with overscan, black is 0 in every format
+    const bool blank = regs->INIDISP.forced_blanking || (row >= SNES_PPU_HEIGHT_NORMAL && !regs->SETINI.overscan);
+
+    if (blank && ppu->pixel_format == SNES_PixelFormat_RGB565)
+    {
+        memset(ppu->pixels.rgb565[row], 0, sizeof(ppu->pixels.rgb565[row]));
+        return;
+    }
+
+    if (blank)
+    {
+        memset(ppu->pixels.xrgb8888[row], 0, sizeof(ppu->pixels.xrgb8888[row]));
+        return;
+    }
+
+    if (ppu->obj_lines.size != regs->obj.size)
+    {
+        set_obj_size(ppu, regs->obj.size);
+    }
+
+    if (screens & (1 << SNES_PpuLayer_OBJ))
+    {
+        render_objs(ppu, &regs->obj, line, &objs);
+    }
+
+    if (regs->bg_mode == 7 && (screens & ((1 << SNES_PpuLayer_BG1) | (extbg << SNES_PpuLayer_BG2))))
+    {
+        render_mode7(ppu, &regs->m7, line, &bgs[0]);
+
+        if (extbg)
+        {
+            render_extbg(&bgs[0], &bgs[1]);
+        }
+    }
+
+    // todo: mosaic
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        const uint8_t bpp = BG_BPP[regs->bg_mode][i];
+
+        if (bpp && (screens & (1 << i)))
+        {
+            render_bg(ppu, regs, i, bpp, regs->bg_mode == 0 ? i * 32 : 0, line, &bgs[i], &bgs_even[i]);
+        }
+    }
+
+    if (windowed || colour_window)
+    {
+        uint64_t spans[2][SNES_PPU_WIDTH / 64];
+
+        window_span(regs->windows.left[0], regs->windows.right[0], spans[0]);
+        window_span(regs->windows.left[1], regs->windows.right[1], spans[1]);
+
+        // shown is where the window isn't
+        for (uint8_t i = 0; i <= SNES_PpuLayer_OBJ; i++)
+        {
+            if (windowed & (1 << i))
+            {
+                layer_window(&regs->windows, spans, i, shown[i]);
+
+                for (uint16_t x = 0; x < SNES_PPU_WIDTH; x++)
+                {
+                    shown[i][x] = ~shown[i][x];
+                }
+            }
+        }
+
+        if (colour_window)
+        {
+            layer_window(&regs->windows, spans, SNES_PpuLayer_BACKDROP, in_colour_window);
+        }
+    }
+
+    composite(bgs, &objs, layers, regs->main_screen, regs->main_screen & regs->main_window, shown, main_index, main_source);
+
+    if (sub_shown)
+    {
+        composite(hires ? bgs_even : bgs, &objs, layers, regs->sub_screen, regs->sub_screen & regs->sub_window, shown, sub_index, sub_source);
+    }
+
+    if (!math->force_black && !blend && !direct)
+    {
+        output_line(ppu, palette, row, main_index);
+
+        if (halves)
+        {
+            // the sub screen's backdrop is the fixed colour
+            const uint32_t fixed = host_colour(ppu, palette->brightness, math->fixed_colour);
+
+            for (uint16_t x = 0; x < SNES_PPU_WIDTH; x++)
+            {
+                even[x] = sub_source[x] == SNES_PpuLayer_BACKDROP ? fixed : palette->colours[sub_index[x]];
+            }
+
+            average_halves(ppu, row, even);
+        }
+
+        return;
+    }
+
+    uint16_t main_colours[SNES_PPU_WIDTH];
+    uint16_t sub_colours[SNES_PPU_WIDTH];
+    uint16_t math_mask[SNES_PPU_WIDTH];
+    uint16_t half_mask[SNES_PPU_WIDTH];
+
+    for (uint16_t x = 0; x < SNES_PPU_WIDTH; x++)
+    {
+        const bool inside = colour_window && in_colour_window[x];
+        const bool black = in_region(math->force_black, inside);
+        const uint8_t source = main_source[x];
+        // sprites only with palettes 4-7
+        const bool enabled = (math->enable & (1 << source)) && !(source == SNES_PpuLayer_OBJ && main_index[x] < 192);
+        // the sub screen's backdrop is the fixed colour, which isn't halved
+        const bool fixed = !sub || sub_source[x] == SNES_PpuLayer_BACKDROP;
+
+        main_colours[x] = black ? 0 : pixel_colour(ppu, direct, &bgs[0], x, main_index[x], source);
+        sub_colours[x] = fixed ? math->fixed_colour : pixel_colour(ppu, direct, &bgs[0], x, sub_index[x], sub_source[x]);
+        math_mask[x] = enabled && !in_region(math->prevent, inside) ? 0xFFFF : 0;
+        half_mask[x] = math->half && !(sub && fixed) && !black ? 0xFFFF : 0;
+
+        if (halves)
+        {
+            even[x] = black ? 0 : host_colour(ppu, palette->brightness, sub_source[x] == SNES_PpuLayer_BACKDROP ? math->fixed_colour : pixel_colour(ppu, direct, &bgs[0], x, sub_index[x], sub_source[x]));
+        }
+    }
+
+    blend_line(main_colours, sub_colours, math_mask, half_mask, math->subtract, main_colours);
+    output_colours(ppu, palette, row, main_colours);
+
+    if (halves)
+    {
+        average_halves(ppu, row, even);
+    }
+}
+
+void snes_ppu_prepare_lines(struct SNES_Ppu* ppu, const struct SNES_PpuRegs* regs, uint16_t count)
+{
+    uint8_t depths = 0;
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        if (regs[i].INIDISP.forced_blanking)
+        {
+            continue;
+        }
+
+        for (uint8_t bg = 0; bg < 4; bg++)
+        {
+            depths |= BG_BPP[regs[i].bg_mode][bg];
+        }
+
+        // sprites are 4bpp and their lines are moved on a new size
+        depths |= 4;
+
+        if (ppu->obj_lines.size != regs[i].obj.size)
+        {
+            set_obj_size(ppu, regs[i].obj.size);
+        }
+    }
+
+    // the bit depths are 2, 4 and 8, so they're their own bits
+    for (uint8_t bpp = 2; bpp <= 8; bpp <<= 1)
+    {
+        if (depths & bpp)
+        {
+            refresh_tiles(ppu, bpp);
+        }
+    }
+}
+
+void snes_ppu_catch_up(struct SNES_Core* snes)
+{
+    struct SNES_Ppu* ppu = &snes->ppu;
+    uint16_t end = SNES_PPU_FIRST_LINE + SNES_PPU_HEIGHT;
+
+    // every line before the current one is done, the current one
+    // is once it's in hblank.
+    if (!ppu->vblank)
+    {
+        const bool hblank = snes->scheduler.cycles - ppu->line_start >= SNES_HBLANK_START_CYCLE;
+        const uint16_t done = ppu->vcounter + hblank;
+
+        end = done < end ? done : end;
+    }
+
+#if SNES_PPU_THREAD
+    if (ppu->thread)
+    {
+        snes_ppu_thread_push_lines(ppu, end);
+        return;
+    }
+#endif
+
+#if SNES_PPU_BANDS
+    if (ppu->bands)
+    {
+        snes_ppu_bands_push_lines(ppu, end);
+        return;
+    }
+#endif
+
+    while (ppu->render_line < end)
+    {
+        snes_ppu_render_line(ppu, &ppu->regs, &ppu->palette, ppu->render_line++);
+    }
+}
+
+void snes_ppu_flush(struct SNES_Core* snes)
+{
+    snes_ppu_catch_up(snes);
+
+#if SNES_PPU_BANDS
+    if (snes->ppu.bands)
+    {
+        snes_ppu_bands_flush(&snes->ppu);
+    }
+#endif
+}
+
+void snes_ppu_start_frame(struct SNES_Core* snes)
+{
+    snes->ppu.render_line = SNES_PPU_FIRST_LINE;
+
+#if SNES_PPU_BANDS
+    if (snes->ppu.bands)
+    {
+        snes_ppu_bands_start_frame(&snes->ppu);
+    }
+#endif
+
+#if SNES_PPU_THREAD
+    if (snes->ppu.thread)
+    {
+        snes_ppu_thread_start_frame(&snes->ppu);
+    }
+#endif
+}
+
+void snes_ppu_end_frame(struct SNES_Core* snes)
+{
+    snes_ppu_flush(snes);
+
+#if SNES_PPU_THREAD
+    if (snes->ppu.thread)
+    {
+        snes_ppu_thread_end_frame(&snes->ppu);
+    }
+#endif
+}
+
+void snes_ppu_set_pixel_format(struct SNES_Ppu* ppu, enum SNES_PixelFormat format)
+{
+    ppu->pixel_format = format;
+    snes_ppu_update_palette(ppu);
+
+#if SNES_PPU_THREAD
+    if (ppu->thread)
+    {
+        snes_ppu_thread_push_format(ppu);
+    }
+#endif
+}
+
 bool snes_ppu_init(struct SNES_Core* snes)
 {
+    struct SNES_Ppu* ppu = &snes->ppu;
+
     // todo: setup default values of registers!
+    for (uint8_t b = 0; b < 16; b++)
+    {
+        for (uint8_t c = 0; c < 32; c++)
+        {
+            // 0 is black, 15 is full brightness
+            const uint8_t level = (c * b + 7) / 15;
+            ppu->brightness_levels[b][c] = (level << 3) | (level >> 2);
+        }
+    }
+
+    ppu->palette.brightness = ppu->regs.INIDISP.master_brightness;
+    snes_ppu_update_palette(ppu);
+    set_obj_size(ppu, ppu->regs.obj.size);
+    snes_ppu_start_frame(snes);
     return true;
 }
@@ -0,0 +1,273 @@
+// ppu rendering split into bands of lines across worker threads.
+// catching up doesn't render, it keeps a copy of the registers for each
+// line that's done instead. the kept lines are rendered together when the
+// frame ends, or before vram / cgram is written mid frame (they'd see the
+// new memory otherwise), see snes_ppu_flush().
+//
+// a flush first decodes the dirty tiles the lines can use, so the workers
+// only read the ppu. each then claims PPU_BAND_LINES lines at a time until
+// none are left, converting the palette to a line's brightness in a copy
+// of its own. the cpu thread renders bands as well, then waits for the
+// workers, so a frame is finished when snes_run_frame() returns just like
+// inline rendering.
+//
+// everything is compiled out unless built with SNES_PPU_BANDS.
+#include "internal.h"
+#include "snes.h"
+#include "types.h"
+#include <stdint.h>
+
+#if SNES_PPU_BANDS
+
+#include <pthread.h>
+#include <stdlib.h>
+
+enum
+{
+    // lines claimed by a worker at a time
+    PPU_BAND_LINES = 8,
+    // fewer lines than this are rendered on the cpu thread
+    PPU_BAND_MIN_LINES = PPU_BAND_LINES * 2,
+    PPU_END_LINE = SNES_PPU_FIRST_LINE + SNES_PPU_HEIGHT,
+};
+
+struct SNES_PpuBands
+{
+    // the registers of each line, up to ppu.render_line
+    struct SNES_PpuRegs regs[PPU_END_LINE];
+    uint16_t line; // next line to render
+
+    // the flush being rendered, set before the workers are woken
+    struct SNES_Ppu* ppu;
+    uint16_t end;
+    uint32_t next; // next line to claim, atomic
+
+    pthread_t* threads;
+    uint32_t count;
+    pthread_mutex_t lock;
+    pthread_cond_t wake; // a flush started or quit
+    pthread_cond_t done; // every worker finished the flush
+    uint64_t generation; // flushes started
+    uint32_t busy; // workers still rendering the flush
+    bool quit;
+};
+
+static void render_bands(struct SNES_PpuBands* bands)
+{
+    struct SNES_Ppu* ppu = bands->ppu;
+    struct SNES_PpuPalette palette = ppu->palette;
+
+    for (;;)
+    {
+        const uint32_t first = __atomic_fetch_add(&bands->next, PPU_BAND_LINES, __ATOMIC_RELAXED);
+        const uint32_t last = first + PPU_BAND_LINES < bands->end ? first + PPU_BAND_LINES : bands->end;
+
+        if (first >= bands->end)
+        {
+            break;
+        }
+
+        for (uint32_t line = first; line < last; line++)
+        {
+            snes_ppu_render_line(ppu, &bands->regs[line], &palette, line);
+        }
+    }
+}
+
+static void* ppu_band_worker(void* user)
+{
+    struct SNES_PpuBands* bands = user;
+    uint64_t generation = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&bands->lock);
+
+        while (!bands->quit && bands->generation == generation)
+        {
+            pthread_cond_wait(&bands->wake, &bands->lock);
+        }
+
+        const bool quit = bands->quit;
+        generation = bands->generation;
+        pthread_mutex_unlock(&bands->lock);
+
+        if (quit)
+        {
+            break;
+        }
+
+        render_bands(bands);
+
+        pthread_mutex_lock(&bands->lock);
+
+        if (--bands->busy == 0)
+        {
+            pthread_cond_signal(&bands->done);
+        }
+
+        pthread_mutex_unlock(&bands->lock);
+    }
+
+    return NULL;
+}
+
+void snes_ppu_bands_push_lines(struct SNES_Ppu* ppu, uint16_t end)
+{
+    struct SNES_PpuBands* bands = ppu->bands;
+
+    while (ppu->render_line < end)
+    {
+        bands->regs[ppu->render_line++] = ppu->regs;
+    }
+}
+
+void snes_ppu_bands_flush(struct SNES_Ppu* ppu)
+{
+    struct SNES_PpuBands* bands = ppu->bands;
+    const uint16_t start = bands->line;
+    const uint16_t end = ppu->render_line;
+
+    if (end <= start)
+    {
+        return;
+    }
+
+    snes_ppu_prepare_lines(ppu, bands->regs + start, end - start);
+    bands->line = end;
+
+    if (end - start < PPU_BAND_MIN_LINES || !bands->count)
+    {
+        for (uint16_t line = start; line < end; line++)
+        {
+            snes_ppu_render_line(ppu, &bands->regs[line], &ppu->palette, line);
+        }
+
+        return;
+    }
+
+    pthread_mutex_lock(&bands->lock);
+    bands->ppu = ppu;
+    bands->end = end;
+    bands->next = start;
+    bands->busy = bands->count;
+    bands->generation++;
+    pthread_cond_broadcast(&bands->wake);
+    pthread_mutex_unlock(&bands->lock);
+
+    render_bands(bands);
+
+    pthread_mutex_lock(&bands->lock);
+
+    while (bands->busy)
+    {
+        pthread_cond_wait(&bands->done, &bands->lock);
+    }
+
+    pthread_mutex_unlock(&bands->lock);
+}
+
+void snes_ppu_bands_start_frame(struct SNES_Ppu* ppu)
+{
+    ppu->bands->line = SNES_PPU_FIRST_LINE;
+}
+
+static void stop_workers(struct SNES_PpuBands* bands, uint32_t count)
+{
+    pthread_mutex_lock(&bands->lock);
+    bands->quit = true;
+    pthread_cond_broadcast(&bands->wake);
+    pthread_mutex_unlock(&bands->lock);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        pthread_join(bands->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&bands->done);
+    pthread_cond_destroy(&bands->wake);
+    pthread_mutex_destroy(&bands->lock);
+}
+
+bool snes_ppu_bands_start(struct SNES_Core* snes, uint32_t workers)
+{
+    snes_ppu_bands_stop(snes);
+
+    // the render thread would render every line on its own anyway
+    if (snes->ppu.thread)
+    {
+        snes_log_err("[PPU] can't render in bands while the render thread is running\n");
+        return false;
+    }
+
+    struct SNES_PpuBands* bands = calloc(1, sizeof(struct SNES_PpuBands));
+
+    if (!bands)
+    {
+        return false;
+    }
+
+    bands->threads = calloc(workers ? workers : 1, sizeof(pthread_t));
+
+    if (!bands->threads)
+    {
+        snes_log_err("[PPU] failed to allocate the render bands\n");
+        free(bands);
+        return false;
+    }
+
+    // the lines already rendered this frame stay rendered
+    bands->line = snes->ppu.render_line;
+
+    pthread_mutex_init(&bands->lock, NULL);
+    pthread_cond_init(&bands->wake, NULL);
+    pthread_cond_init(&bands->done, NULL);
+
+    for (bands->count = 0; bands->count < workers; bands->count++)
+    {
+        if (pthread_create(&bands->threads[bands->count], NULL, ppu_band_worker, bands))
+        {
+            snes_log_err("[PPU] failed to start render band worker %u\n", bands->count);
+            stop_workers(bands, bands->count);
+            free(bands->threads);
+            free(bands);
+            return false;
+        }
+    }
+
+    snes->ppu.bands = bands;
+    return true;
+}
+
+void snes_ppu_bands_stop(struct SNES_Core* snes)
+{
+    struct SNES_PpuBands* bands = snes->ppu.bands;
+
+    if (!bands)
+    {
+        return;
+    }
+
+    // the lines caught up so far are rendered before going back inline
+    snes_ppu_bands_flush(&snes->ppu);
+    stop_workers(bands, bands->count);
+    free(bands->threads);
+    free(bands);
+    snes->ppu.bands = NULL;
+}
+
+#else
+
+bool snes_ppu_bands_start(struct SNES_Core* snes, uint32_t workers)
+{
+    (void)snes;
+    (void)workers;
+    return false;
+}
+
+void snes_ppu_bands_stop(struct SNES_Core* snes)
+{
+    (void)snes;
+}
+
+#endif // SNES_PPU_BANDS
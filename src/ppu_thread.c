@@ -0,0 +1,439 @@
+// pipelined ppu rendering on a thread of its own.
+// the cpu side keeps the full ppu state (reads and dma need it) but doesn't
+// render. catching up queues what rendering needs into a ring instead: the
+// vram / cgram words and oam bytes written, the registers whenever they
+// changed and how far the lines are done. each record carries the line it
+// applies from.
+// the thread applies the records to its own copy of the ppu and renders the
+// lines in between, so the two threads never share mutable state.
+//
+// a finished frame is handed out a frame late, so the thread renders a
+// frame while the cpu runs the next one. snes_run_frame() only waits if
+// the thread is more than a frame behind.
+//
+// everything is compiled out unless built with SNES_PPU_THREAD.
+#include "internal.h"
+#include "snes.h"
+#include "types.h"
+#include <stdint.h>
+
+#if SNES_PPU_THREAD
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+    PPU_RING_SIZE = 1 << 20, // bytes, must be a power of 2
+    PPU_RING_MASK = PPU_RING_SIZE - 1,
+    // the render thread is woken every this many lines
+    PPU_WAKE_LINES = 16,
+    PPU_END_LINE = SNES_PPU_FIRST_LINE + SNES_PPU_HEIGHT,
+};
+
+enum PpuRecordType
+{
+    PpuRecord_LINES, // only renders the lines before it
+    PpuRecord_FRAME, // the next frame starts
+    PpuRecord_REGS, // payload is a struct SNES_PpuRegs
+    PpuRecord_VRAM, // payload is the words from addr
+    PpuRecord_CGRAM, // payload is the word at addr
+    PpuRecord_OAM, // payload is the bytes from addr
+    PpuRecord_FORMAT, // addr is the enum SNES_PixelFormat
+};
+
+// followed by size bytes of payload in the ring
+struct PpuRecord
+{
+    uint32_t size;
+    uint16_t line; // the lines before it are rendered before it's applied
+    uint16_t addr;
+    uint8_t type;
+};
+
+struct SNES_PpuThread
+{
+    uint8_t* ring;
+
+    // head is only written by the cpu, tail only by the render thread
+    uint64_t head;
+    uint64_t tail;
+
+    // cpu side
+    struct SNES_PpuRegs regs; // as last queued
+    uint64_t frames_queued;
+
+    // render thread side
+    struct SNES_Ppu* ppu;
+    uint16_t line; // next line to render
+
+    // frame n is finished into frames[n & 1], guarded by lock
+    void* frames[2];
+    uint64_t frames_done;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake; // records to apply or quit
+    pthread_cond_t space; // the ring has been drained
+    pthread_cond_t done; // a frame was finished
+    bool quit;
+};
+
+static void ring_write(struct SNES_PpuThread* thread, uint64_t pos, const void* data, uint32_t size)
+{
+    const uint32_t start = pos & PPU_RING_MASK;
+    const uint32_t first = size < PPU_RING_SIZE - start ? size : PPU_RING_SIZE - start;
+
+    memcpy(thread->ring + start, data, first);
+    memcpy(thread->ring, (const uint8_t*)data + first, size - first);
+}
+
+static void ring_read(const struct SNES_PpuThread* thread, uint64_t pos, void* data, uint32_t size)
+{
+    const uint32_t start = pos & PPU_RING_MASK;
+    const uint32_t first = size < PPU_RING_SIZE - start ? size : PPU_RING_SIZE - start;
+
+    memcpy(data, thread->ring + start, first);
+    memcpy((uint8_t*)data + first, thread->ring, size - first);
+}
+
+static void render_until(struct SNES_PpuThread* thread, uint16_t line)
+{
+    if (thread->line >= line)
+    {
+        return;
+    }
+
+    while (thread->line < line)
+    {
+        snes_ppu_render_line(thread->ppu, &thread->ppu->regs, &thread->ppu->palette, thread->line++);
+    }
+
+    if (thread->line == PPU_END_LINE)
+    {
+        pthread_mutex_lock(&thread->lock);
+        memcpy(thread->frames[thread->frames_done & 1], &thread->ppu->pixels, sizeof(thread->ppu->pixels));
+        thread->frames_done++;
+        pthread_cond_signal(&thread->done);
+        pthread_mutex_unlock(&thread->lock);
+    }
+}
+
+static void apply_record(struct SNES_PpuThread* thread, const struct PpuRecord* record, uint64_t payload)
+{
+    struct SNES_Ppu* ppu = thread->ppu;
+
+    render_until(thread, record->line);
+
+    switch ((enum PpuRecordType)record->type)
+    {
+        case PpuRecord_LINES:
+            break;
+
+        case PpuRecord_FRAME:
+            thread->line = SNES_PPU_FIRST_LINE;
+            break;
+
+        case PpuRecord_REGS:
+            ring_read(thread, payload, &ppu->regs, sizeof(ppu->regs));
+            break;
+
+        case PpuRecord_VRAM:
+            ring_read(thread, payload, ppu->vram + record->addr, record->size);
+            snes_ppu_on_vram_write(ppu, record->addr, record->size / 2);
+            break;
+
+        case PpuRecord_CGRAM:
+            ring_read(thread, payload, ppu->cgram + record->addr, record->size);
+            snes_ppu_on_cgram_write(ppu, record->addr);
+            break;
+
+        case PpuRecord_OAM:
+            ring_read(thread, payload, ppu->oam + record->addr, record->size);
+            snes_ppu_on_oam_write(ppu, record->addr, record->size);
+            break;
+
+        case PpuRecord_FORMAT:
+            ppu->pixel_format = record->addr;
+            snes_ppu_update_palette(ppu);
+            break;
+    }
+}
+
+static void* ppu_render_thread(void* user)
+{
+    struct SNES_PpuThread* thread = user;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&thread->lock);
+
+        while (!thread->quit && __atomic_load_n(&thread->head, __ATOMIC_ACQUIRE) == thread->tail)
+        {
+            pthread_cond_wait(&thread->wake, &thread->lock);
+        }
+
+        const bool quit = thread->quit;
+        pthread_mutex_unlock(&thread->lock);
+
+        const uint64_t head = __atomic_load_n(&thread->head, __ATOMIC_ACQUIRE);
+
+        while (thread->tail != head)
+        {
+            struct PpuRecord record;
+
+            ring_read(thread, thread->tail, &record, sizeof(record));
+            apply_record(thread, &record, thread->tail + sizeof(record));
+            __atomic_store_n(&thread->tail, thread->tail + sizeof(record) + record.size, __ATOMIC_RELEASE);
+        }
+
+        pthread_mutex_lock(&thread->lock);
+        pthread_cond_signal(&thread->space);
+        pthread_mutex_unlock(&thread->lock);
+
+        if (quit)
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void wake(struct SNES_PpuThread* thread)
+{
+    pthread_mutex_lock(&thread->lock);
+    pthread_cond_signal(&thread->wake);
+    pthread_mutex_unlock(&thread->lock);
+}
+
+static void push(struct SNES_PpuThread* thread, const struct PpuRecord* record, const void* payload)
+{
+    const uint64_t head = thread->head;
+    const uint64_t size = sizeof(*record) + record->size;
+
+    // full, wait for the render thread to catch up
+    if (head + size - __atomic_load_n(&thread->tail, __ATOMIC_ACQUIRE) > PPU_RING_SIZE)
+    {
+        pthread_mutex_lock(&thread->lock);
+        pthread_cond_signal(&thread->wake);
+
+        while (head + size - __atomic_load_n(&thread->tail, __ATOMIC_ACQUIRE) > PPU_RING_SIZE)
+        {
+            pthread_cond_wait(&thread->space, &thread->lock);
+        }
+
+        pthread_mutex_unlock(&thread->lock);
+    }
+
+    ring_write(thread, head, record, sizeof(*record));
+
+    if (record->size)
+    {
+        ring_write(thread, head + sizeof(*record), payload, record->size);
+    }
+    __atomic_store_n(&thread->head, head + size, __ATOMIC_RELEASE);
+}
+
+void snes_ppu_thread_push_lines(struct SNES_Ppu* ppu, uint16_t end)
+{
+    struct SNES_PpuThread* thread = ppu->thread;
+    const uint16_t start = ppu->render_line;
+
+    // every register write since the last catch up applies from start
+    if (memcmp(&thread->regs, &ppu->regs, sizeof(ppu->regs)))
+    {
+        const struct PpuRecord record = { .type = PpuRecord_REGS, .line = start, .size = sizeof(ppu->regs) };
+
+        push(thread, &record, &ppu->regs);
+        thread->regs = ppu->regs;
+    }
+
+    if (end <= start)
+    {
+        return;
+    }
+
+    const struct PpuRecord record = { .type = PpuRecord_LINES, .line = end };
+
+    push(thread, &record, NULL);
+    ppu->render_line = end;
+
+    if (end == PPU_END_LINE)
+    {
+        thread->frames_queued++;
+        wake(thread);
+    }
+    else if (start / PPU_WAKE_LINES != end / PPU_WAKE_LINES)
+    {
+        wake(thread);
+    }
+}
+
+void snes_ppu_thread_push_vram(struct SNES_Ppu* ppu, uint16_t addr, uint32_t words)
+{
+    const struct PpuRecord record = { .type = PpuRecord_VRAM, .line = ppu->render_line, .addr = addr, .size = words * 2 };
+
+    push(ppu->thread, &record, ppu->vram + addr);
+}
+
+void snes_ppu_thread_push_cgram(struct SNES_Ppu* ppu, uint8_t index)
+{
+    const struct PpuRecord record = { .type = PpuRecord_CGRAM, .line = ppu->render_line, .addr = index, .size = 2 };
+
+    push(ppu->thread, &record, ppu->cgram + index);
+}
+
+void snes_ppu_thread_push_oam(struct SNES_Ppu* ppu, uint16_t addr, uint16_t bytes)
+{
+    const struct PpuRecord record = { .type = PpuRecord_OAM, .line = ppu->render_line, .addr = addr, .size = bytes };
+
+    push(ppu->thread, &record, ppu->oam + addr);
+}
+
+void snes_ppu_thread_push_format(struct SNES_Ppu* ppu)
+{
+    const struct PpuRecord record = { .type = PpuRecord_FORMAT, .line = ppu->render_line, .addr = ppu->pixel_format };
+
+    push(ppu->thread, &record, NULL);
+}
+
+void snes_ppu_thread_start_frame(struct SNES_Ppu* ppu)
+{
+    const struct PpuRecord record = { .type = PpuRecord_FRAME, .line = ppu->render_line };
+
+    push(ppu->thread, &record, NULL);
+}
+
+void snes_ppu_thread_end_frame(struct SNES_Ppu* ppu)
+{
+    struct SNES_PpuThread* thread = ppu->thread;
+    const uint64_t frame = thread->frames_queued - 1;
+
+    // the first frame out is the one from before the thread started,
+    // which is already there.
+    if (frame == 0)
+    {
+        return;
+    }
+
+    // the frame before the one just queued. the thread can't be finishing
+    // into its buffer as the frame after it is still being run.
+    pthread_mutex_lock(&thread->lock);
+
+    while (thread->frames_done < frame)
+    {
+        pthread_cond_wait(&thread->done, &thread->lock);
+    }
+
+    memcpy(&ppu->pixels, thread->frames[(frame - 1) & 1], sizeof(ppu->pixels));
+    pthread_mutex_unlock(&thread->lock);
+}
+
+bool snes_ppu_thread_start(struct SNES_Core* snes)
+{
+    snes_ppu_thread_stop(snes);
+
+    // the thread renders inline, on its own copy
+    if (snes->ppu.bands)
+    {
+        snes_log_err("[PPU] can't start the render thread while rendering in bands\n");
+        return false;
+    }
+
+    struct SNES_PpuThread* thread = calloc(1, sizeof(struct SNES_PpuThread));
+
+    if (!thread)
+    {
+        return false;
+    }
+
+    thread->ring = malloc(PPU_RING_SIZE);
+    thread->ppu = malloc(sizeof(struct SNES_Ppu));
+    thread->frames[0] = malloc(sizeof(snes->ppu.pixels));
+    thread->frames[1] = malloc(sizeof(snes->ppu.pixels));
+
+    if (!thread->ring || !thread->ppu || !thread->frames[0] || !thread->frames[1])
+    {
+        snes_log_err("[PPU] failed to allocate the render thread\n");
+        goto fail;
+    }
+
+    // the render thread starts from a copy of the current state
+    memcpy(thread->ppu, &snes->ppu, sizeof(struct SNES_Ppu));
+    thread->ppu->thread = NULL;
+    thread->regs = snes->ppu.regs;
+    thread->line = snes->ppu.render_line;
+
+    pthread_mutex_init(&thread->lock, NULL);
+    pthread_cond_init(&thread->wake, NULL);
+    pthread_cond_init(&thread->space, NULL);
+    pthread_cond_init(&thread->done, NULL);
+
+    if (pthread_create(&thread->thread, NULL, ppu_render_thread, thread))
+    {
+        pthread_cond_destroy(&thread->done);
+        pthread_cond_destroy(&thread->space);
+        pthread_cond_destroy(&thread->wake);
+        pthread_mutex_destroy(&thread->lock);
+        goto fail;
+    }
+
+    snes->ppu.thread = thread;
+    return true;
+
+fail:
+    free(thread->frames[1]);
+    free(thread->frames[0]);
+    free(thread->ppu);
+    free(thread->ring);
+    free(thread);
+    return false;
+}
+
+void snes_ppu_thread_stop(struct SNES_Core* snes)
+{
+    struct SNES_PpuThread* thread = snes->ppu.thread;
+
+    if (!thread)
+    {
+        return;
+    }
+
+    // the thread applies everything that's left before exiting
+    pthread_mutex_lock(&thread->lock);
+    thread->quit = true;
+    pthread_cond_signal(&thread->wake);
+    pthread_mutex_unlock(&thread->lock);
+    pthread_join(thread->thread, NULL);
+
+    // it has rendered up to the same line the cpu side got to
+    memcpy(&snes->ppu.pixels, &thread->ppu->pixels, sizeof(snes->ppu.pixels));
+
+    pthread_cond_destroy(&thread->done);
+    pthread_cond_destroy(&thread->space);
+    pthread_cond_destroy(&thread->wake);
+    pthread_mutex_destroy(&thread->lock);
+    free(thread->frames[1]);
+    free(thread->frames[0]);
+    free(thread->ppu);
+    free(thread->ring);
+    free(thread);
+    snes->ppu.thread = NULL;
+}
+
+#else
+
+bool snes_ppu_thread_start(struct SNES_Core* snes)
+{
+    (void)snes;
+    return false;
+}
+
+void snes_ppu_thread_stop(struct SNES_Core* snes)
+{
+    (void)snes;
+}
+
+#endif // SNES_PPU_THREAD
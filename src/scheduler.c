@@ -0,0 +1,284 @@
+#include "internal.h"
+#include "types.h"
+#include <stdint.h>
+#include <string.h>
+
+
+// NOTE: everything that happens at a point in time (beam position,
+// interrupts, dma, apu sync) is an event on the master clock.
+// the cpu runs uninterrupted until scheduler.next, after which every
+// event that is due is run by snes_scheduler_fire().
+
+static bool entry_before(const struct SNES_SchedulerEntry* a, const struct SNES_SchedulerEntry* b)
+{
+    // ties are ordered by event so that the order is always the same
+    return a->when < b->when || (a->when == b->when && a->event < b->event);
+}
+
+static void heap_swap(struct SNES_Scheduler* s, uint8_t a, uint8_t b)
+{
+    const struct SNES_SchedulerEntry tmp = s->heap[a];
+    s->heap[a] = s->heap[b];
+    s->heap[b] = tmp;
+    s->slot[s->heap[a].event] = a;
+    s->slot[s->heap[b].event] = b;
+}
+
+static void heap_up(struct SNES_Scheduler* s, uint8_t i)
+{
+    while (i > 0)
+    {
+        const uint8_t parent = (i - 1) / 2;
+
+        if (!entry_before(&s->heap[i], &s->heap[parent]))
+        {
+            break;
+        }
+
+        heap_swap(s, i, parent);
+        i = parent;
+    }
+}
+
+static void heap_down(struct SNES_Scheduler* s, uint8_t i)
+{
+    for (;;)
+    {
+        const uint8_t l = i * 2 + 1;
+        const uint8_t r = i * 2 + 2;
+        uint8_t min = i;
+
+        if (l < s->count && entry_before(&s->heap[l], &s->heap[min]))
+        {
+            min = l;
+        }
+
+        if (r < s->count && entry_before(&s->heap[r], &s->heap[min]))
+        {
+            min = r;
+        }
+
+        if (min == i)
+        {
+            break;
+        }
+
+        heap_swap(s, i, min);
+        i = min;
+    }
+}
+
+static void update_next(struct SNES_Scheduler* s)
+{
+    s->next = s->count ? s->heap[0].when : UINT64_MAX;
+}
+
+void snes_scheduler_add(struct SNES_Core* snes, enum SNES_Event event, uint64_t when)
+{
+    struct SNES_Scheduler* s = &snes->scheduler;
+    int8_t i = s->slot[event];
+
+    if (i < 0)
+    {
+        i = s->count++;
+        s->slot[event] = i;
+        s->heap[i].event = event;
+    }
+
+    s->heap[i].when = when;
+    heap_up(s, i);
+    heap_down(s, s->slot[event]);
+    update_next(s);
+}
+
+void snes_scheduler_remove(struct SNES_Core* snes, enum SNES_Event event)
+{
+    struct SNES_Scheduler* s = &snes->scheduler;
+    const int8_t i = s->slot[event];
+
+    if (i < 0)
+    {
+        return;
+    }
+
+    const uint8_t last = --s->count;
+
+    if (i != last)
+    {
+        heap_swap(s, i, last);
+        const uint8_t moved = s->heap[i].event;
+        heap_up(s, i);
+        heap_down(s, s->slot[moved]);
+    }
+
+    s->slot[event] = -1;
+    update_next(s);
+}
+
+static uint16_t lines_per_frame(const struct SNES_Core* snes)
+{
+    return snes->cart.pal ? SNES_LINES_PER_FRAME_PAL : SNES_LINES_PER_FRAME_NTSC;
+}
+
+// schedules the next h/v irq from NMITIMEN, HTIME and VTIME.
+// the irq is simply re-calculated whenever any of them change.
+void snes_scheduler_update_irq(struct SNES_Core* snes)
+{
+    const uint8_t mode = snes->mem.NMITIMEN.irq; // 1=H, 2=V, 3=HV
+    const uint16_t lines = lines_per_frame(snes);
+    const uint64_t now = snes->scheduler.cycles;
+
+    if (!mode || ((mode & 2) && snes->mem.VTIME >= lines))
+    {
+        snes_scheduler_remove(snes, SNES_Event_IRQ);
+        return;
+    }
+
+    // todo: the dot isn't exact, the irq fires a few cycles after HTIME
+    const uint64_t h = (mode & 1) ? snes->mem.HTIME * SNES_CYCLES_PER_DOT : 0;
+    uint64_t when = snes->ppu.line_start + h;
+    uint64_t period = SNES_CYCLES_PER_LINE;
+
+    if (mode & 2)
+    {
+        const uint16_t line_delta = (snes->mem.VTIME + lines - snes->ppu.vcounter) % lines;
+        when += (uint64_t)line_delta * SNES_CYCLES_PER_LINE;
+        period *= lines;
+    }
+
+    while (when <= now)
+    {
+        when += period;
+    }
+
+    snes_scheduler_add(snes, SNES_Event_IRQ, when);
+}
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppuinterlaceoverscan
+static uint16_t vblank_start_line(const struct SNES_Core* snes)
+{
+    return snes->ppu.regs.SETINI.overscan ? SNES_VBLANK_START_LINE_OVERSCAN : SNES_VBLANK_START_LINE;
+}
+
+static void on_line(struct SNES_Core* snes, uint64_t when)
+{
+    snes->ppu.line_start = when;
+    snes->ppu.vcounter++;
+
+    if (snes->ppu.vcounter == lines_per_frame(snes))
+    {
+        snes->ppu.vcounter = 0;
+        snes->ppu.vblank = false;
+        snes->mem.RDNMI = false;
+        snes_ppu_start_frame(snes);
+        snes_hdma_start_frame(snes);
+    }
+    else if (!snes->ppu.vblank && snes->ppu.vcounter >= vblank_start_line(snes))
+    {
+        // set first so the frame is caught up to the end, the lines past
+        // 224 without overscan are drawn black
+        snes->ppu.vblank = true;
+        snes_ppu_end_frame(snes);
+        snes->mem.RDNMI = true;
+        snes->scheduler.frame_end = true;
+
+        if (snes->mem.NMITIMEN.vblank_enable)
+        {
+            snes_cpu_nmi(snes);
+        }
+    }
+
+    snes_scheduler_add(snes, SNES_Event_HBLANK, when + SNES_HBLANK_START_CYCLE);
+    snes_scheduler_add(snes, SNES_Event_LINE, when + SNES_CYCLES_PER_LINE);
+}
+
+static void on_irq(struct SNES_Core* snes)
+{
+    snes->mem.TIMEUP = true;
+    snes_cpu_irq(snes, true);
+    snes_scheduler_update_irq(snes);
+}
+
+static void run_event(struct SNES_Core* snes, enum SNES_Event event, uint64_t when)
+{
+    switch (event)
+    {
+        case SNES_Event_INTERRUPT:
+            snes_cpu_poll_interrupts(snes);
+            break;
+
+        case SNES_Event_HBLANK:
+            if (!snes->ppu.vblank)
+            {
+                snes_hdma_run_line(snes);
+            }
+            break;
+
+        case SNES_Event_LINE:
+            on_line(snes, when);
+            break;
+
+        case SNES_Event_IRQ:
+            on_irq(snes);
+            break;
+
+        case SNES_Event_DMA:
+            snes_dma_run(snes);
+            break;
+
+        case SNES_Event_APU_SYNC:
+            snes_apu_catch_up(snes);
+            snes_scheduler_add(snes, SNES_Event_APU_SYNC, when + SNES_APU_SYNC_CYCLES);
+            break;
+
+        case SNES_Event_MAX:
+            break;
+    }
+}
+
+void snes_scheduler_break(struct SNES_Core* snes)
+{
+    snes->scheduler.next = snes->scheduler.cycles;
+}
+
+void snes_scheduler_fire(struct SNES_Core* snes)
+{
+    struct SNES_Scheduler* s = &snes->scheduler;
+
+    while (s->count && s->heap[0].when <= s->cycles)
+    {
+        const struct SNES_SchedulerEntry entry = s->heap[0];
+
+        // removed first as the event may add itself again
+        snes_scheduler_remove(snes, entry.event);
+        run_event(snes, entry.event, entry.when);
+    }
+
+    // undo snes_scheduler_break()
+    update_next(s);
+
+    // an event (interrupt, dma) may change what an idle loop reads, so
+    // the last iteration can no longer be compared to the next one.
+    snes->cpu_idle.armed = false;
+
+#if SNES_JIT_LOCKSTEP
+    snes_jit_lockstep_fire(snes);
+#endif
+}
+
+bool snes_scheduler_init(struct SNES_Core* snes)
+{
+    memset(&snes->scheduler, 0, sizeof(snes->scheduler));
+    memset(snes->scheduler.slot, -1, sizeof(snes->scheduler.slot));
+    snes->scheduler.next = UINT64_MAX;
+
+    snes->ppu.line_start = 0;
+    snes->ppu.vcounter = 0;
+    snes->ppu.vblank = false;
+
+    snes_scheduler_add(snes, SNES_Event_HBLANK, SNES_HBLANK_START_CYCLE);
+    snes_scheduler_add(snes, SNES_Event_LINE, SNES_CYCLES_PER_LINE);
+    snes_scheduler_add(snes, SNES_Event_APU_SYNC, SNES_APU_SYNC_CYCLES);
+
+    return true;
+}
@@ -6,18 +6,75 @@
 #include <string.h>
 
 
-static struct SNES_Header snes_get_header(const uint8_t* rom, size_t size)
+enum
 {
-    // todo: figure out how to detect this...
-    enum
+    LoROM_OFFSET = 0x7FB0,
+    HiROM_OFFSET = 0xFFB0,
+    // the vectors are after the header, up to 0x7FFF / 0xFFFF
+    HEADER_SPAN = 0x50,
+    RESET_VECTOR = 0x4C,
+};
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snescartridgeromheader
+// how much the bytes at offset look like a header, -1 if they're past the
+// end of the rom. the checksum and its complement count the most, then a
+// map mode that matches where the header is and a reset vector in rom.
+static int score_header(const uint8_t* rom, size_t size, size_t offset, bool hirom)
+{
+    if (offset + HEADER_SPAN > size)
     {
-        LoROM_OFFSET = 0x7FB0,
-        HiROM_OFFSET = 0xFFB0,
-    };
+        return -1;
+    }
 
-    struct SNES_Header header;
-    memcpy(&header, rom + LoROM_OFFSET, sizeof(struct SNES_Header));
-    return header;
+    const struct SNES_Header* header = (const struct SNES_Header*)(rom + offset);
+    const uint16_t complement = header->complement_check[0] | (header->complement_check[1] << 8);
+    const uint16_t checksum = header->check_sum[0] | (header->check_sum[1] << 8);
+    const uint16_t reset = rom[offset + RESET_VECTOR] | (rom[offset + RESET_VECTOR + 1] << 8);
+    const uint8_t layout = header->map_mode & 0x0F;
+    int score = 0;
+
+    if ((checksum ^ complement) == 0xFFFF)
+    {
+        score += 4;
+    }
+
+    if ((header->map_mode & 0xE0) == 0x20)
+    {
+        score += 1;
+
+        // 0 / 2 / 3 are LoROM layouts (S-DD1, SA-1), 1 / 5 / A HiROM ones
+        if (hirom ? (layout == 0x1 || layout == 0x5 || layout == 0xA) : (layout == 0x0 || layout == 0x2 || layout == 0x3))
+        {
+            score += 2;
+        }
+    }
+
+    if (reset >= 0x8000)
+    {
+        score += 2;
+    }
+
+    if (header->fixed_value_2 == 0x33)
+    {
+        score += 1;
+    }
+
+    return score;
+}
+
+// picks the LoROM or HiROM header, LoROM if they score the same
+static bool snes_get_header(const uint8_t* rom, size_t size, struct SNES_Header* header)
+{
+    const int lorom = score_header(rom, size, LoROM_OFFSET, false);
+    const int hirom = score_header(rom, size, HiROM_OFFSET, true);
+
+    if (lorom < 0 && hirom < 0)
+    {
+        return false;
+    }
+
+    memcpy(header, rom + (hirom > lorom ? HiROM_OFFSET : LoROM_OFFSET), sizeof(struct SNES_Header));
+    return true;
 }
 
 static struct SNES_GameTitle snes_get_game_title(const struct SNES_Header* header)
@@ -39,7 +96,14 @@ bool snes_loadrom(struct SNES_Core* snes, const uint8_t* rom, size_t rom_size)
     snes->rom = rom;
     snes->rom_size = rom_size;
 
-    const struct SNES_Header header = snes_get_header(rom, rom_size);
+    struct SNES_Header header;
+
+    if (!snes_get_header(rom, rom_size, &header))
+    {
+        snes_log_err("rom is too small to have a header: %zu bytes\n", rom_size);
+        return false;
+    }
+
     const struct SNES_GameTitle title = snes_get_game_title(&header);
 
     // todo: fix this, getting the wrong size...
@@ -47,6 +111,16 @@ bool snes_loadrom(struct SNES_Core* snes, const uint8_t* rom, size_t rom_size)
     // however it works for SMW ???
     snes->cart.rom_size = 1 << header.rom_size;
     snes->cart.ram_size = 1 << header.ram_size;
+    snes->cart.sram_size = header.ram_size ? 1024 << header.ram_size : 0;
+    // bit 4 is FastROM, which is set by MEMSEL instead
+    snes->cart.map_mode = header.map_mode & ~0x10;
+    snes->cart.cart_type = header.cartridge_type;
+    snes->cart.pal = (header.destination_code >= SNES_DestinationCode_EUROPE && header.destination_code <= SNES_DestinationCode_INDONESIA) || header.destination_code == SNES_DestinationCode_AUSTRALIA;
+
+    if (snes->cart.sram_size > sizeof(snes->mem.sram))
+    {
+        snes->cart.sram_size = sizeof(snes->mem.sram);
+    }
 
     snes_log("SNES header:\n");
     snes_log("\ttitle: %s\n", title.title);
@@ -55,19 +129,100 @@ bool snes_loadrom(struct SNES_Core* snes, const uint8_t* rom, size_t rom_size)
     snes_log("\trom_size: 0x%02X [%zu KiB]\n", header.rom_size, snes->cart.rom_size);
     snes_log("\tram_size: 0x%02X [%zu KiB]\n", header.ram_size, snes->cart.ram_size);
 
+    if (snes->cart.map_mode != SNES_MapMode_LoROM && snes->cart.map_mode != SNES_MapMode_HiROM)
+    {
+        snes_log_err("unsupported map mode: 0x%02X\n", header.map_mode);
+        return false;
+    }
+
+    // the memory map has to be built first as the cpu
+    // fetches the reset vector on init.
+    if (!snes_mem_init(snes))
+    {
+        return false;
+    }
+
+    snes_scheduler_init(snes);
     snes_cpu_init(snes);
     snes_ppu_init(snes);
     snes_apu_init(snes);
 
+#if SNES_JIT
+    // not fatal, the cached interpreter is used instead
+    snes_jit_init(snes);
+#endif
+
     return true;
 }
 
-bool snes_run(struct SNES_Core* snes)
+void snes_quit(struct SNES_Core* snes)
 {
-    for (;;)
+    snes_trace_stop(snes);
+    snes_profile_stop(snes);
+    snes_ppu_thread_stop(snes);
+    snes_ppu_bands_stop(snes);
+
+#if SNES_JIT
+    snes_jit_quit(snes);
+#endif
+}
+
+enum SNES_RunResult snes_run_frame(struct SNES_Core* snes)
+{
+    snes->scheduler.frame_end = false;
+    snes->debug.hit = false;
+
+    while (!snes->scheduler.frame_end)
     {
-        snes_cpu_run(snes);
+        // exec breakpoints are checked by a separate loop so that
+        // the normal one doesn't pay for them.
+        if (snes->debug.exec_count)
+        {
+            snes_debug_run(snes);
+        }
+        else
+        {
+            // the cpu only stops once the next event is due
+            while (snes->scheduler.cycles < snes->scheduler.next)
+            {
+                snes_cpu_run(snes);
+            }
+        }
+
+        // events that are due are fired once the run is resumed
+        if (snes->debug.hit)
+        {
+            return SNES_RunResult_BREAK;
+        }
+
+        snes_scheduler_fire(snes);
     }
 
-    return true;
+    return SNES_RunResult_FRAME;
+}
+
+const void* snes_get_pixels(const struct SNES_Core* snes)
+{
+    return &snes->ppu.pixels;
+}
+
+void snes_set_pixel_format(struct SNES_Core* snes, enum SNES_PixelFormat format)
+{
+    snes_ppu_set_pixel_format(&snes->ppu, format);
+}
+
+uint64_t snes_get_idle_cycles(const struct SNES_Core* snes)
+{
+    return snes->cpu_idle.skipped;
+}
+
+enum SNES_RunResult snes_run(struct SNES_Core* snes)
+{
+    for (;;)
+    {
+        if (snes_run_frame(snes) == SNES_RunResult_BREAK)
+        {
+            return SNES_RunResult_BREAK;
+        }
+    }
 }
@@ -9,8 +9,56 @@ extern "C" {
 
 
 bool snes_init(struct SNES_Core* snes);
+// frees anything allocated by the core (only the jit for now)
+void snes_quit(struct SNES_Core* snes);
 bool snes_loadrom(struct SNES_Core* snes, const uint8_t* rom, size_t rom_size);
-bool snes_run(struct SNES_Core* snes);
+// runs until the start of the next vblank or a breakpoint is hit.
+// running again after a hit carries on from where it stopped.
+enum SNES_RunResult snes_run_frame(struct SNES_Core* snes);
+// runs frames until a breakpoint is hit
+enum SNES_RunResult snes_run(struct SNES_Core* snes);
+// the last frame, SNES_PPU_WIDTH x SNES_PPU_HEIGHT pixels with no row
+// padding, a uint32_t or uint16_t each depending on the pixel format.
+// without overscan (SETINI) the rows past SNES_PPU_HEIGHT_NORMAL are black.
+const void* snes_get_pixels(const struct SNES_Core* snes);
+// XRGB8888 by default, set it before running (or between frames)
+void snes_set_pixel_format(struct SNES_Core* snes, enum SNES_PixelFormat format);
+// renders on a thread of its own, snes_get_pixels() is then a frame late.
+// returns false if SNES_PPU_THREAD is compiled out or the thread failed.
+bool snes_ppu_thread_start(struct SNES_Core* snes);
+// waits for the thread to finish what's queued, then renders inline again
+void snes_ppu_thread_stop(struct SNES_Core* snes);
+// renders each frame in bands of lines across workers extra threads (and
+// the calling one), for when one core can't keep up. returns false if
+// SNES_PPU_BANDS is compiled out, the render thread is running or a
+// worker failed to start.
+bool snes_ppu_bands_start(struct SNES_Core* snes, uint32_t workers);
+// renders what's been caught up, then stops the workers
+void snes_ppu_bands_stop(struct SNES_Core* snes);
+// master cycles skipped by idle loop detection (SNES_CPU_IDLE_SKIP)
+uint64_t snes_get_idle_cycles(const struct SNES_Core* snes);
+// streams a binary trace of every instruction to path (SNES_TRACE only).
+// returns false if tracing is compiled out or the file can't be opened.
+bool snes_trace_start(struct SNES_Core* snes, const char* path);
+// flushes what's left of the trace and closes the file
+void snes_trace_stop(struct SNES_Core* snes);
+
+// counts executions and cycles per opcode, addressing mode and pc
+// (SNES_PROFILE only). returns false if profiling is compiled out.
+bool snes_profile_start(struct SNES_Core* snes);
+void snes_profile_stop(struct SNES_Core* snes);
+// writes a report sorted by cycles, only the top max_pcs pcs are listed
+bool snes_profile_write_report(const struct SNES_Core* snes, const char* path, size_t max_pcs);
+// writes every counter as csv: kind,key,opcode,name,count,cycles
+bool snes_profile_write_csv(const struct SNES_Core* snes, const char* path);
+
+// type is or'd SNES_Breakpoint, start / end are inclusive.
+// returns the id of the breakpoint or -1 if all slots are used.
+int snes_debug_add_breakpoint(struct SNES_Core* snes, uint8_t type, uint32_t start, uint32_t end);
+void snes_debug_remove_breakpoint(struct SNES_Core* snes, int id);
+void snes_debug_clear_breakpoints(struct SNES_Core* snes);
+// returns the hit that stopped the last run, NULL if there wasn't one
+const struct SNES_DebugHit* snes_debug_get_hit(const struct SNES_Core* snes);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,217 @@
+// binary instruction trace.
+// the cpu writes a SNES_TraceRecord per instruction into a ring buffer,
+// a background thread streams the ring to disk. the file is a small
+// header followed by raw records, see tools/trace_decode.c.
+//
+// everything is compiled out unless built with SNES_TRACE, in which case
+// the only cost while not tracing is a NULL check per instruction.
+#include "internal.h"
+#include "snes.h"
+#include "types.h"
+#include <stdint.h>
+
+#if SNES_TRACE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+    TRACE_RING_SIZE = 1 << 16, // records, must be a power of 2
+    TRACE_RING_MASK = TRACE_RING_SIZE - 1,
+    // the flush thread is woken every CHUNK records
+    TRACE_CHUNK_SIZE = 1 << 12,
+};
+
+struct SNES_Trace
+{
+    FILE* file;
+    struct SNES_TraceRecord* ring;
+
+    // head is only written by the cpu, tail only by the flush thread
+    uint64_t head;
+    uint64_t tail;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake; // records to flush or quit
+    pthread_cond_t space; // the ring has been drained
+    bool quit;
+};
+
+static void* trace_flush_thread(void* user)
+{
+    struct SNES_Trace* trace = user;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&trace->lock);
+
+        while (!trace->quit && __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE) == trace->tail)
+        {
+            pthread_cond_wait(&trace->wake, &trace->lock);
+        }
+
+        const bool quit = trace->quit;
+        pthread_mutex_unlock(&trace->lock);
+
+        const uint64_t head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+
+        while (trace->tail != head)
+        {
+            // write up to the end of the ring, then wrap
+            const uint64_t start = trace->tail & TRACE_RING_MASK;
+            uint64_t count = head - trace->tail;
+
+            if (start + count > TRACE_RING_SIZE)
+            {
+                count = TRACE_RING_SIZE - start;
+            }
+
+            fwrite(trace->ring + start, sizeof(struct SNES_TraceRecord), count, trace->file);
+            __atomic_store_n(&trace->tail, trace->tail + count, __ATOMIC_RELEASE);
+        }
+
+        pthread_mutex_lock(&trace->lock);
+        pthread_cond_signal(&trace->space);
+        pthread_mutex_unlock(&trace->lock);
+
+        if (quit)
+        {
+            break;
+        }
+    }
+
+    fflush(trace->file);
+    return NULL;
+}
+
+static void trace_wake(struct SNES_Trace* trace)
+{
+    pthread_mutex_lock(&trace->lock);
+    pthread_cond_signal(&trace->wake);
+    pthread_mutex_unlock(&trace->lock);
+}
+
+void snes_trace_push(struct SNES_Trace* trace, const struct SNES_TraceRecord* record)
+{
+    const uint64_t head = trace->head;
+
+    // full, wait for the flush thread to catch up rather than drop records
+    if (head - __atomic_load_n(&trace->tail, __ATOMIC_ACQUIRE) >= TRACE_RING_SIZE)
+    {
+        pthread_mutex_lock(&trace->lock);
+        pthread_cond_signal(&trace->wake);
+
+        while (head - __atomic_load_n(&trace->tail, __ATOMIC_ACQUIRE) >= TRACE_RING_SIZE)
+        {
+            pthread_cond_wait(&trace->space, &trace->lock);
+        }
+
+        pthread_mutex_unlock(&trace->lock);
+    }
+
+    trace->ring[head & TRACE_RING_MASK] = *record;
+    __atomic_store_n(&trace->head, head + 1, __ATOMIC_RELEASE);
+
+    if (((head + 1) & (TRACE_CHUNK_SIZE - 1)) == 0)
+    {
+        trace_wake(trace);
+    }
+}
+
+bool snes_trace_start(struct SNES_Core* snes, const char* path)
+{
+    snes_trace_stop(snes);
+
+    struct SNES_Trace* trace = calloc(1, sizeof(struct SNES_Trace));
+
+    if (!trace)
+    {
+        return false;
+    }
+
+    trace->ring = malloc(sizeof(struct SNES_TraceRecord) * TRACE_RING_SIZE);
+    trace->file = fopen(path, "wb");
+
+    if (!trace->ring || !trace->file)
+    {
+        snes_log_err("[TRACE] failed to open: %s\n", path);
+        goto fail;
+    }
+
+    const struct SNES_TraceHeader header =
+    {
+        .magic = SNES_TRACE_MAGIC,
+        .version = SNES_TRACE_VERSION,
+        .record_size = sizeof(struct SNES_TraceRecord),
+    };
+
+    fwrite(&header, sizeof(header), 1, trace->file);
+
+    pthread_mutex_init(&trace->lock, NULL);
+    pthread_cond_init(&trace->wake, NULL);
+    pthread_cond_init(&trace->space, NULL);
+
+    if (pthread_create(&trace->thread, NULL, trace_flush_thread, trace))
+    {
+        pthread_cond_destroy(&trace->space);
+        pthread_cond_destroy(&trace->wake);
+        pthread_mutex_destroy(&trace->lock);
+        goto fail;
+    }
+
+    snes->trace = trace;
+    return true;
+
+fail:
+    if (trace->file)
+    {
+        fclose(trace->file);
+    }
+    free(trace->ring);
+    free(trace);
+    return false;
+}
+
+void snes_trace_stop(struct SNES_Core* snes)
+{
+    struct SNES_Trace* trace = snes->trace;
+
+    if (!trace)
+    {
+        return;
+    }
+
+    // the thread flushes everything that's left before exiting
+    pthread_mutex_lock(&trace->lock);
+    trace->quit = true;
+    pthread_cond_signal(&trace->wake);
+    pthread_mutex_unlock(&trace->lock);
+    pthread_join(trace->thread, NULL);
+
+    pthread_cond_destroy(&trace->space);
+    pthread_cond_destroy(&trace->wake);
+    pthread_mutex_destroy(&trace->lock);
+    fclose(trace->file);
+    free(trace->ring);
+    free(trace);
+    snes->trace = NULL;
+}
+
+#else
+
+bool snes_trace_start(struct SNES_Core* snes, const char* path)
+{
+    (void)snes; (void)path;
+    return false;
+}
+
+void snes_trace_stop(struct SNES_Core* snes)
+{
+    (void)snes;
+}
+
+#endif // SNES_TRACE
@@ -8,6 +8,8 @@ extern "C" {
 #include <stdbool.h>
 #include <stdint.h>
 
+struct SNES_Core;
+
 // SOURCE: https://sneslab.net/wiki/SNES_ROM_Header#CPU_Exception_Vectors
 enum SNES_Vector
 {
@@ -16,6 +18,9 @@ enum SNES_Vector
     SNES_Vector_ABORT = 0xFFE8, // 8-9
     SNES_Vector_NMI = 0xFFEA, // A-B
     SNES_Vector_IRQ = 0xFFEE, // E-F
+    // emulation mode
+    SNES_Vector_EMU_NMI = 0xFFFA,
+    SNES_Vector_EMU_IRQ = 0xFFFE,
 };
 
 enum SNES_MapMode
@@ -95,19 +100,53 @@ struct SNES_INIDISP
     uint8_t master_brightness; // 0=screen black 1=dim etc
 };
 
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppuinterlaceoverscan
+struct SNES_SETINI
+{
+    bool extbg; // mode 7 bg2, see render_extbg()
+    bool pseudo_hires; // the sub screen on the even pixels, like modes 5 / 6
+    bool overscan; // 239 lines instead of 224
+};
+
 struct SNES_Cart
 {
     size_t rom_size;
     size_t ram_size;
+    size_t sram_size; // in bytes, 0 if the cart has no sram
 
     uint8_t map_mode;
     uint8_t cart_type;
+    bool pal; // 312 lines per frame instead of 262
+};
+
+// bits of the packed status register
+enum SNES_P
+{
+    SNES_P_C = 1 << 0, // carry
+    SNES_P_Z = 1 << 1, // zero
+    SNES_P_I = 1 << 2, // irq disable
+    SNES_P_D = 1 << 3, // decimal
+    SNES_P_X = 1 << 4, // x/y width
+    SNES_P_M = 1 << 5, // accumulator width
+    SNES_P_V = 1 << 6, // overflow
+    SNES_P_N = 1 << 7, // negative
+};
+
+// the width of A and X/Y, selects the opcode handler table when
+// the cpu is built with SNES_CPU_DISPATCH_TABLES.
+enum SNES_CpuWidth
+{
+    SNES_CpuWidth_M8_X8,
+    SNES_CpuWidth_M8_X16,
+    SNES_CpuWidth_M16_X8,
+    SNES_CpuWidth_M16_X16,
+    SNES_CpuWidth_EMULATION,
+    SNES_CpuWidth_MAX,
 };
 
 struct SNES_Cpu
 {
     uint32_t oprand;
-    uint16_t cycles;
 
     uint16_t PC;
     uint16_t SP;
@@ -118,19 +157,188 @@ struct SNES_Cpu
     uint8_t PBR; // program bank register (bit 16-24 of addr)
     uint8_t DBR; // data bank register (bit 16-24 of addr)
 
-    // flags
+    // flags, N and Z in P are always 0 as they are lazily
+    // evaluated from nz, see set_nz_8() in cpu.c.
+    uint8_t P; // enum SNES_P
+    uint32_t nz; // bit 31 is N, Z is set if the low 16-bits are 0
     bool flag_B; // break (emulation mode only)
-    bool flag_N; // negative
-    bool flag_V; // overflow
-    bool flag_M; // accumulator width
-    bool flag_X; // x/y width
-    bool flag_D; // decimal
-    bool flag_I; // irq disable
-    bool flag_Z; // zero
-    bool flag_C; // carry
     bool flag_E; // emulation
+
+    // only updated on REP, SEP, XCE and PLP
+    uint8_t width; // enum SNES_CpuWidth
+
+    // interrupts are only taken when the interrupt event runs, see scheduler.c
+    bool nmi_pending; // edge, cleared once taken
+    bool irq_line; // level, held until acknowledged (TIMEUP read)
+};
+
+enum
+{
+    SNES_PPU_WIDTH = 256,
+    // the frame is sized for overscan, without it only the first 224 lines
+    // are drawn and the rest are black
+    SNES_PPU_HEIGHT = 239,
+    SNES_PPU_HEIGHT_NORMAL = 224,
+    // line 0 isn't displayed, the picture starts on line 1
+    SNES_PPU_FIRST_LINE = 1,
+};
+
+struct SNES_PpuBg
+{
+    uint16_t map_addr; // word addr of the tilemap
+    uint8_t map_size; // 0=32x32, 1=64x32, 2=32x64, 3=64x64 tiles
+    uint16_t tile_addr; // word addr of the tile data
+    uint16_t hofs; // 10-bit scroll
+    uint16_t vofs;
+};
+
+struct SNES_PpuMode7
+{
+    // the matrix, signed 8.8 fixed point
+    int16_t a;
+    int16_t b;
+    int16_t c;
+    int16_t d;
+    // the centre and scroll, signed 13-bit
+    int16_t x;
+    int16_t y;
+    int16_t hofs;
+    int16_t vofs;
+    uint8_t screen_over; // 0/1=wrap, 2=transparent, 3=tile 0 outside the map
+    bool hflip;
+    bool vflip;
+};
+
+enum SNES_PixelFormat
+{
+    SNES_PixelFormat_XRGB8888, // uint32_t, 0x00RRGGBB
+    SNES_PixelFormat_RGB565, // uint16_t
+};
+
+enum
+{
+    // 8x8 tiles that fit in vram at each bit depth
+    SNES_PPU_TILES_2BPP = 0x8000 / 8,
+    SNES_PPU_TILES_4BPP = 0x8000 / 16,
+    SNES_PPU_TILES_8BPP = 0x8000 / 32,
+};
+
+// vram tiles decoded to a byte per pixel, 8 pixels (a row) per uint64_t.
+// a tile's dirty bit is set by a vram write to it and cleared once it's
+// decoded again, which is only done when a line uses it.
+struct SNES_PpuTileCache
+{
+    uint64_t tiles_2bpp[SNES_PPU_TILES_2BPP][8];
+    uint64_t tiles_4bpp[SNES_PPU_TILES_4BPP][8];
+    uint64_t tiles_8bpp[SNES_PPU_TILES_8BPP][8];
+    uint64_t dirty_2bpp[SNES_PPU_TILES_2BPP / 64];
+    uint64_t dirty_4bpp[SNES_PPU_TILES_4BPP / 64];
+    uint64_t dirty_8bpp[SNES_PPU_TILES_8BPP / 64];
+};
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppuspritesobjs
+struct SNES_PpuObj
+{
+    uint16_t tile_addr[2]; // word addr of tiles 0-255 / 256-511 (OBSEL)
+    uint8_t size; // 0-7, the small / large size pair (OBSEL)
+    uint8_t first; // the sprite with the highest priority (rotation)
+};
+
+enum
+{
+    SNES_PPU_OBJS = 128,
+    // the sprite y wraps, so there are this many lines to be on
+    SNES_PPU_OBJ_LINES = 256,
+};
+
+// the sprites on each line, kept up to date by oam writes so that a line
+// doesn't have to check all 128. a sprite only moves between lines when
+// its y or height changes, a change of OBSEL size moves them all.
+struct SNES_PpuObjLines
+{
+    uint64_t sprites[SNES_PPU_OBJ_LINES][SNES_PPU_OBJS / 64]; // bit per sprite
+    uint8_t y[SNES_PPU_OBJS]; // the lines each sprite is on, as last set
+    uint8_t height[SNES_PPU_OBJS];
+    uint8_t size; // the OBSEL size the heights are from
 };
 
+// the layers a window / screen register has a bit or setting for
+enum SNES_PpuLayer
+{
+    SNES_PpuLayer_BG1,
+    SNES_PpuLayer_BG2,
+    SNES_PpuLayer_BG3,
+    SNES_PpuLayer_BG4,
+    SNES_PpuLayer_OBJ,
+    SNES_PpuLayer_BACKDROP, // also the colour window
+    SNES_PpuLayer_COUNT,
+};
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppuwindow
+struct SNES_PpuWindows
+{
+    // window 1 / 2 cover left to right (inclusive), nothing if left > right
+    uint8_t left[2];
+    uint8_t right[2];
+    // per layer, bit 0/1 invert / enable window 1, bit 2/3 window 2
+    uint8_t select[SNES_PpuLayer_COUNT];
+    uint8_t logic[SNES_PpuLayer_COUNT]; // 0=OR, 1=AND, 2=XOR, 3=XNOR
+};
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesppucolormathematics
+struct SNES_PpuColourMath
+{
+    // 0=never, 1=outside the colour window, 2=inside, 3=always
+    uint8_t force_black;
+    uint8_t prevent;
+    bool add_sub_screen; // otherwise the fixed colour
+    bool direct_colour;
+    bool subtract;
+    bool half;
+    uint8_t enable; // bit per layer
+    uint16_t fixed_colour; // BGR555 (COLDATA)
+};
+
+// the registers a line is rendered from, written by snes_io_write()
+struct SNES_PpuRegs
+{
+    struct SNES_INIDISP INIDISP;
+    struct SNES_SETINI SETINI;
+    uint8_t bg_mode; // 0-7
+    bool bg3_priority; // mode 1 only, high priority bg3 tiles go on top
+    uint8_t bg_big_tiles; // bit per bg, 16x16 tiles instead of 8x8
+    struct SNES_PpuBg bg[4];
+    struct SNES_PpuMode7 m7;
+    struct SNES_PpuObj obj;
+    // bit per layer, shown on the main / sub screen (TM / TS) and hidden
+    // inside the windows on them (TMW / TSW)
+    uint8_t main_screen;
+    uint8_t sub_screen;
+    uint8_t main_window;
+    uint8_t sub_window;
+    struct SNES_PpuWindows windows;
+    struct SNES_PpuColourMath math;
+};
+
+// cgram in the host pixel format with the master brightness applied
+struct SNES_PpuPalette
+{
+    uint8_t brightness;
+    uint32_t colours[256];
+};
+
+// BGR555 to the host pixel format at a brightness. the red and green
+// bits convert on their own from the blue ones, so a colour is
+// rg[bgr555 & 0x3FF] | b[bgr555 >> 10].
+struct SNES_PpuColourLut
+{
+    uint32_t rg[1024];
+    uint32_t b[32];
+};
+
+struct SNES_PpuThread;
+struct SNES_PpuBands;
+
 struct SNES_Ppu
 {
     uint16_t vram[1024 * 32];
@@ -146,12 +354,46 @@ struct SNES_Ppu
     // each slot is 4 bytes, also takes 2-bits at the end of oam
     uint8_t oam[544];
     uint16_t oam_addr;
+    uint16_t oam_write_addr; // byte addr, reloaded from oam_addr
+    uint8_t oam_latch; // even byte of a low table write
+
+    struct SNES_PpuRegs regs;
+    // BGnHOFS / BGnVOFS are written twice, these are the previous writes
+    uint8_t bg_ofs_latch;
+    uint8_t bg_hofs_latch;
+    // M7A-M7D, M7X, M7Y and the mode 7 scroll share a latch of their own
+    uint8_t m7_latch;
 
-    uint8_t obj_size;
-    // name select
-    // name base select
     bool obj_priority_actiavtion;
+    struct SNES_PpuObjLines obj_lines;
+
+    // beam position, advanced by the scheduler
+    uint64_t line_start; // master cycle the current line started on
+    uint16_t vcounter;
+    bool vblank;
 
+    // lines are rendered lazily, see snes_ppu_catch_up()
+    uint16_t render_line; // next line to render
+    union
+    {
+        uint32_t xrgb8888[SNES_PPU_HEIGHT][SNES_PPU_WIDTH];
+        uint16_t rgb565[SNES_PPU_HEIGHT][SNES_PPU_WIDTH];
+    } pixels;
+    struct SNES_PpuTileCache tile_cache;
+
+    // kept up to date by cgram writes. brightness_levels[b][c] is the 5-bit
+    // colour channel c at brightness b, expanded to 8 bits.
+    enum SNES_PixelFormat pixel_format;
+    struct SNES_PpuPalette palette;
+    uint8_t brightness_levels[16][32];
+    // every brightness in the pixel format, for lines that aren't output
+    // through the palette
+    struct SNES_PpuColourLut colour_lut[16];
+
+    // lines are rendered by this instead when it's running, see ppu_thread.c
+    struct SNES_PpuThread* thread;
+    // or in bands across worker threads, see ppu_bands.c
+    struct SNES_PpuBands* bands;
 };
 
 struct SNES_Apu
@@ -187,22 +429,353 @@ struct SNES_Apu
     bool timer_enable[3];
     bool ipl_enable; // enabled reading from ipl at 0xFFC0+
 
+    // the apu runs on its own clock, see snes_apu_catch_up()
+    uint64_t master_cycles; // master cycle it's caught up to
+    uint64_t clock_frac; // left over from converting to spc700 cycles
+    uint8_t timer_clock[3]; // spc700 cycles towards the next timer tick
+    uint8_t timer_stage[3]; // ticks towards the next counter increment
+
     // 64KiB ram
     uint8_t ram[1024 * 64];
 };
 
+// the 24-bit address space is split into 8KiB pages, see mem.c
+enum
+{
+    SNES_MEM_PAGE_SHIFT = 13,
+    SNES_MEM_PAGE_SIZE = 1 << SNES_MEM_PAGE_SHIFT,
+    SNES_MEM_PAGE_MASK = SNES_MEM_PAGE_SIZE - 1,
+    SNES_MEM_PAGE_COUNT = 0x1000000 >> SNES_MEM_PAGE_SHIFT,
+};
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snesdmaandhdmachannel07registers
+enum SNES_DMAP
+{
+    SNES_DMAP_MODE = 0x07, // b-bus pattern, see snes_dma_pattern
+    SNES_DMAP_FIXED = 0x08, // the a-bus addr isn't stepped
+    SNES_DMAP_DECREMENT = 0x10,
+    SNES_DMAP_INDIRECT = 0x40, // hdma only
+    SNES_DMAP_B_TO_A = 0x80,
+};
+
+struct SNES_DmaChannel
+{
+    uint8_t DMAP; // direction, a-bus step and transfer mode
+    uint8_t BBAD; // b-bus register, $2100 | BBAD
+    uint16_t A1T; // a-bus addr, stepped as the transfer runs
+    uint8_t A1B; // a-bus bank, never stepped
+    uint8_t DASB; // hdma indirect bank
+    uint16_t DAS; // byte count (0=64KiB), hdma indirect addr
+    uint16_t A2A; // hdma table addr
+    uint8_t NTRL; // hdma line counter
+    uint8_t UNUSED; // r/w but does nothing
+};
+
+// why writes to a wram page take the slow path, see snes_mem_trap_wram_writes()
+enum SNES_WramTrap
+{
+    SNES_WramTrap_CODE = 1 << 0, // cached cpu blocks
+    SNES_WramTrap_HDMA = 1 << 1, // walked hdma tables
+};
+
 struct SNES_Mem
 {
+    // direct host pointers for each page, NULL pages are either io
+    // or unmapped and are handled by the slow path.
+    const uint8_t* rmap[SNES_MEM_PAGE_COUNT];
+    uint8_t* wmap[SNES_MEM_PAGE_COUNT];
+    // master cycles of an access to each page
+    uint8_t access_cycles[SNES_MEM_PAGE_COUNT];
+
     uint8_t wram[1024 * 128]; // 128KiB
+    uint8_t wram_trap[16]; // enum SNES_WramTrap per 8KiB page
+    uint8_t sram[1024 * 128]; // 128KiB (max)
 
     struct SNES_NMITIMEN NMITIMEN;
-    struct SNES_INIDISP INIDISP;
     uint8_t HDMAEN; // hdma channel(s) enable
     uint8_t MDMAEN; // general dma channel(s)
     uint8_t MEMSEL; // memory-2 waitstate control
+    uint16_t HTIME; // h-irq dot
+    uint16_t VTIME; // v-irq line
+    uint32_t WMADD; // wram port addr (17-bit), see WMDATA
+
+    // multiply / divide unit, the results are set as soon as it starts,
+    // see io_read_alu() in mem.c for reads before it's done.
+    uint8_t WRMPYA;
+    uint8_t WRMPYB;
+    uint16_t WRDIVA;
+    uint8_t WRDIVB;
+    uint16_t RDDIV; // quotient
+    uint16_t RDMPY; // product or remainder
+    uint16_t alu_rddiv; // RDDIV before a divide, it's shifted out as it runs
+    uint8_t alu_steps; // 8 for a multiply, 16 for a divide, 0 if neither ran yet
+    uint64_t alu_start; // master cycle it started on
+    bool RDNMI; // set on vblank, cleared on read
+    bool TIMEUP; // set on h/v irq, cleared on read
 
     // last value placed on the data bus
     uint8_t open_bus;
+
+    // stand in values for APUIO0 / APUIO1 until the spc700 runs, kept
+    // per core so that a lockstep shadow reads the same values.
+    uint8_t apuio_counter;
+    uint32_t apuio_seed;
+
+    struct SNES_DmaChannel dma[8]; // see dma.c
+};
+
+enum
+{
+    SNES_CPU_BLOCK_MAX_OPS = 16,
+    SNES_CPU_BLOCK_COUNT = 1024, // must be a power of 2
+    SNES_CPU_CACHE_LINE_SIZE = 64, // granularity of wram code tracking
+};
+
+// a pre-decoded instruction, see cache_compile() in cpu.c
+struct SNES_CpuOp
+{
+    void (*exec)(struct SNES_Core* snes, uint32_t raw);
+    uint32_t raw; // operand as fetched
+    uint32_t oprand; // address of the operand
+    uint16_t pc_next;
+    uint8_t opcode;
+    uint8_t open_bus; // last byte fetched
+    uint8_t cycles; // cost of fetching the opcode and operand
+};
+
+struct SNES_CpuBlock
+{
+    uint32_t key; // PBR:PC | width << 24
+    uint32_t wram_gen;
+    uint8_t count; // 0 if empty
+    bool wram; // contains code from wram
+    uint16_t hits; // number of times run, used to find hot blocks
+    void (*native)(struct SNES_Core* snes); // jit translated block or NULL
+    struct SNES_CpuOp ops[SNES_CPU_BLOCK_MAX_OPS];
+};
+
+// only used when built with SNES_CPU_CACHE
+struct SNES_CpuCache
+{
+    // bumped each time cached wram code is written to, this
+    // invalidates every block that contains wram.
+    uint32_t wram_gen;
+    uint16_t wram_code_pages; // 8KiB wram pages with cached code
+    uint8_t wram_code_lines[1024 * 128 / SNES_CPU_CACHE_LINE_SIZE / 8];
+
+    struct SNES_CpuBlock blocks[SNES_CPU_BLOCK_COUNT];
+};
+
+// idle loop detection, see idle_check() in cpu.c
+struct SNES_CpuIdle
+{
+    uint32_t key; // PBR:PC after the branch | width << 24
+    bool loop_ok; // the loop only reads plain memory or safe io
+    bool armed; // the state below is from the last iteration, cleared on events
+    uint16_t D;
+    uint8_t DBR;
+
+    uint16_t A;
+    uint16_t X;
+    uint16_t Y;
+    uint8_t P;
+    uint8_t open_bus;
+    uint64_t cycles;
+    size_t ticks;
+
+    uint64_t skipped; // total master cycles skipped
+};
+
+// SOURCE: https://problemkaputt.de/fullsnes.htm#snestiming
+enum
+{
+    SNES_CYCLES_PER_LINE = 1364, // master cycles
+    SNES_CYCLES_PER_DOT = 4,
+    SNES_HBLANK_START_CYCLE = 274 * SNES_CYCLES_PER_DOT,
+    SNES_VBLANK_START_LINE = 225,
+    SNES_VBLANK_START_LINE_OVERSCAN = 240,
+    SNES_LINES_PER_FRAME_NTSC = 262,
+    SNES_LINES_PER_FRAME_PAL = 312,
+    SNES_MASTER_CLOCK_NTSC = 21477272, // master cycles per second
+    SNES_MASTER_CLOCK_PAL = 21281370,
+    // the apu is caught up at least this often, see snes_apu_catch_up()
+    SNES_APU_SYNC_CYCLES = SNES_CYCLES_PER_LINE * 16,
+
+    // cost of a single cpu access, depends on the region (and MEMSEL)
+    SNES_CYCLES_FAST = 6,
+    SNES_CYCLES_SLOW = 8,
+    SNES_CYCLES_XSLOW = 12,
+    SNES_CYCLES_IO = 6, // internal operation
+};
+
+enum
+{
+    SNES_HDMA_LINES = SNES_VBLANK_START_LINE_OVERSCAN, // hdma runs on every visible line
+};
+
+// a channel's hdma state after a line, see hdma.c
+struct SNES_HdmaLine
+{
+    uint8_t data[4]; // written to the b-bus
+    uint8_t len; // bytes written
+    uint8_t cycles;
+    uint8_t NTRL;
+    bool transfer; // the next line writes
+    uint16_t A2A;
+    uint16_t DAS;
+    bool done; // the end of the table was reached
+};
+
+// a channel's table walked once for the rest of the frame
+struct SNES_HdmaWalk
+{
+    struct SNES_HdmaLine init; // the state the frame starts with
+    struct SNES_HdmaLine lines[SNES_HDMA_LINES];
+
+    // the walk is used again next frame while these are the same
+    uint8_t DMAP;
+    uint8_t A1B;
+    uint16_t A1T;
+    uint8_t DASB;
+
+    bool valid;
+    bool cacheable; // only read rom and wram
+    uint8_t first_line; // line the walk started from
+    uint8_t end_line; // first line that wasn't walked, see walk_line()
+    bool live_read; // set by walk_read() for io, open bus and sram
+    uint16_t wram_pages; // 8KiB wram pages the walk read from
+};
+
+struct SNES_Hdma
+{
+    struct SNES_HdmaWalk walks[8];
+    uint16_t wram_pages; // trapped, every page a valid walk read from
+    // bit per channel
+    uint8_t transfer;
+    uint8_t done;
+    uint8_t dirty; // walk again from the live registers before the next line
+};
+
+// at most one of each event is pending at a time, adding an event
+// that is already pending moves it.
+enum SNES_Event
+{
+    SNES_Event_INTERRUPT, // take a pending nmi / irq at the next instruction
+    SNES_Event_HBLANK,
+    SNES_Event_LINE, // end of line, also starts and ends vblank
+    SNES_Event_IRQ, // h/v timer irq
+    SNES_Event_DMA,
+    SNES_Event_APU_SYNC,
+    SNES_Event_MAX,
+};
+
+struct SNES_SchedulerEntry
+{
+    uint64_t when; // master cycle
+    uint8_t event; // enum SNES_Event
+};
+
+struct SNES_Scheduler
+{
+    uint64_t cycles; // master clock
+    uint64_t next; // when of the earliest event, the cpu runs up to this
+
+    // binary min-heap ordered by when (then event)
+    struct SNES_SchedulerEntry heap[SNES_Event_MAX];
+    uint8_t count;
+    int8_t slot[SNES_Event_MAX]; // heap index of each event, -1 if not pending
+
+    bool frame_end; // set on vblank, see snes_run_frame()
+};
+
+// what a breakpoint / watchpoint triggers on, can be or'd together
+enum SNES_Breakpoint
+{
+    SNES_Breakpoint_EXEC = 1 << 0, // before the instruction at the addr runs
+    SNES_Breakpoint_READ = 1 << 1, // any cpu read, including opcode fetches
+    SNES_Breakpoint_WRITE = 1 << 2,
+    // the range is a 16-bit io register range (such as 0x4210-0x4212)
+    // that matches in every bank io is mapped (00-3F, 80-BF).
+    SNES_Breakpoint_IO = 1 << 3,
+};
+
+enum SNES_RunResult
+{
+    SNES_RunResult_FRAME, // ran until the start of vblank
+    SNES_RunResult_BREAK, // stopped on a breakpoint, see snes_debug_get_hit()
+};
+
+enum
+{
+    SNES_DEBUG_MAX_BREAKPOINTS = 32,
+};
+
+struct SNES_BreakpointEntry
+{
+    uint32_t start; // inclusive
+    uint32_t end; // inclusive
+    uint8_t type; // SNES_Breakpoint, 0 if the slot is free
+};
+
+struct SNES_DebugHit
+{
+    uint32_t addr; // address that was executed / accessed
+    uint32_t pc; // PBR:PC at the time of the hit
+    uint8_t type; // the SNES_Breakpoint that was hit
+    uint8_t value; // the value read / written
+    uint8_t id; // the breakpoint that was hit
+};
+
+// breakpoints are looked up through page flags, so that nothing is
+// checked unless the page has a breakpoint in it:
+// - read / write watched pages are removed from rmap / wmap, so only
+//   accesses to them take the slow path and check the watch list.
+// - exec breakpoints make snes_run_frame() step one instruction at a
+//   time, but only while PC is in (or a block away from) a flagged page.
+struct SNES_Debug
+{
+    struct SNES_BreakpointEntry breakpoints[SNES_DEBUG_MAX_BREAKPOINTS];
+    // SNES_Breakpoint of every breakpoint that overlaps the page
+    uint8_t page_flags[SNES_MEM_PAGE_COUNT];
+    // the real mapping of every page, mem.rmap / wmap are NULL if watched
+    const uint8_t* rmap[SNES_MEM_PAGE_COUNT];
+    uint8_t* wmap[SNES_MEM_PAGE_COUNT];
+    uint8_t exec_count; // number of exec breakpoints
+
+    bool hit; // set on a hit until the next run
+    bool skip_exec; // step over the exec breakpoint that was last hit
+    struct SNES_DebugHit last_hit;
+};
+
+// "SNESTRC1" as read from the start of a trace file
+#define SNES_TRACE_MAGIC 0x3143525453454E53ULL
+#define SNES_TRACE_VERSION 1
+
+// a trace file starts with this header, followed by records until eof
+struct SNES_TraceHeader
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t record_size;
+};
+
+// written for every instruction before it runs when tracing,
+// see trace.c and tools/trace_decode.c
+struct SNES_TraceRecord
+{
+    uint64_t cycles; // master clock
+    uint32_t pc; // PBR:PC
+    uint32_t operand; // the (up to) 3 bytes after the opcode
+    uint16_t A;
+    uint16_t X;
+    uint16_t Y;
+    uint16_t SP;
+    uint16_t D;
+    uint8_t DBR;
+    uint8_t P;
+    uint8_t opcode;
+    uint8_t E;
+    uint8_t reserved[2];
 };
 
 struct SNES_Core
@@ -211,7 +784,15 @@ struct SNES_Core
     struct SNES_Ppu ppu;
     struct SNES_Apu apu;
     struct SNES_Mem mem;
+    struct SNES_Hdma hdma;
     struct SNES_Cart cart;
+    struct SNES_Scheduler scheduler;
+    struct SNES_CpuCache cpu_cache;
+    struct SNES_CpuIdle cpu_idle;
+    struct SNES_Debug debug;
+    struct SNES_Jit* jit; // only used with SNES_JIT, see jit_x64.c
+    struct SNES_Trace* trace; // only used with SNES_TRACE, see trace.c
+    struct SNES_Profile* profile; // only used with SNES_PROFILE, see cpu.c
 
     const uint8_t* rom;
     size_t rom_size;
@@ -0,0 +1,160 @@
+// runs frames as fast as possible and prints instructions per second, for
+// comparing cpu build options against each other (the switch vs
+// SNES_CPU_DISPATCH_TABLES, SNES_CPU_CACHE, SNES_JIT...).
+// without a rom it runs a built in LoROM loop that mixes 8 and 16-bit
+// widths, wram loads / stores, stack ops and branches.
+// usage: snes_bench [frames] [rom]
+//
+// e.g. to compare the switch with the dispatch tables:
+//   cmake -S . -B build_switch -DCMAKE_BUILD_TYPE=Release
+//   cmake -S . -B build_tables -DCMAKE_BUILD_TYPE=Release -DSNES_CPU_DISPATCH_TABLES=ON
+//   build each, then run build_*/snes_bench 3000
+// the wram checksum should be the same for every build.
+#include <snes.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static struct SNES_Core snes = {0};
+static uint8_t rom[1024 * 1024 * 4] = {0};
+
+static const uint8_t BENCH_CODE[] =
+{
+    0x78,                     // SEI
+    0x18,                     // CLC
+    0xFB,                     // XCE
+    0xC2, 0x30,               // REP #$30
+    0xA9, 0xFF, 0x01,         // LDA #$01FF
+    0x1B,                     // TCS
+    // outer:
+    0xA9, 0x00, 0x00,         // LDA #$0000
+    0xA2, 0x00, 0x00,         // LDX #$0000
+    // fill:
+    0x9D, 0x00, 0x10,         // STA $1000,X
+    0x18,                     // CLC
+    0x69, 0x37, 0x13,         // ADC #$1337
+    0xE8,                     // INX
+    0xE8,                     // INX
+    0xE0, 0x00, 0x04,         // CPX #$0400
+    0xD0, 0xF2,               // BNE fill
+    0x20, 0x4C, 0x80,         // JSR sub
+    0xE2, 0x20,               // SEP #$20
+    0xA9, 0x80,               // LDA #$80
+    // shift:
+    0x4A,                     // LSR
+    0x08,                     // PHP
+    0x28,                     // PLP
+    0xD0, 0xFB,               // BNE shift
+    0xC2, 0x20,               // REP #$20
+    0xE2, 0x10,               // SEP #$10
+    0xA0, 0x10,               // LDY #$10
+    // dl:
+    0xB9, 0x00, 0x10,         // LDA $1000,Y
+    0x2A,                     // ROL
+    0x99, 0x00, 0x12,         // STA $1200,Y
+    0x88,                     // DEY
+    0xD0, 0xF6,               // BNE dl
+    0xC2, 0x10,               // REP #$10
+    0xAF, 0x00, 0x10, 0x7E,   // LDA $7E1000
+    0x8F, 0x00, 0x20, 0x7F,   // STA $7F2000
+    0xEE, 0x00, 0x11,         // INC $1100
+    0xCE, 0x02, 0x11,         // DEC $1102
+    0x4C, 0x09, 0x80,         // JMP outer
+    // sub:
+    0x48,                     // PHA
+    0xDA,                     // PHX
+    0x5A,                     // PHY
+    0xA2, 0xFE, 0x03,         // LDX #$03FE
+    // sl:
+    0xBD, 0x00, 0x10,         // LDA $1000,X
+    0x38,                     // SEC
+    0xE9, 0x01, 0x00,         // SBC #$0001
+    0x9D, 0x00, 0x14,         // STA $1400,X
+    0xCA,                     // DEX
+    0xCA,                     // DEX
+    0x10, 0xF2,               // BPL sl
+    0x7A,                     // PLY
+    0xFA,                     // PLX
+    0x68,                     // PLA
+    0x60,                     // RTS
+};
+
+// 128KiB LoROM with the code at $00:8000
+static size_t build_rom(void)
+{
+    const size_t size = 0x8000 * 4;
+
+    memcpy(rom, BENCH_CODE, sizeof(BENCH_CODE));
+    rom[0x7FD5] = 0x20; // LoROM
+    rom[0x7FD7] = 0x07; // rom size
+    rom[0x7FD8] = 0x00; // sram size
+    rom[0x7FFC] = 0x00; // reset vector
+    rom[0x7FFD] = 0x80;
+
+    return size;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv)
+{
+    const long frames = argc >= 2 ? atol(argv[1]) : 1000;
+    size_t rom_size = 0;
+
+    if (argc >= 3)
+    {
+        FILE* file = fopen(argv[2], "rb");
+
+        if (!file)
+        {
+            printf("failed to open rom: %s\n", argv[2]);
+            return -1;
+        }
+
+        rom_size = fread(rom, 1, sizeof(rom), file);
+        fclose(file);
+    }
+    else
+    {
+        rom_size = build_rom();
+    }
+
+    snes_init(&snes);
+
+    if (!snes_loadrom(&snes, rom, rom_size))
+    {
+        printf("failed to load rom\n");
+        return -1;
+    }
+
+    const double start = now();
+
+    for (long i = 0; i < frames; i++)
+    {
+        snes_run_frame(&snes);
+    }
+
+    const double seconds = now() - start;
+
+    // fnv-1a, to check that every build ran the same code
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < sizeof(snes.mem.wram); i++)
+    {
+        hash = (hash ^ snes.mem.wram[i]) * 16777619u;
+    }
+
+    printf("frames: %ld instructions: %zu time: %.3fs\n", frames, snes.ticks, seconds);
+    printf("%.1f Minstr/s %.1f frames/s wram: %08X\n", snes.ticks / seconds / 1e6, frames / seconds, hash);
+
+    snes_quit(&snes);
+
+    return 0;
+}
@@ -0,0 +1,225 @@
+// decodes a binary trace written by snes_trace_start() into one line
+// of disassembly and registers per instruction.
+// usage: snes_trace_decode trace.bin > trace.txt
+#include <types.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+enum Mode
+{
+    IMP, // implied
+    ACC, // A
+    IMM8, // #$12
+    IMM_M, // #$12 or #$1234 depending on M
+    IMM_X, // #$12 or #$1234 depending on X
+    REL, // $1234 (8-bit offset)
+    REL16, // $1234 (16-bit offset)
+    DP, // $12
+    DPX, // $12,x
+    DPY, // $12,y
+    DPI, // ($12)
+    DPIX, // ($12,x)
+    DPIY, // ($12),y
+    DPIL, // [$12]
+    DPILY, // [$12],y
+    ABS, // $1234
+    ABSX, // $1234,x
+    ABSY, // $1234,y
+    ABSI, // ($1234)
+    ABSIX, // ($1234,x)
+    ABSIL, // [$1234]
+    LONG, // $123456
+    LONGX, // $123456,x
+    SR, // $12,s
+    SRIY, // ($12,s),y
+    MOVE, // $12,$34 (src bank, dst bank)
+};
+
+struct Opcode
+{
+    const char* name;
+    enum Mode mode;
+};
+
+static const struct Opcode OPCODES[0x100] =
+{
+    {"BRK",IMM8},{"ORA",DPIX},{"COP",IMM8},{"ORA",SR},{"TSB",DP},{"ORA",DP},{"ASL",DP},{"ORA",DPIL},
+    {"PHP",IMP},{"ORA",IMM_M},{"ASL",ACC},{"PHD",IMP},{"TSB",ABS},{"ORA",ABS},{"ASL",ABS},{"ORA",LONG},
+    {"BPL",REL},{"ORA",DPIY},{"ORA",DPI},{"ORA",SRIY},{"TRB",DP},{"ORA",DPX},{"ASL",DPX},{"ORA",DPILY},
+    {"CLC",IMP},{"ORA",ABSY},{"INC",ACC},{"TCS",IMP},{"TRB",ABS},{"ORA",ABSX},{"ASL",ABSX},{"ORA",LONGX},
+    {"JSR",ABS},{"AND",DPIX},{"JSL",LONG},{"AND",SR},{"BIT",DP},{"AND",DP},{"ROL",DP},{"AND",DPIL},
+    {"PLP",IMP},{"AND",IMM_M},{"ROL",ACC},{"PLD",IMP},{"BIT",ABS},{"AND",ABS},{"ROL",ABS},{"AND",LONG},
+    {"BMI",REL},{"AND",DPIY},{"AND",DPI},{"AND",SRIY},{"BIT",DPX},{"AND",DPX},{"ROL",DPX},{"AND",DPILY},
+    {"SEC",IMP},{"AND",ABSY},{"DEC",ACC},{"TSC",IMP},{"BIT",ABSX},{"AND",ABSX},{"ROL",ABSX},{"AND",LONGX},
+    {"RTI",IMP},{"EOR",DPIX},{"WDM",IMM8},{"EOR",SR},{"MVP",MOVE},{"EOR",DP},{"LSR",DP},{"EOR",DPIL},
+    {"PHA",IMP},{"EOR",IMM_M},{"LSR",ACC},{"PHK",IMP},{"JMP",ABS},{"EOR",ABS},{"LSR",ABS},{"EOR",LONG},
+    {"BVC",REL},{"EOR",DPIY},{"EOR",DPI},{"EOR",SRIY},{"MVN",MOVE},{"EOR",DPX},{"LSR",DPX},{"EOR",DPILY},
+    {"CLI",IMP},{"EOR",ABSY},{"PHY",IMP},{"TCD",IMP},{"JML",LONG},{"EOR",ABSX},{"LSR",ABSX},{"EOR",LONGX},
+    {"RTS",IMP},{"ADC",DPIX},{"PER",REL16},{"ADC",SR},{"STZ",DP},{"ADC",DP},{"ROR",DP},{"ADC",DPIL},
+    {"PLA",IMP},{"ADC",IMM_M},{"ROR",ACC},{"RTL",IMP},{"JMP",ABSI},{"ADC",ABS},{"ROR",ABS},{"ADC",LONG},
+    {"BVS",REL},{"ADC",DPIY},{"ADC",DPI},{"ADC",SRIY},{"STZ",DPX},{"ADC",DPX},{"ROR",DPX},{"ADC",DPILY},
+    {"SEI",IMP},{"ADC",ABSY},{"PLY",IMP},{"TDC",IMP},{"JMP",ABSIX},{"ADC",ABSX},{"ROR",ABSX},{"ADC",LONGX},
+    {"BRA",REL},{"STA",DPIX},{"BRL",REL16},{"STA",SR},{"STY",DP},{"STA",DP},{"STX",DP},{"STA",DPIL},
+    {"DEY",IMP},{"BIT",IMM_M},{"TXA",IMP},{"PHB",IMP},{"STY",ABS},{"STA",ABS},{"STX",ABS},{"STA",LONG},
+    {"BCC",REL},{"STA",DPIY},{"STA",DPI},{"STA",SRIY},{"STY",DPX},{"STA",DPX},{"STX",DPY},{"STA",DPILY},
+    {"TYA",IMP},{"STA",ABSY},{"TXS",IMP},{"TXY",IMP},{"STZ",ABS},{"STA",ABSX},{"STZ",ABSX},{"STA",LONGX},
+    {"LDY",IMM_X},{"LDA",DPIX},{"LDX",IMM_X},{"LDA",SR},{"LDY",DP},{"LDA",DP},{"LDX",DP},{"LDA",DPIL},
+    {"TAY",IMP},{"LDA",IMM_M},{"TAX",IMP},{"PLB",IMP},{"LDY",ABS},{"LDA",ABS},{"LDX",ABS},{"LDA",LONG},
+    {"BCS",REL},{"LDA",DPIY},{"LDA",DPI},{"LDA",SRIY},{"LDY",DPX},{"LDA",DPX},{"LDX",DPY},{"LDA",DPILY},
+    {"CLV",IMP},{"LDA",ABSY},{"TSX",IMP},{"TYX",IMP},{"LDY",ABSX},{"LDA",ABSX},{"LDX",ABSY},{"LDA",LONGX},
+    {"CPY",IMM_X},{"CMP",DPIX},{"REP",IMM8},{"CMP",SR},{"CPY",DP},{"CMP",DP},{"DEC",DP},{"CMP",DPIL},
+    {"INY",IMP},{"CMP",IMM_M},{"DEX",IMP},{"WAI",IMP},{"CPY",ABS},{"CMP",ABS},{"DEC",ABS},{"CMP",LONG},
+    {"BNE",REL},{"CMP",DPIY},{"CMP",DPI},{"CMP",SRIY},{"PEI",DPI},{"CMP",DPX},{"DEC",DPX},{"CMP",DPILY},
+    {"CLD",IMP},{"CMP",ABSY},{"PHX",IMP},{"STP",IMP},{"JML",ABSIL},{"CMP",ABSX},{"DEC",ABSX},{"CMP",LONGX},
+    {"CPX",IMM_X},{"SBC",DPIX},{"SEP",IMM8},{"SBC",SR},{"CPX",DP},{"SBC",DP},{"INC",DP},{"SBC",DPIL},
+    {"INX",IMP},{"SBC",IMM_M},{"NOP",IMP},{"XBA",IMP},{"CPX",ABS},{"SBC",ABS},{"INC",ABS},{"SBC",LONG},
+    {"BEQ",REL},{"SBC",DPIY},{"SBC",DPI},{"SBC",SRIY},{"PEA",ABS},{"SBC",DPX},{"INC",DPX},{"SBC",DPILY},
+    {"SED",IMP},{"SBC",ABSY},{"PLX",IMP},{"XCE",IMP},{"JSR",ABSIX},{"SBC",ABSX},{"INC",ABSX},{"SBC",LONGX},
+};
+
+static int mode_len(enum Mode mode, bool m8, bool x8)
+{
+    switch (mode)
+    {
+        case IMP: case ACC:
+            return 0;
+
+        case IMM_M:
+            return m8 ? 1 : 2;
+
+        case IMM_X:
+            return x8 ? 1 : 2;
+
+        case IMM8: case REL: case DP: case DPX: case DPY: case DPI:
+        case DPIX: case DPIY: case DPIL: case DPILY: case SR: case SRIY:
+            return 1;
+
+        case REL16: case ABS: case ABSX: case ABSY: case ABSI:
+        case ABSIX: case ABSIL: case MOVE:
+            return 2;
+
+        case LONG: case LONGX:
+            return 3;
+    }
+
+    return 0;
+}
+
+static void format_operand(char* out, size_t size, const struct SNES_TraceRecord* r, enum Mode mode, int len)
+{
+    const uint32_t v = r->operand & ((1u << (len * 8)) - 1);
+    const uint16_t pc = r->pc & 0xFFFF;
+
+    switch (mode)
+    {
+        case IMP: out[0] = '\0'; break;
+        case ACC: snprintf(out, size, "A"); break;
+        case IMM8: case IMM_M: case IMM_X: snprintf(out, size, "#$%0*X", len * 2, v); break;
+        case REL: snprintf(out, size, "$%04X", (uint16_t)(pc + 2 + (int8_t)v)); break;
+        case REL16: snprintf(out, size, "$%04X", (uint16_t)(pc + 3 + (int16_t)v)); break;
+        case DP: snprintf(out, size, "$%02X", v); break;
+        case DPX: snprintf(out, size, "$%02X,x", v); break;
+        case DPY: snprintf(out, size, "$%02X,y", v); break;
+        case DPI: snprintf(out, size, "($%02X)", v); break;
+        case DPIX: snprintf(out, size, "($%02X,x)", v); break;
+        case DPIY: snprintf(out, size, "($%02X),y", v); break;
+        case DPIL: snprintf(out, size, "[$%02X]", v); break;
+        case DPILY: snprintf(out, size, "[$%02X],y", v); break;
+        case ABS: snprintf(out, size, "$%04X", v); break;
+        case ABSX: snprintf(out, size, "$%04X,x", v); break;
+        case ABSY: snprintf(out, size, "$%04X,y", v); break;
+        case ABSI: snprintf(out, size, "($%04X)", v); break;
+        case ABSIX: snprintf(out, size, "($%04X,x)", v); break;
+        case ABSIL: snprintf(out, size, "[$%04X]", v); break;
+        case LONG: snprintf(out, size, "$%06X", v); break;
+        case LONGX: snprintf(out, size, "$%06X,x", v); break;
+        case SR: snprintf(out, size, "$%02X,s", v); break;
+        case SRIY: snprintf(out, size, "($%02X,s),y", v); break;
+        // the operand bytes are dst then src, but written as src,dst
+        case MOVE: snprintf(out, size, "$%02X,$%02X", v >> 8, v & 0xFF); break;
+    }
+}
+
+static void print_record(const struct SNES_TraceRecord* r)
+{
+    const struct Opcode* op = &OPCODES[r->opcode];
+    const bool m8 = r->E || (r->P & 0x20);
+    const bool x8 = r->E || (r->P & 0x10);
+    const int len = mode_len(op->mode, m8, x8);
+
+    char bytes[16];
+    int n = snprintf(bytes, sizeof(bytes), "%02X", r->opcode);
+
+    for (int i = 0; i < len; i++)
+    {
+        n += snprintf(bytes + n, sizeof(bytes) - n, " %02X", (r->operand >> (i * 8)) & 0xFF);
+    }
+
+    char operand[32];
+    format_operand(operand, sizeof(operand), r, op->mode, len);
+
+    char flags[9];
+    const char* names = "NVMXDIZC";
+
+    for (int i = 0; i < 8; i++)
+    {
+        const bool set = r->P & (0x80 >> i);
+        flags[i] = set ? names[i] : names[i] + ('a' - 'A');
+    }
+
+    flags[8] = '\0';
+
+    printf("%02X:%04X %-11s %s %-12s A:%04X X:%04X Y:%04X S:%04X D:%04X DB:%02X P:%s %c cyc:%llu\n",
+        r->pc >> 16, r->pc & 0xFFFF, bytes, op->name, operand,
+        r->A, r->X, r->Y, r->SP, r->D, r->DBR, flags, r->E ? 'E' : 'N',
+        (unsigned long long)r->cycles
+    );
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        printf("usage: %s trace.bin\n", argv[0]);
+        return -1;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+
+    if (!file)
+    {
+        printf("failed to open: %s\n", argv[1]);
+        return -1;
+    }
+
+    struct SNES_TraceHeader header;
+
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != SNES_TRACE_MAGIC)
+    {
+        printf("not a trace file: %s\n", argv[1]);
+        fclose(file);
+        return -1;
+    }
+
+    if (header.version != SNES_TRACE_VERSION || header.record_size != sizeof(struct SNES_TraceRecord))
+    {
+        printf("unsupported trace version: %u record size: %u\n", header.version, header.record_size);
+        fclose(file);
+        return -1;
+    }
+
+    static struct SNES_TraceRecord records[4096];
+    size_t count;
+
+    while ((count = fread(records, sizeof(records[0]), sizeof(records) / sizeof(records[0]), file)))
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            print_record(&records[i]);
+        }
+    }
+
+    fclose(file);
+    return 0;
+}